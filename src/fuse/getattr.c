@@ -38,6 +38,7 @@
 
 #include "gnunet-fuse.h"
 #include "gfs_download.h"
+#include "gfs_attr_cache.h"
 
 int
 gn_getattr (const char *path, struct stat *stbuf)
@@ -45,6 +46,8 @@ gn_getattr (const char *path, struct stat *stbuf)
   struct GNUNET_FUSE_PathInfo *pi;
   int eno;
 
+  if (GNUNET_OK == GNUNET_FUSE_attr_cache_get (path, stbuf))
+    return 0;
   pi = GNUNET_FUSE_path_info_get (path, &eno);
   if (NULL == pi)
     return - eno;
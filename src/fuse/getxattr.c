@@ -0,0 +1,181 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/*
+ * getxattr.c - FUSE getxattr function
+ *
+ *	 Get extended attributes.
+ *
+ * If 'size' is zero, the size of the value should be returned,
+ * otherwise the value should be stored in 'value' and its size
+ * returned (or -ERANGE if 'value' is too small).
+ */
+/**
+ * @file fuse/getxattr.c
+ * @brief extended attributes with information about the mount,
+ *        about preloads and with the metadata of entries
+ */
+#include "gnunet-fuse.h"
+#include "gfs_preload.h"
+#include "gfs_stats.h"
+
+
+/**
+ * Extended attribute of the root with our statistics.
+ */
+#define STATISTICS_XATTR "user.gnunet-fuse.statistics"
+
+
+/**
+ * Return a value to FUSE (and free it).
+ *
+ * @param data value of the attribute
+ * @param value buffer for the value
+ * @param size size of 'value', 0 to only ask for the size
+ * @return size of the value, or -ERANGE if 'value' is too small
+ */
+static int
+return_value (char *data,
+	      char *value,
+	      size_t size)
+{
+  size_t len;
+
+  len = strlen (data);
+  if ( (0 != size) &&
+       (size < len) )
+  {
+    GNUNET_free (data);
+    return - ERANGE;
+  }
+  if (0 != size)
+    memcpy (value, data, len);
+  GNUNET_free (data);
+  return (int) len;
+}
+
+
+/**
+ * Add an item of metadata to the value of the metadata attribute
+ * (one line per item).  Binary items (i.e. thumbnails) are skipped.
+ *
+ * @param cls the value so far (updated)
+ * @param plugin_name name of the plugin that produced the item
+ * @param type type of the item
+ * @param format format of the item
+ * @param data_mime_type mime type of the item
+ * @param data the item
+ * @param data_len number of bytes in 'data'
+ * @return 0 to continue with the next item
+ */
+static int
+add_meta_item (void *cls,
+	       const char *plugin_name,
+	       enum EXTRACTOR_MetaType type,
+	       enum EXTRACTOR_MetaFormat format,
+	       const char *data_mime_type,
+	       const char *data,
+	       size_t data_len)
+{
+  char **text = cls;
+  char *tmp;
+
+  if ( (EXTRACTOR_METAFORMAT_UTF8 != format) &&
+       (EXTRACTOR_METAFORMAT_C_STRING != format) )
+    return 0;
+  GNUNET_asprintf (&tmp,
+		   "%s%s: %s\n",
+		   *text,
+		   EXTRACTOR_metatype_to_string (type),
+		   data);
+  GNUNET_free (*text);
+  *text = tmp;
+  return 0;
+}
+
+
+int
+gn_getxattr (const char *path, const char *name, char *value,
+	     size_t size)
+{
+  struct GNUNET_CONTAINER_MetaData *meta;
+  struct GNUNET_FUSE_PathInfo *pi;
+  char *data;
+  int eno;
+
+  if (0 == strcmp (name, GNUNET_FUSE_PRELOAD_XATTR))
+  {
+    if (NULL == (pi = GNUNET_FUSE_path_info_get (path, &eno)))
+      return - eno;
+    data = GNUNET_FUSE_preload_status (pi);
+    GNUNET_FUSE_path_info_done (pi);
+    if (NULL == data)
+      return - ENODATA;
+    return return_value (data,
+			 value,
+			 size);
+  }
+  if (0 == strcmp (name, GNUNET_FUSE_URI_XATTR))
+  {
+    if (NULL == (pi = GNUNET_FUSE_path_info_get (path, &eno)))
+      return - eno;
+    /* the root has no URI when mounting several URIs */
+    data = (NULL == pi->uri) ? NULL : GNUNET_FS_uri_to_string (pi->uri);
+    GNUNET_FUSE_path_info_done (pi);
+    if (NULL == data)
+      return - ENODATA;
+    return return_value (data,
+			 value,
+			 size);
+  }
+  if (0 == strcmp (name, GNUNET_FUSE_META_XATTR))
+  {
+    if (NULL == (pi = GNUNET_FUSE_path_info_get (path, &eno)))
+      return - eno;
+    meta = GNUNET_FUSE_path_info_get_meta (pi);
+    GNUNET_FUSE_path_info_done (pi);
+    if (NULL == meta)
+      return - ENODATA;
+    data = GNUNET_strdup ("");
+    (void) GNUNET_CONTAINER_meta_data_iterate (meta,
+					       &add_meta_item,
+					       &data);
+    GNUNET_CONTAINER_meta_data_destroy (meta);
+    return return_value (data,
+			 value,
+			 size);
+  }
+  if (0 != strcmp (path, "/"))
+    return - ENODATA;
+  if (0 == strcmp (name, GNUNET_FUSE_MOUNTS_XATTR))
+  {
+    if (NULL == (data = GNUNET_FUSE_mount_list ()))
+      return - ENODATA;
+    return return_value (data,
+			 value,
+			 size);
+  }
+  if (0 == strcmp (name, STATISTICS_XATTR))
+    return return_value (GNUNET_FUSE_stats_to_string (),
+			 value,
+			 size);
+  return - ENODATA;
+}
+
+/* end of getxattr.c */
@@ -0,0 +1,239 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_attr_cache.c
+ * @brief cache of file attributes by path, filled by readdir
+ *
+ * After a directory listing, the kernel asks for the attributes of
+ * every entry (i.e. for 'ls -l' or 'find').  As readdir already has
+ * the attributes at hand, we remember them here by the hash of the
+ * full path so that 'getattr' does not need to walk the tree from the
+ * root again.  The published content is immutable, so entries only
+ * become invalid if the tree itself is modified.
+ */
+#include "gfs_attr_cache.h"
+
+
+/**
+ * Entry in the attribute cache.
+ */
+struct AttrEntry
+{
+
+  /**
+   * Entries are kept in a DLL in LRU order.
+   */
+  struct AttrEntry *next;
+
+  /**
+   * Entries are kept in a DLL in LRU order.
+   */
+  struct AttrEntry *prev;
+
+  /**
+   * Hash of the full path of the entry.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Cached attributes.
+   */
+  struct stat stbuf;
+
+};
+
+
+/**
+ * Map from path hashes to 'struct AttrEntry'.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *map;
+
+/**
+ * Least recently used entry.
+ */
+static struct AttrEntry *lru_head;
+
+/**
+ * Most recently used entry.
+ */
+static struct AttrEntry *lru_tail;
+
+/**
+ * Lock for 'map' and the LRU list.
+ */
+static struct GNUNET_Mutex *lock;
+
+/**
+ * Maximum number of entries in the cache.
+ */
+static unsigned long long max_size;
+
+
+/**
+ * Initialize the attribute cache.
+ *
+ * @param max_entries maximum number of attributes to keep
+ */
+void
+GNUNET_FUSE_attr_cache_init (unsigned long long max_entries)
+{
+  max_size = max_entries;
+  if (0 == max_size)
+    return;
+  lock = GNUNET_mutex_create (GNUNET_NO);
+  map = GNUNET_CONTAINER_multihashmap_create (1024, GNUNET_YES);
+}
+
+
+/**
+ * Remove an entry from the cache.  Caller must hold the lock.
+ *
+ * @param ae entry to remove
+ */
+static void
+remove_entry (struct AttrEntry *ae)
+{
+  GNUNET_assert (GNUNET_YES ==
+		 GNUNET_CONTAINER_multihashmap_remove (map,
+						       &ae->key,
+						       ae));
+  GNUNET_CONTAINER_DLL_remove (lru_head,
+			       lru_tail,
+			       ae);
+  GNUNET_free (ae);
+}
+
+
+/**
+ * Remember the attributes of an entry in a directory.
+ *
+ * @param dirname path of the directory
+ * @param filename name of the entry in the directory
+ * @param stbuf attributes of the entry
+ */
+void
+GNUNET_FUSE_attr_cache_put (const char *dirname,
+			    const char *filename,
+			    const struct stat *stbuf)
+{
+  size_t dlen = strlen (dirname);
+  size_t flen = strlen (filename);
+  char path[dlen + flen + 2];
+  struct GNUNET_HashCode key;
+  struct AttrEntry *ae;
+
+  if (NULL == map)
+    return;
+  memcpy (path, dirname, dlen);
+  if ( (0 == dlen) ||
+       ('/' != dirname[dlen - 1]) )
+    path[dlen++] = '/';
+  memcpy (&path[dlen], filename, flen + 1);
+  GNUNET_CRYPTO_hash (path, dlen + flen, &key);
+  GNUNET_mutex_lock (lock);
+  if (NULL != (ae = GNUNET_CONTAINER_multihashmap_get (map, &key)))
+  {
+    ae->stbuf = *stbuf;
+    GNUNET_mutex_unlock (lock);
+    return;
+  }
+  if (GNUNET_CONTAINER_multihashmap_size (map) >= max_size)
+    remove_entry (lru_head);
+  ae = GNUNET_new (struct AttrEntry);
+  ae->key = key;
+  ae->stbuf = *stbuf;
+  GNUNET_assert (GNUNET_OK ==
+		 GNUNET_CONTAINER_multihashmap_put (map,
+						    &ae->key,
+						    ae,
+						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  GNUNET_CONTAINER_DLL_insert_tail (lru_head,
+				    lru_tail,
+				    ae);
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Lookup the attributes of a path in the cache.
+ *
+ * @param path path to look up
+ * @param stbuf where to store the attributes
+ * @return GNUNET_OK on success, GNUNET_NO if the path is not cached
+ */
+int
+GNUNET_FUSE_attr_cache_get (const char *path,
+			    struct stat *stbuf)
+{
+  struct GNUNET_HashCode key;
+  struct AttrEntry *ae;
+
+  if (NULL == map)
+    return GNUNET_NO;
+  GNUNET_CRYPTO_hash (path, strlen (path), &key);
+  GNUNET_mutex_lock (lock);
+  if (NULL == (ae = GNUNET_CONTAINER_multihashmap_get (map, &key)))
+  {
+    GNUNET_mutex_unlock (lock);
+    return GNUNET_NO;
+  }
+  *stbuf = ae->stbuf;
+  GNUNET_CONTAINER_DLL_remove (lru_head,
+			       lru_tail,
+			       ae);
+  GNUNET_CONTAINER_DLL_insert_tail (lru_head,
+				    lru_tail,
+				    ae);
+  GNUNET_mutex_unlock (lock);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Forget everything in the attribute cache.
+ */
+void
+GNUNET_FUSE_attr_cache_clear ()
+{
+  if (NULL == map)
+    return;
+  GNUNET_mutex_lock (lock);
+  while (NULL != lru_head)
+    remove_entry (lru_head);
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Destroy the attribute cache.
+ */
+void
+GNUNET_FUSE_attr_cache_done ()
+{
+  if (NULL == map)
+    return;
+  GNUNET_FUSE_attr_cache_clear ();
+  GNUNET_CONTAINER_multihashmap_destroy (map);
+  map = NULL;
+  GNUNET_mutex_destroy (lock);
+  lock = NULL;
+}
+
+/* end of gfs_attr_cache.c */
@@ -0,0 +1,76 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_attr_cache.h
+ * @brief cache of file attributes by path, filled by readdir
+ */
+#ifndef GFS_ATTR_CACHE_H
+#define GFS_ATTR_CACHE_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Initialize the attribute cache.
+ *
+ * @param max_entries maximum number of attributes to keep
+ */
+void
+GNUNET_FUSE_attr_cache_init (unsigned long long max_entries);
+
+
+/**
+ * Remember the attributes of an entry in a directory.
+ *
+ * @param dirname path of the directory
+ * @param filename name of the entry in the directory
+ * @param stbuf attributes of the entry
+ */
+void
+GNUNET_FUSE_attr_cache_put (const char *dirname,
+                            const char *filename,
+                            const struct stat *stbuf);
+
+
+/**
+ * Lookup the attributes of a path in the cache.
+ *
+ * @param path path to look up
+ * @param stbuf where to store the attributes
+ * @return GNUNET_OK on success, GNUNET_NO if the path is not cached
+ */
+int
+GNUNET_FUSE_attr_cache_get (const char *path,
+                            struct stat *stbuf);
+
+
+/**
+ * Forget everything in the attribute cache.
+ */
+void
+GNUNET_FUSE_attr_cache_clear (void);
+
+
+/**
+ * Destroy the attribute cache.
+ */
+void
+GNUNET_FUSE_attr_cache_done (void);
+
+#endif
@@ -0,0 +1,1259 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_cache.c
+ * @brief persistent cache of downloaded content, keyed by URI
+ *
+ * Content in the cache is stored under the hash of its URI.  As
+ * GNUnet URIs identify the content itself, a file in the cache is
+ * valid for as long as it exists.  Files only enter the cache once
+ * they are complete (by renaming them into place), so a crash never
+ * leaves partial content under a cache name.
+ *
+ * Several gnunet-fuse processes may share a cache directory.  Files
+ * that are being downloaded are kept under a "part" name that all
+ * processes download into, next to a "map" with one bit per block
+ * (see 'struct GNUNET_FUSE_CachePartial').  A bit is only set once
+ * the data of its block was written to disk, so after a crash the
+ * map never claims data that is missing.  As writing data to disk is
+ * slow, we collect the blocks that arrive and update the map for all
+ * of them at once (see #FLUSH_BLOCKS and #FLUSH_FREQUENCY).  Processes
+ * use the map to skip blocks that others fetched.  Once a file is complete, it is
+ * linked to its cache name; the "part" and "map" files are removed
+ * when no process uses them anymore (each user holds a shared
+ * 'flock' on the "part" file).
+ *
+ * Complete files that are renamed into the cache are not written to
+ * disk first.  Instead, each process lists them in a "journal" (on
+ * which it holds an exclusive 'flock') before renaming them, writes
+ * them to disk when it shuts down and then removes the journal (a
+ * long running process does the same every #JOURNAL_CHECKPOINT
+ * files, but keeps the then empty journal).  A
+ * journal that is left over (and not locked) thus lists the files a
+ * crash may have damaged; we check those against their URI when we
+ * start (see gfs_verify.c).  Damaged files are turned back into
+ * partial downloads without any available blocks: FS then keeps the
+ * blocks that are intact and only fetches the others again.  Each
+ * entry of the journal is marked as soon as its file was checked,
+ * so the check resumes where it was interrupted.  The check runs
+ * before the mount: until a file is checked, we must not serve it.  Blocks of partial downloads
+ * need no check, they are on disk before the map mentions them.
+ */
+#include "gfs_cache.h"
+#include "gfs_verify.h"
+#include <sys/file.h>
+
+
+/**
+ * Suffix of partial downloads in the cache.
+ */
+#define PARTIAL_SUFFIX "part"
+
+/**
+ * Suffix of the block maps of partial downloads.
+ */
+#define MAP_SUFFIX "map"
+
+/**
+ * How often we try to get hold of a partial download while other
+ * processes remove it.
+ */
+#define MAX_OPEN_ATTEMPTS 16
+
+/**
+ * After how many new blocks of a partial download we write them to
+ * disk and add them to its map (256 blocks are 8 MiB).
+ */
+#define FLUSH_BLOCKS 256
+
+/**
+ * How long new blocks of a partial download may wait until we write
+ * them to disk and add them to its map.
+ */
+#define FLUSH_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 500)
+
+/**
+ * Prefix of the names of journals.
+ */
+#define JOURNAL_PREFIX "journal-"
+
+/**
+ * Marks entries of a journal that were checked.
+ */
+#define JOURNAL_DONE '#'
+
+/**
+ * After how many files in our journal we write them to disk and
+ * empty the journal, so that neither the journal nor the check
+ * after a crash grow without bounds.
+ */
+#define JOURNAL_CHECKPOINT 256
+
+
+/**
+ * A partial download in the persistent cache, which other processes
+ * may use at the same time.
+ */
+struct GNUNET_FUSE_CachePartial
+{
+
+  /**
+   * Name of the file with the data.
+   */
+  char *filename;
+
+  /**
+   * Name of the file with the map of the blocks that are available.
+   */
+  char *map_filename;
+
+  /**
+   * Name of the file once it is complete.
+   */
+  char *final_filename;
+
+  /**
+   * Open handle of 'filename', we hold a shared lock on it while
+   * we use the file.
+   */
+  int fd;
+
+  /**
+   * GNUNET_YES once we linked the complete file to its cache name.
+   */
+  int published;
+
+  /**
+   * Lock for the blocks that are not in the map yet.
+   */
+  struct GNUNET_Mutex *lock;
+
+  /**
+   * Blocks that are available but not in the map yet (one bit per
+   * block, like the map), NULL if there were none so far.
+   */
+  uint8_t *pending;
+
+  /**
+   * Number of bytes in 'pending'.
+   */
+  size_t pending_size;
+
+  /**
+   * First block in 'pending' that is set.
+   */
+  uint64_t pending_first;
+
+  /**
+   * Last block in 'pending' that is set.
+   */
+  uint64_t pending_last;
+
+  /**
+   * Number of blocks we added to 'pending', zero if it is empty.
+   */
+  unsigned int num_pending;
+
+  /**
+   * When we added the first block to 'pending'.
+   */
+  struct GNUNET_TIME_Absolute pending_since;
+
+};
+
+
+/**
+ * An entry of a left over journal.
+ */
+struct Entry
+{
+
+  /**
+   * Offset of the entry in the journal.
+   */
+  off_t offset;
+
+  /**
+   * URI of the content.
+   */
+  struct GNUNET_FS_Uri *uri;
+
+  /**
+   * Suffix of the file with the derived data, NULL for the
+   * content itself.
+   */
+  char *suffix;
+
+  /**
+   * Name of the file in the cache.
+   */
+  char *filename;
+
+};
+
+
+/**
+ * Directory with the persistent cache, NULL for none.
+ */
+static char *cache_dir;
+
+/**
+ * Name of our journal, NULL for none.
+ */
+static char *journal_filename;
+
+/**
+ * Open handle of our journal, we hold an exclusive lock on it.
+ */
+static int journal_fd = -1;
+
+/**
+ * Protects the journal and 'journaled'; held while files that are
+ * listed in the journal get their names in the cache.
+ */
+static struct GNUNET_Mutex *journal_lock;
+
+/**
+ * Names of the files listed in our journal.
+ */
+static char **journaled;
+
+/**
+ * Number of entries in 'journaled'.
+ */
+static unsigned int num_journaled;
+
+/**
+ * Number of entries 'journaled' has room for.
+ */
+static unsigned int journaled_size;
+
+
+/**
+ * Write the entries of the cache directory to disk.
+ */
+static void
+sync_dir ()
+{
+  int fd;
+
+  if (-1 == (fd = open (cache_dir, O_RDONLY)))
+    return;
+  if (0 != fsync (fd))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "fsync",
+			      cache_dir);
+  GNUNET_break (0 == close (fd));
+}
+
+
+
+/**
+ * Turn a damaged copy of content back into a partial download
+ * without any available blocks (so that we download it again,
+ * except for the blocks FS finds intact).
+ *
+ * @param uri URI of the content
+ * @param fn name of the damaged file
+ */
+static void
+discard (const struct GNUNET_FS_Uri *uri,
+	 const char *fn)
+{
+  char *part;
+  char *map;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+	      _("Cached copy `%s' is damaged, it will be downloaded again\n"),
+	      fn);
+  part = GNUNET_FUSE_cache_get_filename (uri, PARTIAL_SUFFIX);
+  map = GNUNET_FUSE_cache_get_filename (uri, MAP_SUFFIX);
+  /* if a partial download exists, its map is right for it */
+  if ( (GNUNET_YES != GNUNET_DISK_file_test (part)) &&
+       ( (0 == unlink (map)) ||
+	 (ENOENT == errno) ) &&
+       (0 != link (fn, part)) &&
+       (EEXIST != errno) &&
+       (ENOENT != errno) )
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "link",
+			      part);
+  if ( (0 != unlink (fn)) &&
+       (ENOENT != errno) )
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "unlink",
+			      fn);
+  GNUNET_free (part);
+  GNUNET_free (map);
+}
+
+
+/**
+ * Checking the files of a left over journal.
+ */
+struct Recovery
+{
+
+  /**
+   * Name of the journal.
+   */
+  const char *filename;
+
+  /**
+   * Open handle of the journal.
+   */
+  int fd;
+
+  /**
+   * The files we check.
+   */
+  const struct GNUNET_FUSE_VerifyFile *files;
+
+  /**
+   * Entries of the journal of the files we check (same order).
+   */
+  struct Entry **entries;
+
+};
+
+
+/**
+ * Mark an entry of a left over journal as checked.
+ *
+ * @param rec the check
+ * @param e the entry
+ */
+static void
+mark_checked (const struct Recovery *rec,
+	      const struct Entry *e)
+{
+  static const char done = JOURNAL_DONE;
+
+  if (1 != pwrite (rec->fd, &done, 1, e->offset))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "pwrite",
+			      rec->filename);
+}
+
+
+/**
+ * A file of a left over journal was checked: discard it if it is
+ * damaged and mark its entry.  Called from the threads checking
+ * the files.
+ *
+ * @param cls the 'struct Recovery'
+ * @param vf the file
+ */
+static void
+file_checked (void *cls,
+	      const struct GNUNET_FUSE_VerifyFile *vf)
+{
+  struct Recovery *rec = cls;
+  struct Entry *e = rec->entries[vf - rec->files];
+
+  if (GNUNET_YES != vf->result)
+  {
+    discard (e->uri, e->filename);
+    /* the entry must not be marked before the file is gone */
+    sync_dir ();
+  }
+  mark_checked (rec, e);
+}
+
+
+/**
+ * Check the files listed in a journal a process left over and
+ * remove the journal.  Does nothing if the process is still running.
+ *
+ * @param cls NULL
+ * @param filename name of a file in the cache directory
+ * @return GNUNET_OK (continue to iterate)
+ */
+static int
+recover_journal (void *cls,
+		 const char *filename)
+{
+  struct GNUNET_FUSE_VerifyFile *files;
+  struct Entry *entries;
+  struct Entry *e;
+  struct stat sbuf;
+  const char *base;
+  char *data;
+  char *line;
+  char *end;
+  char *sp;
+  char *emsg;
+  struct Recovery rec;
+  unsigned int num_entries;
+  unsigned int entries_size;
+  unsigned int num_files;
+  unsigned int damaged;
+  unsigned int i;
+  int fd;
+
+  base = strrchr (filename, '/');
+  base = (NULL == base) ? filename : base + 1;
+  if (0 != strncmp (base, JOURNAL_PREFIX, strlen (JOURNAL_PREFIX)))
+    return GNUNET_OK;
+  if (-1 == (fd = open (filename, O_RDWR)))
+    return GNUNET_OK;
+  if ( (0 != flock (fd, LOCK_EX | LOCK_NB)) ||
+       (0 != fstat (fd, &sbuf)) )
+  {
+    /* still in use (or another process checks it) */
+    GNUNET_break (0 == close (fd));
+    return GNUNET_OK;
+  }
+  data = GNUNET_malloc (sbuf.st_size + 1);
+  if (sbuf.st_size != pread (fd, data, sbuf.st_size, 0))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "read",
+			      filename);
+    GNUNET_free (data);
+    GNUNET_break (0 == close (fd));
+    return GNUNET_OK;
+  }
+  data[sbuf.st_size] = '\0';
+  entries = NULL;
+  num_entries = 0;
+  entries_size = 0;
+  for (line = data; '\0' != *line; line = end + 1)
+  {
+    /* a crash may have cut the last entry short */
+    if (NULL == (end = strchr (line, '\n')))
+      break;
+    *end = '\0';
+    if (JOURNAL_DONE == *line)
+      continue;
+    if (num_entries == entries_size)
+      GNUNET_array_grow (entries,
+			 entries_size,
+			 GNUNET_MAX (16, 2 * entries_size));
+    e = &entries[num_entries++];
+    e->offset = line - data;
+    if (NULL != (sp = strchr (line, ' ')))
+      *sp = '\0';
+    emsg = NULL;
+    e->uri = GNUNET_FS_uri_parse (line, &emsg);
+    GNUNET_free_non_null (emsg);
+    e->suffix = (NULL == sp) ? NULL : GNUNET_strdup (sp + 1);
+    e->filename = (NULL == e->uri) ? NULL : GNUNET_FUSE_cache_get_filename (e->uri, e->suffix);
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+	      _("Checking %u files in the cache after a crash\n"),
+	      num_entries);
+  rec.filename = filename;
+  rec.fd = fd;
+  /* derived data is cheap to compute again, we only check content */
+  files = GNUNET_malloc (num_entries * sizeof (struct GNUNET_FUSE_VerifyFile) + 1);
+  rec.files = files;
+  rec.entries = GNUNET_malloc (num_entries * sizeof (struct Entry *) + 1);
+  num_files = 0;
+  for (i = 0; i < num_entries; i++)
+  {
+    e = &entries[i];
+    if (NULL == e->filename)
+      continue; /* entry we cannot understand, nothing to check */
+    if (NULL != e->suffix)
+    {
+      if ( (0 != unlink (e->filename)) &&
+	   (ENOENT != errno) )
+	GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+				  "unlink",
+				  e->filename);
+      continue;
+    }
+    files[num_files].filename = e->filename;
+    files[num_files].uri = e->uri;
+    rec.entries[num_files] = e;
+    num_files++;
+  }
+  sync_dir ();
+  for (i = 0; i < num_entries; i++)
+    if ( (NULL == entries[i].filename) ||
+	 (NULL != entries[i].suffix) )
+      mark_checked (&rec, &entries[i]);
+  /* each entry is marked as soon as its file is checked, so an
+     interrupted check resumes with the files it did not get to */
+  GNUNET_FUSE_verify_files (files,
+			    num_files,
+			    &file_checked,
+			    &rec);
+  damaged = 0;
+  for (i = 0; i < num_files; i++)
+    if (GNUNET_YES != files[i].result)
+      damaged++;
+  for (i = 0; i < num_entries; i++)
+  {
+    e = &entries[i];
+    if (NULL != e->uri)
+      GNUNET_FS_uri_destroy (e->uri);
+    GNUNET_free_non_null (e->suffix);
+    GNUNET_free_non_null (e->filename);
+  }
+  if (0 != damaged)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("%u of the files in the cache were damaged by a crash\n"),
+		damaged);
+  /* the journal must outlive what we changed in the cache */
+  sync_dir ();
+  if (0 != unlink (filename))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "unlink",
+			      filename);
+  GNUNET_break (0 == close (fd));
+  GNUNET_array_grow (entries, entries_size, 0);
+  GNUNET_free (rec.entries);
+  GNUNET_free (files);
+  GNUNET_free (data);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Create our journal.  The journal is created and locked under a
+ * temporary name first: other processes that start meanwhile must
+ * never see it unlocked, they would take it for a left over one.
+ */
+static void
+journal_create ()
+{
+  char *tmp;
+
+  GNUNET_asprintf (&tmp,
+		   "%s/tmp-XXXXXX",
+		   cache_dir);
+  if (-1 == (journal_fd = mkstemp (tmp)))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "mkstemp",
+			      tmp);
+    GNUNET_free (tmp);
+    return;
+  }
+  GNUNET_asprintf (&journal_filename,
+		   "%s/%s%s",
+		   cache_dir,
+		   JOURNAL_PREFIX,
+		   &tmp[strlen (tmp) - strlen ("XXXXXX")]);
+  if (0 != flock (journal_fd, LOCK_EX))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "flock",
+			      tmp);
+    goto error;
+  }
+  /* unlike rename, linking never replaces a journal a crashed
+     process left behind */
+  if (0 != link (tmp, journal_filename))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "link",
+			      journal_filename);
+    goto error;
+  }
+  GNUNET_break (0 == unlink (tmp));
+  GNUNET_free (tmp);
+  sync_dir ();
+  return;
+ error:
+  GNUNET_break (0 == close (journal_fd));
+  journal_fd = -1;
+  GNUNET_break (0 == unlink (tmp));
+  GNUNET_free (tmp);
+  GNUNET_free (journal_filename);
+  journal_filename = NULL;
+}
+
+
+/**
+ * Write a file to disk.
+ *
+ * @param fn name of the file
+ */
+static void
+sync_file (const char *fn)
+{
+  int fd;
+
+  if (-1 == (fd = open (fn, O_RDONLY)))
+    return;
+  if (0 != fsync (fd))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "fsync",
+			      fn);
+  GNUNET_break (0 == close (fd));
+}
+
+
+/**
+ * Write the files listed in our journal to disk and empty the
+ * journal.  Caller must hold 'journal_lock'.
+ */
+static void
+journal_checkpoint ()
+{
+  unsigned int i;
+
+  for (i = 0; i < num_journaled; i++)
+  {
+    sync_file (journaled[i]);
+    GNUNET_free (journaled[i]);
+  }
+  num_journaled = 0;
+  /* the new names must be on disk before the journal forgets them */
+  sync_dir ();
+  if ( (0 != lseek (journal_fd, 0, SEEK_SET)) ||
+       (0 != ftruncate (journal_fd, 0)) ||
+       (0 != fdatasync (journal_fd)) )
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "ftruncate",
+			      journal_filename);
+}
+
+
+/**
+ * List a file in our journal before it gets its name in the cache.
+ * Caller must hold 'journal_lock' until the file has its name, so
+ * that a checkpoint never drops an entry whose file is not there.
+ *
+ * @param uri URI of the content
+ * @param suffix NULL for the content itself, otherwise the suffix
+ *        of the file with the derived data
+ * @param fn name of the file in the cache
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the file is not
+ *         listed (and must be written to disk by the caller)
+ */
+static int
+journal_add (const struct GNUNET_FS_Uri *uri,
+	     const char *suffix,
+	     const char *fn)
+{
+  char *us;
+  char *line;
+  int ret;
+
+  if (-1 == journal_fd)
+    return GNUNET_SYSERR;
+  us = GNUNET_FS_uri_to_string (uri);
+  GNUNET_asprintf (&line,
+		   "%s%s%s\n",
+		   us,
+		   (NULL == suffix) ? "" : " ",
+		   (NULL == suffix) ? "" : suffix);
+  GNUNET_free (us);
+  ret = GNUNET_OK;
+  if (num_journaled >= JOURNAL_CHECKPOINT)
+    journal_checkpoint ();
+  if ( (strlen (line) != write (journal_fd, line, strlen (line))) ||
+       (0 != fdatasync (journal_fd)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "write",
+			      journal_filename);
+    ret = GNUNET_SYSERR;
+  }
+  else
+  {
+    if (num_journaled == journaled_size)
+      GNUNET_array_grow (journaled,
+			 journaled_size,
+			 GNUNET_MAX (16, 2 * journaled_size));
+    journaled[num_journaled++] = GNUNET_strdup (fn);
+  }
+  GNUNET_free (line);
+  return ret;
+}
+
+
+/**
+ * Setup the persistent cache.  Checks the files that processes
+ * which crashed may have left damaged before it returns, so that we
+ * never serve them; this delays the mount, but only by the files
+ * written shortly before the crash (see #JOURNAL_CHECKPOINT).
+ *
+ * @param dirname directory to keep the cache in, NULL to
+ *        only use temporary files
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_cache_init (const char *dirname)
+{
+  if (NULL == dirname)
+    return GNUNET_OK;
+  if (GNUNET_OK != GNUNET_DISK_directory_create (dirname))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+			      "mkdir",
+			      dirname);
+    return GNUNET_SYSERR;
+  }
+  cache_dir = GNUNET_strdup (dirname);
+  /* processes that crashed left their journals behind */
+  GNUNET_DISK_directory_scan (cache_dir,
+			      &recover_journal,
+			      NULL);
+  journal_lock = GNUNET_mutex_create (GNUNET_NO);
+  journal_create ();
+  return GNUNET_OK;
+}
+
+
+/**
+ * Get the name of the file under which the content of the given
+ * URI (or data derived from it) is (or would be) stored in the
+ * persistent cache.
+ *
+ * @param uri URI of the content
+ * @param suffix NULL for the content itself, otherwise the suffix
+ *        of the file with the derived data (i.e. "idx")
+ * @return NULL if we have no persistent cache, otherwise
+ *         a filename (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_cache_get_filename (const struct GNUNET_FS_Uri *uri,
+				const char *suffix)
+{
+  struct GNUNET_HashCode key;
+  struct GNUNET_CRYPTO_HashAsciiEncoded enc;
+  char *us;
+  char *fn;
+
+  if (NULL == cache_dir)
+    return NULL;
+  us = GNUNET_FS_uri_to_string (uri);
+  GNUNET_CRYPTO_hash (us, strlen (us), &key);
+  GNUNET_free (us);
+  GNUNET_CRYPTO_hash_to_enc (&key, &enc);
+  GNUNET_asprintf (&fn,
+		   "%s/%s%s%s",
+		   cache_dir,
+		   (const char *) enc.encoding,
+		   (NULL == suffix) ? "" : ".",
+		   (NULL == suffix) ? "" : suffix);
+  return fn;
+}
+
+
+/**
+ * Check if the persistent cache has a complete copy of the
+ * content of the given URI.
+ *
+ * @param uri URI of the content
+ * @return GNUNET_YES if the content is in the cache
+ */
+int
+GNUNET_FUSE_cache_test (const struct GNUNET_FS_Uri *uri)
+{
+  char *fn;
+  uint64_t size;
+  int ret;
+
+  if (NULL == (fn = GNUNET_FUSE_cache_get_filename (uri, NULL)))
+    return GNUNET_NO;
+  ret = GNUNET_NO;
+  if ( (GNUNET_YES == GNUNET_DISK_file_test (fn)) &&
+       (GNUNET_OK == GNUNET_DISK_file_size (fn, &size, GNUNET_YES, GNUNET_YES)) &&
+       (size == GNUNET_FS_uri_chk_get_file_size (uri)) )
+    ret = GNUNET_YES;
+  GNUNET_free (fn);
+  return ret;
+}
+
+
+/**
+ * Create a fresh file to download content into.  The file is
+ * created next to the persistent cache (if we have one) so
+ * that it can later be published into the cache atomically.
+ *
+ * @return name of the new file (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_cache_mktemp ()
+{
+  char *fn;
+  int fd;
+
+  if (NULL == cache_dir)
+    return GNUNET_DISK_mktemp ("gnunet-fuse-tempfile");
+  GNUNET_asprintf (&fn,
+		   "%s/tmp-XXXXXX",
+		   cache_dir);
+  fd = mkstemp (fn);
+  if (-1 == fd)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "mkstemp",
+			      fn);
+    GNUNET_free (fn);
+    return GNUNET_DISK_mktemp ("gnunet-fuse-tempfile");
+  }
+  GNUNET_break (0 == close (fd));
+  return fn;
+}
+
+
+/**
+ * Create a fresh directory to download a whole tree into (like
+ * #GNUNET_FUSE_cache_mktemp(), the files in it can later be
+ * published into the cache).
+ *
+ * @return name of the new directory (to be freed by the caller),
+ *         NULL on error
+ */
+char *
+GNUNET_FUSE_cache_mkdtemp ()
+{
+  char *fn;
+
+  if (NULL == cache_dir)
+    return GNUNET_DISK_mkdtemp ("gnunet-fuse-preload");
+  GNUNET_asprintf (&fn,
+		   "%s/tmp-XXXXXX",
+		   cache_dir);
+  if (NULL == mkdtemp (fn))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "mkdtemp",
+			      fn);
+    GNUNET_free (fn);
+    return GNUNET_DISK_mkdtemp ("gnunet-fuse-preload");
+  }
+  return fn;
+}
+
+
+/**
+ * Move a complete download (or complete derived data) into the
+ * persistent cache.
+ *
+ * @param uri URI of the content
+ * @param suffix NULL for the content itself, otherwise the suffix
+ *        of the file with the derived data
+ * @param filename name of the file with the complete data,
+ *        must have been created by #GNUNET_FUSE_cache_mktemp()
+ * @return NULL if we have no persistent cache or if the move failed,
+ *         otherwise the new name of the file (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_cache_publish (const struct GNUNET_FS_Uri *uri,
+			   const char *suffix,
+			   const char *filename)
+{
+  char *fn;
+  int ret;
+
+  if (NULL == (fn = GNUNET_FUSE_cache_get_filename (uri, suffix)))
+    return NULL;
+  GNUNET_mutex_lock (journal_lock);
+  if (GNUNET_OK != journal_add (uri, suffix, fn))
+    sync_file (filename);
+  ret = rename (filename, fn);
+  GNUNET_mutex_unlock (journal_lock);
+  if (0 != ret)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "rename",
+			      fn);
+    GNUNET_free (fn);
+    return NULL;
+  }
+  return fn;
+}
+
+
+/**
+ * Start using the partial download of the content of a URI in the
+ * persistent cache (creating an empty one if no process started to
+ * download it yet).
+ *
+ * @param uri URI of the content
+ * @return NULL if we have no persistent cache or on error
+ */
+struct GNUNET_FUSE_CachePartial *
+GNUNET_FUSE_cache_partial_open (const struct GNUNET_FS_Uri *uri)
+{
+  struct GNUNET_FUSE_CachePartial *cp;
+  struct stat fst;
+  struct stat pst;
+  unsigned int i;
+  int fd;
+
+  if (NULL == cache_dir)
+    return NULL;
+  cp = GNUNET_new (struct GNUNET_FUSE_CachePartial);
+  cp->filename = GNUNET_FUSE_cache_get_filename (uri, PARTIAL_SUFFIX);
+  cp->map_filename = GNUNET_FUSE_cache_get_filename (uri, MAP_SUFFIX);
+  cp->final_filename = GNUNET_FUSE_cache_get_filename (uri, NULL);
+  cp->fd = -1;
+  for (i = 0; i < MAX_OPEN_ATTEMPTS; i++)
+  {
+    if (-1 == (fd = open (cp->filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+				"open",
+				cp->filename);
+      break;
+    }
+    if (0 != flock (fd, LOCK_SH))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+				"flock",
+				cp->filename);
+      GNUNET_break (0 == close (fd));
+      break;
+    }
+    /* the process that held the last lock may have removed the
+       file while we waited; then we locked a file nobody sees */
+    if ( (0 == fstat (fd, &fst)) &&
+	 (0 == stat (cp->filename, &pst)) &&
+	 (fst.st_dev == pst.st_dev) &&
+	 (fst.st_ino == pst.st_ino) )
+    {
+      cp->fd = fd;
+      cp->lock = GNUNET_mutex_create (GNUNET_NO);
+      return cp;
+    }
+    GNUNET_break (0 == close (fd));
+  }
+  GNUNET_free (cp->filename);
+  GNUNET_free (cp->map_filename);
+  GNUNET_free (cp->final_filename);
+  GNUNET_free (cp);
+  return NULL;
+}
+
+
+/**
+ * Get the name of the file to download the content into.
+ *
+ * @param cp the partial download
+ * @return name of the file (valid until the partial download is closed)
+ */
+const char *
+GNUNET_FUSE_cache_partial_get_filename (const struct GNUNET_FUSE_CachePartial *cp)
+{
+  return cp->filename;
+}
+
+
+/**
+ * Read the map of the blocks of a partial download that are
+ * available (because we or other processes downloaded them).
+ *
+ * @param cp the partial download
+ * @param map where to store the map (one bit per block, like the
+ *        'blocks' of a 'struct GNUNET_FUSE_Content'); bytes that
+ *        are not in the map are set to zero
+ * @param size number of bytes in 'map'
+ */
+void
+GNUNET_FUSE_cache_partial_read_map (struct GNUNET_FUSE_CachePartial *cp,
+				    uint8_t *map,
+				    size_t size)
+{
+  ssize_t got;
+  int fd;
+
+  memset (map, 0, size);
+  if (-1 == (fd = open (cp->map_filename, O_RDONLY)))
+    return; /* no blocks yet */
+  if (0 == flock (fd, LOCK_SH))
+  {
+    got = pread (fd, map, size, 0);
+    if (got < 0)
+      memset (map, 0, size);
+  }
+  GNUNET_break (0 == close (fd));
+}
+
+
+/**
+ * Write the data of a partial download to disk and then add blocks
+ * to its map.
+ *
+ * @param cp the partial download
+ * @param bits the blocks to add (one bit per block, like the map)
+ * @param offset offset of 'bits' in the map
+ * @param size number of bytes in 'bits'
+ */
+static void
+write_map (struct GNUNET_FUSE_CachePartial *cp,
+	   const uint8_t *bits,
+	   uint64_t offset,
+	   size_t size)
+{
+  uint8_t *buf;
+  ssize_t got;
+  size_t i;
+  int fd;
+
+  /* all processes write through the same file, so this also syncs
+     what our download processes wrote */
+  if (0 != fdatasync (cp->fd))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "fdatasync",
+			      cp->filename);
+    return;
+  }
+  if (-1 == (fd = open (cp->map_filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "open",
+			      cp->map_filename);
+    return;
+  }
+  if (0 != flock (fd, LOCK_EX))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "flock",
+			      cp->map_filename);
+    GNUNET_break (0 == close (fd));
+    return;
+  }
+  /* the range spans the map of a whole file in the worst case */
+  buf = GNUNET_malloc (size);
+  got = pread (fd, buf, size, offset);
+  if (got < 0)
+    got = 0;
+  memset (&buf[got], 0, size - got);
+  for (i = 0; i < size; i++)
+    buf[i] |= bits[i];
+  if (size != pwrite (fd, buf, size, offset))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "pwrite",
+			      cp->map_filename);
+  GNUNET_free (buf);
+  GNUNET_break (0 == close (fd));
+}
+
+
+/**
+ * Add the blocks that are not in the map of a partial download yet
+ * to the map.  Caller must hold the lock of the partial download,
+ * which we release.
+ *
+ * @param cp the partial download
+ */
+static void
+flush_pending (struct GNUNET_FUSE_CachePartial *cp)
+{
+  uint64_t offset;
+  size_t size;
+  uint8_t *bits;
+
+  if (0 == cp->num_pending)
+  {
+    GNUNET_mutex_unlock (cp->lock);
+    return;
+  }
+  offset = cp->pending_first / 8;
+  size = cp->pending_last / 8 - offset + 1;
+  bits = GNUNET_malloc (size);
+  memcpy (bits, &cp->pending[offset], size);
+  memset (&cp->pending[offset], 0, size);
+  cp->num_pending = 0;
+  /* do not hold up other downloads while we wait for the disk */
+  GNUNET_mutex_unlock (cp->lock);
+  write_map (cp, bits, offset, size);
+  GNUNET_free (bits);
+}
+
+
+/**
+ * Record in the map of a partial download that blocks are available
+ * to other processes.  The data of the blocks is written to disk
+ * first, so the map never refers to data that a crash lost.  To
+ * write to disk less often, we only do so once enough blocks
+ * arrived or the first of them waited long enough; use
+ * #GNUNET_FUSE_cache_partial_flush() for the rest.
+ *
+ * @param cp the partial download
+ * @param first first block that is available
+ * @param last last block that is available
+ */
+void
+GNUNET_FUSE_cache_partial_add_blocks (struct GNUNET_FUSE_CachePartial *cp,
+				      uint64_t first,
+				      uint64_t last)
+{
+  uint64_t block;
+  size_t size;
+
+  GNUNET_mutex_lock (cp->lock);
+  if (cp->pending_size <= last / 8)
+  {
+    /* grow geometrically, downloads mostly move forward */
+    size = GNUNET_MAX (last / 8 + 1, 2 * cp->pending_size);
+    cp->pending = GNUNET_realloc (cp->pending, size);
+    memset (&cp->pending[cp->pending_size], 0, size - cp->pending_size);
+    cp->pending_size = size;
+  }
+  for (block = first; block <= last; block++)
+    cp->pending[block / 8] |= (1 << (block % 8));
+  if (0 == cp->num_pending)
+  {
+    cp->pending_first = first;
+    cp->pending_last = last;
+    cp->pending_since = GNUNET_TIME_absolute_get ();
+  }
+  else
+  {
+    cp->pending_first = GNUNET_MIN (cp->pending_first, first);
+    cp->pending_last = GNUNET_MAX (cp->pending_last, last);
+  }
+  cp->num_pending += last - first + 1;
+  if ( (cp->num_pending < FLUSH_BLOCKS) &&
+       (GNUNET_TIME_absolute_get_duration (cp->pending_since).rel_value_us <
+	FLUSH_FREQUENCY.rel_value_us) )
+  {
+    GNUNET_mutex_unlock (cp->lock);
+    return;
+  }
+  flush_pending (cp);
+}
+
+
+/**
+ * Add all blocks of a partial download that
+ * #GNUNET_FUSE_cache_partial_add_blocks() did not record in the
+ * map yet to the map.
+ *
+ * @param cp the partial download
+ */
+void
+GNUNET_FUSE_cache_partial_flush (struct GNUNET_FUSE_CachePartial *cp)
+{
+  GNUNET_mutex_lock (cp->lock);
+  flush_pending (cp);
+}
+
+
+/**
+ * Make the content of a complete partial download available under
+ * its cache name.  The file keeps its partial name as well until
+ * nobody uses it anymore.
+ *
+ * @param cp the partial download, all blocks must be available
+ * @return GNUNET_OK if we published the file, GNUNET_NO if another
+ *         process did, GNUNET_SYSERR on error
+ */
+int
+GNUNET_FUSE_cache_partial_publish (struct GNUNET_FUSE_CachePartial *cp)
+{
+  /* the complete file must be on disk before it gets its cache name */
+  GNUNET_FUSE_cache_partial_flush (cp);
+  if (GNUNET_YES == cp->published)
+    return GNUNET_NO;
+  cp->published = GNUNET_YES;
+  /* unlike rename, linking never replaces a file others use */
+  if (0 == link (cp->filename, cp->final_filename))
+    return GNUNET_OK;
+  if (EEXIST == errno)
+    return GNUNET_NO;
+  GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			    "link",
+			    cp->final_filename);
+  cp->published = GNUNET_NO;
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Stop using a partial download.  If the content is complete in the
+ * cache and no other process uses the partial download, it is removed.
+ *
+ * @param cp the partial download
+ */
+void
+GNUNET_FUSE_cache_partial_close (struct GNUNET_FUSE_CachePartial *cp)
+{
+  int fd;
+
+  GNUNET_FUSE_cache_partial_flush (cp);
+  GNUNET_break (0 == close (cp->fd));
+  if ( (GNUNET_YES == GNUNET_DISK_file_test (cp->final_filename)) &&
+       (-1 != (fd = open (cp->filename, O_RDONLY))) )
+  {
+    if (0 == flock (fd, LOCK_EX | LOCK_NB))
+    {
+      /* remove the map first: a map without its file is harmless,
+	 a map of another file is not */
+      if ( (0 != unlink (cp->map_filename)) &&
+	   (ENOENT != errno) )
+	GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+				  "unlink",
+				  cp->map_filename);
+      else if (0 != unlink (cp->filename))
+	GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+				  "unlink",
+				  cp->filename);
+    }
+    GNUNET_break (0 == close (fd));
+  }
+  GNUNET_mutex_destroy (cp->lock);
+  GNUNET_free_non_null (cp->pending);
+  GNUNET_free (cp->filename);
+  GNUNET_free (cp->map_filename);
+  GNUNET_free (cp->final_filename);
+  GNUNET_free (cp);
+}
+
+
+/**
+ * Shutdown the persistent cache (does not remove its contents).
+ */
+void
+GNUNET_FUSE_cache_done ()
+{
+  unsigned int i;
+
+  if (-1 != journal_fd)
+  {
+    /* a clean shutdown leaves nothing to check */
+    for (i = 0; i < num_journaled; i++)
+    {
+      sync_file (journaled[i]);
+      GNUNET_free (journaled[i]);
+    }
+    num_journaled = 0;
+    GNUNET_array_grow (journaled, journaled_size, 0);
+    sync_dir ();
+    if (0 != unlink (journal_filename))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+				"unlink",
+				journal_filename);
+    GNUNET_break (0 == close (journal_fd));
+    journal_fd = -1;
+    GNUNET_free (journal_filename);
+    journal_filename = NULL;
+  }
+  if (NULL != journal_lock)
+  {
+    GNUNET_mutex_destroy (journal_lock);
+    journal_lock = NULL;
+  }
+  GNUNET_free_non_null (cache_dir);
+  cache_dir = NULL;
+}
+
+/* end of gfs_cache.c */
@@ -0,0 +1,207 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_cache.h
+ * @brief persistent cache of downloaded content, keyed by URI
+ */
+#ifndef GFS_CACHE_H
+#define GFS_CACHE_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Setup the persistent cache.  Checks the files that processes
+ * which crashed may have left damaged before it returns, so that we
+ * never serve them; this delays the mount, but only by the files
+ * written shortly before the crash.
+ *
+ * @param dirname directory to keep the cache in, NULL to
+ *        only use temporary files
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_cache_init (const char *dirname);
+
+
+/**
+ * Get the name of the file under which the content of the given
+ * URI (or data derived from it) is (or would be) stored in the
+ * persistent cache.
+ *
+ * @param uri URI of the content
+ * @param suffix NULL for the content itself, otherwise the suffix
+ *        of the file with the derived data (i.e. "idx")
+ * @return NULL if we have no persistent cache, otherwise
+ *         a filename (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_cache_get_filename (const struct GNUNET_FS_Uri *uri,
+                                const char *suffix);
+
+
+/**
+ * Check if the persistent cache has a complete copy of the
+ * content of the given URI.
+ *
+ * @param uri URI of the content
+ * @return GNUNET_YES if the content is in the cache
+ */
+int
+GNUNET_FUSE_cache_test (const struct GNUNET_FS_Uri *uri);
+
+
+/**
+ * Create a fresh file to download content into.  The file is
+ * created next to the persistent cache (if we have one) so
+ * that it can later be published into the cache atomically.
+ *
+ * @return name of the new file (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_cache_mktemp (void);
+
+
+/**
+ * Create a fresh directory to download a whole tree into (like
+ * #GNUNET_FUSE_cache_mktemp(), the files in it can later be
+ * published into the cache).
+ *
+ * @return name of the new directory (to be freed by the caller),
+ *         NULL on error
+ */
+char *
+GNUNET_FUSE_cache_mkdtemp (void);
+
+
+/**
+ * Move a complete download (or complete derived data) into the
+ * persistent cache.
+ *
+ * @param uri URI of the content
+ * @param suffix NULL for the content itself, otherwise the suffix
+ *        of the file with the derived data
+ * @param filename name of the file with the complete data,
+ *        must have been created by #GNUNET_FUSE_cache_mktemp()
+ * @return NULL if we have no persistent cache or if the move failed,
+ *         otherwise the new name of the file (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_cache_publish (const struct GNUNET_FS_Uri *uri,
+                           const char *suffix,
+                           const char *filename);
+
+
+/**
+ * Start using the partial download of the content of a URI in the
+ * persistent cache (creating an empty one if no process started to
+ * download it yet).
+ *
+ * @param uri URI of the content
+ * @return NULL if we have no persistent cache or on error
+ */
+struct GNUNET_FUSE_CachePartial *
+GNUNET_FUSE_cache_partial_open (const struct GNUNET_FS_Uri *uri);
+
+
+/**
+ * Get the name of the file to download the content into.
+ *
+ * @param cp the partial download
+ * @return name of the file (valid until the partial download is closed)
+ */
+const char *
+GNUNET_FUSE_cache_partial_get_filename (const struct GNUNET_FUSE_CachePartial *cp);
+
+
+/**
+ * Read the map of the blocks of a partial download that are
+ * available (because we or other processes downloaded them).
+ *
+ * @param cp the partial download
+ * @param map where to store the map (one bit per block, like the
+ *        'blocks' of a 'struct GNUNET_FUSE_Content'); bytes that
+ *        are not in the map are set to zero
+ * @param size number of bytes in 'map'
+ */
+void
+GNUNET_FUSE_cache_partial_read_map (struct GNUNET_FUSE_CachePartial *cp,
+                                    uint8_t *map,
+                                    size_t size);
+
+
+/**
+ * Record in the map of a partial download that blocks are available
+ * to other processes.  The data of the blocks is written to disk
+ * first, so the map never refers to data that a crash lost.  To
+ * write to disk less often, we only do so once enough blocks
+ * arrived or the first of them waited long enough; use
+ * #GNUNET_FUSE_cache_partial_flush() for the rest.
+ *
+ * @param cp the partial download
+ * @param first first block that is available
+ * @param last last block that is available
+ */
+void
+GNUNET_FUSE_cache_partial_add_blocks (struct GNUNET_FUSE_CachePartial *cp,
+                                      uint64_t first,
+                                      uint64_t last);
+
+
+/**
+ * Add all blocks of a partial download that
+ * #GNUNET_FUSE_cache_partial_add_blocks() did not record in the
+ * map yet to the map.
+ *
+ * @param cp the partial download
+ */
+void
+GNUNET_FUSE_cache_partial_flush (struct GNUNET_FUSE_CachePartial *cp);
+
+
+/**
+ * Make the content of a complete partial download available under
+ * its cache name.  The file keeps its partial name as well until
+ * nobody uses it anymore.
+ *
+ * @param cp the partial download, all blocks must be available
+ * @return GNUNET_OK if we published the file, GNUNET_NO if another
+ *         process did, GNUNET_SYSERR on error
+ */
+int
+GNUNET_FUSE_cache_partial_publish (struct GNUNET_FUSE_CachePartial *cp);
+
+
+/**
+ * Stop using a partial download.  If the content is complete in the
+ * cache and no other process uses the partial download, it is removed.
+ *
+ * @param cp the partial download
+ */
+void
+GNUNET_FUSE_cache_partial_close (struct GNUNET_FUSE_CachePartial *cp);
+
+
+/**
+ * Shutdown the persistent cache (does not remove its contents).
+ */
+void
+GNUNET_FUSE_cache_done (void);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_content.c
+ * @brief downloaded content shared by all entries with the same CHK
+ *
+ * The same file often appears in several directories (and in several
+ * versions of a directory).  Path info entries therefore do not own
+ * the data they download; instead, all entries with the same CHK
+ * share one 'struct GNUNET_FUSE_Content' with the 'tmpfile', the map
+ * of the blocks that are available and the downloads that are
+ * running.  Blocks downloaded through one entry are thus available
+ * to all others, and readers of different entries wait for the same
+ * downloads.
+ */
+#include "gfs_content.h"
+#include "gfs_cache.h"
+#include "gfs_stats.h"
+
+
+/**
+ * Map from keys of CHKs to 'struct GNUNET_FUSE_Content'.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *map;
+
+/**
+ * Lock for 'map' and the reference counters of the contents.
+ */
+static struct GNUNET_Mutex *map_lock;
+
+
+/**
+ * Setup the map of all contents.
+ */
+void
+GNUNET_FUSE_content_init ()
+{
+  map_lock = GNUNET_mutex_create (GNUNET_NO);
+  map = GNUNET_CONTAINER_multihashmap_create (1024, GNUNET_YES);
+}
+
+
+/**
+ * Get the content for a URI, creating it if no other path info
+ * entry has the same URI.
+ *
+ * @param uri URI of the file or directory
+ * @return the content, with incremented reference counter
+ */
+struct GNUNET_FUSE_Content *
+GNUNET_FUSE_content_get (const struct GNUNET_FS_Uri *uri)
+{
+  struct GNUNET_FUSE_Content *content;
+  struct GNUNET_HashCode key;
+
+  GNUNET_FS_uri_to_key (uri, &key);
+  GNUNET_mutex_lock (map_lock);
+  if (NULL != (content = GNUNET_CONTAINER_multihashmap_get (map, &key)))
+  {
+    content->rc++;
+    GNUNET_mutex_unlock (map_lock);
+    GNUNET_FUSE_stats_update (gettext_noop ("# entries sharing content"),
+			      1);
+    return content;
+  }
+  content = GNUNET_new (struct GNUNET_FUSE_Content);
+  content->key = key;
+  content->lock = GNUNET_mutex_create (GNUNET_YES);
+  content->rc = 1;
+  GNUNET_assert (GNUNET_OK ==
+		 GNUNET_CONTAINER_multihashmap_put (map,
+						    &content->key,
+						    content,
+						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  GNUNET_mutex_unlock (map_lock);
+  return content;
+}
+
+
+/**
+ * Release a content.  Once no path info entry refers to it, its
+ * 'tmpfile' is removed (unless it is in the persistent cache, where
+ * we only stop using its partial download, if any).
+ *
+ * @param content content to release
+ */
+void
+GNUNET_FUSE_content_release (struct GNUNET_FUSE_Content *content)
+{
+  GNUNET_mutex_lock (map_lock);
+  if (0 != --content->rc)
+  {
+    GNUNET_mutex_unlock (map_lock);
+    return;
+  }
+  GNUNET_assert (GNUNET_YES ==
+		 GNUNET_CONTAINER_multihashmap_remove (map,
+						       &content->key,
+						       content));
+  GNUNET_mutex_unlock (map_lock);
+  /* downloads hold a reference to an entry, so none is left */
+  GNUNET_break (NULL == content->download_head);
+  if (NULL != content->tmpfile)
+  {
+    if (GNUNET_YES != content->tmpfile_cached)
+      GNUNET_break (0 == unlink (content->tmpfile));
+    GNUNET_free (content->tmpfile);
+  }
+  if (NULL != content->partial)
+    GNUNET_FUSE_cache_partial_close (content->partial);
+  GNUNET_free_non_null (content->blocks);
+  GNUNET_mutex_destroy (content->lock);
+  GNUNET_free (content);
+}
+
+
+/**
+ * Destroy the map of all contents.  All contents must have been
+ * released.
+ */
+void
+GNUNET_FUSE_content_done ()
+{
+  GNUNET_break (0 == GNUNET_CONTAINER_multihashmap_size (map));
+  GNUNET_CONTAINER_multihashmap_destroy (map);
+  map = NULL;
+  GNUNET_mutex_destroy (map_lock);
+  map_lock = NULL;
+}
+
+/* end of gfs_content.c */
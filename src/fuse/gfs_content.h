@@ -0,0 +1,65 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_content.h
+ * @brief downloaded content shared by all entries with the same CHK
+ */
+#ifndef GFS_CONTENT_H
+#define GFS_CONTENT_H
+
+#include "gnunet-fuse.h"
+
+
+/**
+ * Setup the map of all contents.
+ */
+void
+GNUNET_FUSE_content_init (void);
+
+
+/**
+ * Get the content for a URI, creating it if no other path info
+ * entry has the same URI.
+ *
+ * @param uri URI of the file or directory
+ * @return the content, with incremented reference counter
+ */
+struct GNUNET_FUSE_Content *
+GNUNET_FUSE_content_get (const struct GNUNET_FS_Uri *uri);
+
+
+/**
+ * Release a content.  Once no path info entry refers to it, its
+ * 'tmpfile' is removed (unless it is in the persistent cache).
+ *
+ * @param content content to release
+ */
+void
+GNUNET_FUSE_content_release (struct GNUNET_FUSE_Content *content);
+
+
+/**
+ * Destroy the map of all contents.  All contents must have been
+ * released.
+ */
+void
+GNUNET_FUSE_content_done (void);
+
+#endif
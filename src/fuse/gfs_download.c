@@ -23,226 +23,2574 @@
  * @author Christian Grothoff
  */
 #include "gfs_download.h"
+#include "gfs_cache.h"
+#include "gfs_scheduler.h"
+#include "gfs_stats.h"
+#include <pthread.h>
+#include <poll.h>
 
 
 /**
- * Context for a download operation.
+ * How often do we check if a download process terminated (in ms)
+ * while no blocks arrive.
+ */
+#define MONITOR_INTERVAL_MS 100
+
+/**
+ * Number of buckets of a 'struct Histogram'.
+ */
+#define HISTOGRAM_BUCKETS 32
+
+/**
+ * How long a download may go without progress before we hedge it
+ * while we do not know enough about the usual delays (in ms).
+ */
+#define DEFAULT_HEDGE_DELAY_MS 5000
+
+/**
+ * Minimum time a download must go without progress before we
+ * hedge it (in ms).
+ */
+#define MIN_HEDGE_DELAY_MS 1000
+
+/**
+ * Number of delays we must have seen before we derive the time
+ * after which we hedge from them.
+ */
+#define MIN_HEDGE_SAMPLES 32
+
+/**
+ * Maximum number of small files downloaded by one process.
+ */
+#define MAX_BATCH_SIZE 64
+
+
+/**
+ * Types of messages sent by download processes.
+ */
+enum MessageType
+{
+
+  /**
+   * A block arrived from the local datastore.
+   */
+  MT_LOCAL_BLOCK = 0,
+
+  /**
+   * A block arrived from the network.
+   */
+  MT_NETWORK_BLOCK = 1,
+
+  /**
+   * The local datastore did not have all blocks, we asked the network.
+   */
+  MT_ESCALATED = 2,
+
+  /**
+   * The download of the range of the file is complete.
+   */
+  MT_COMPLETED = 3
+
+};
+
+
+/**
+ * Message sent by a download process for each block that arrived
+ * (and when it escalates to the network or completes a file).
+ */
+struct BlockMessage
+{
+
+  /**
+   * Offset of the block in the file.
+   */
+  uint64_t offset;
+
+  /**
+   * Length of the block.
+   */
+  uint64_t length;
+
+  /**
+   * Type of the message, an 'enum MessageType'.
+   */
+  uint32_t type;
+
+  /**
+   * Index of the file the message is about in the ranges
+   * the process downloads.
+   */
+  uint32_t file;
+
+};
+
+
+/**
+ * Distribution of the delays between arriving blocks.  Bucket 'i'
+ * counts delays of less than 2^i ms (and at least 2^(i-1) ms).
+ */
+struct Histogram
+{
+
+  /**
+   * Number of delays in each bucket.
+   */
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+
+  /**
+   * Number of delays in all buckets.
+   */
+  uint64_t total;
+
+};
+
+
+/**
+ * A range of blocks of a file for a download process.
+ */
+struct Range
+{
+
+  /**
+   * The file.
+   */
+  struct GNUNET_FUSE_PathInfo *path_info;
+
+  /**
+   * First block to download.
+   */
+  uint64_t first_block;
+
+  /**
+   * Last block to download.
+   */
+  uint64_t last_block;
+
+};
+
+
+/**
+ * A process downloading (part of) the range of a download.
+ */
+struct Process
+{
+
+  /**
+   * Slot of a hedge, NULL for the first process of a download
+   * (whose slot is the job of the download).
+   */
+  struct GNUNET_FUSE_Job *job;
+
+  /**
+   * Job the scheduler knows the process by (to preempt it), NULL
+   * if none.
+   */
+  struct GNUNET_FUSE_Job *registered;
+
+  /**
+   * When did the process last provide a block (or start).
+   */
+  struct GNUNET_TIME_Absolute last_block;
+
+  /**
+   * The process, 0 if it is not running.
+   */
+  pid_t pid;
+
+  /**
+   * Read end of the pipe of the process.
+   */
+  int fd;
+
+  /**
+   * Status of the process once it terminated, -1 if unknown.
+   */
+  int status;
+
+};
+
+
+/**
+ * A running download.
+ */
+struct GNUNET_FUSE_Download
+{
+
+  /**
+   * Downloads into the same file are kept in a DLL.
+   */
+  struct GNUNET_FUSE_Download *next;
+
+  /**
+   * Downloads into the same file are kept in a DLL.
+   */
+  struct GNUNET_FUSE_Download *prev;
+
+  /**
+   * File we are downloading (we hold a reference).
+   */
+  struct GNUNET_FUSE_PathInfo *path_info;
+
+  /**
+   * Our job with the scheduler, NULL while we neither wait for
+   * nor hold a slot.
+   */
+  struct GNUNET_FUSE_Job *job;
+
+  /**
+   * First block we are downloading.
+   */
+  uint64_t first_block;
+
+  /**
+   * Last block we are downloading.
+   */
+  uint64_t last_block;
+
+  /**
+   * Priority of the download.
+   */
+  enum GNUNET_FUSE_DownloadPriority priority;
+
+  /**
+   * GNUNET_YES if the local datastore did not have all blocks.
+   */
+  int escalated;
+
+  /**
+   * Batch the download belongs to, NULL if none.
+   */
+  struct Batch *batch;
+
+  /**
+   * GNUNET_YES once nobody needs the download anymore.
+   */
+  int cancelled;
+
+};
+
+
+/**
+ * Downloads of small files that are performed by a single process.
+ * The first member leads the batch: it waits for a slot and then
+ * downloads the files of all members, which wait for it (see
+ * 'wait_batch').  Afterwards, each member goes on alone for the
+ * blocks that are still missing.
+ */
+struct Batch
+{
+
+  /**
+   * The downloads in the batch, the leader first.
+   */
+  struct GNUNET_FUSE_Download *members[MAX_BATCH_SIZE];
+
+  /**
+   * Number of entries in 'members'.
+   */
+  unsigned int num;
+
+  /**
+   * GNUNET_YES once the leader got a slot; no more downloads
+   * may join then.
+   */
+  int sealed;
+
+};
+
+
+/**
+ * Lock for the block maps and download lists of all files.
+ */
+static struct GNUNET_Mutex *block_lock;
+
+/**
+ * Broadcast whenever blocks arrive or a download terminates.
+ */
+static struct GNUNET_Cond *block_cond;
+
+/**
+ * Number of downloads that are running.
+ */
+static unsigned int active_downloads;
+
+/**
+ * Batch new downloads of small files may join, NULL if none.
+ */
+static struct Batch *open_batch;
+
+/**
+ * How long download processes wait for the next block from the local
+ * datastore before asking the network (0 to always ask the network).
+ */
+static struct GNUNET_TIME_Relative local_timeout;
+
+/**
+ * How long we retry failed downloads.
+ */
+static struct GNUNET_TIME_Relative retry_deadline;
+
+/**
+ * Percentile of the delays between blocks after which a stalled
+ * download is hedged, 0 to never hedge.
+ */
+static unsigned int hedge_percentile;
+
+/**
+ * Delays between the blocks provided by the first process of each
+ * download; delays of processes that were stopped while waiting
+ * for a block count up to the time they were stopped.
+ */
+static struct Histogram primary_delays;
+
+/**
+ * Delays between the blocks of each download as seen by readers
+ * (i.e. whichever process provided the block first).
+ */
+static struct Histogram delivered_delays;
+
+/**
+ * Number of download attempts.
+ */
+static unsigned long long num_attempts;
+
+/**
+ * Number of hedges started.
+ */
+static unsigned long long num_hedges;
+
+
+/**
+ * Context for downloading one file in a download process.
  */
 struct Context
 {
 
-  /**
-   * Information about the file we are downloading.
-   */
-  struct GNUNET_FUSE_PathInfo *path_info;
+  /**
+   * Download process this file belongs to.
+   */
+  struct Session *session;
+
+  /**
+   * Information about the file we are downloading.
+   */
+  struct GNUNET_FUSE_PathInfo *path_info;
+
+  /**
+   * Download handle.
+   */
+  struct GNUNET_FS_DownloadContext *dc;
+
+  /**
+   * Start offset.
+   */
+  off_t start_offset;
+
+  /**
+   * Number of bytes to download.
+   */
+  uint64_t length;
+
+  /**
+   * Task to ask the network if the local datastore does not
+   * provide the next block in time, NULL if none.
+   */
+  struct GNUNET_SCHEDULER_Task *timeout_task;
+
+  /**
+   * Task to finish the download of the file, NULL if none.
+   */
+  struct GNUNET_SCHEDULER_Task *done_task;
+
+  /**
+   * Bitmap of the blocks of our range that arrived.
+   */
+  uint8_t *have;
+
+  /**
+   * Number of blocks in our range.
+   */
+  uint64_t num_blocks;
+
+  /**
+   * Index of the file in the batch.
+   */
+  unsigned int index;
+
+  /**
+   * GNUNET_YES while we only ask the local datastore.
+   */
+  int local_phase;
+
+  /**
+   * GNUNET_YES if the download completed.
+   */
+  int completed;
+
+  /**
+   * GNUNET_YES once the download of the file is over.
+   */
+  int done;
+
+};
+
+
+/**
+ * State of a download process.  A process downloads the ranges of
+ * one or more files (see 'struct Batch') with a single FS handle.
+ */
+struct Session
+{
+
+  /**
+   * FS handle.
+   */
+  struct GNUNET_FS_Handle *fs;
+
+  /**
+   * Files we are downloading.
+   */
+  struct Context *files;
+
+  /**
+   * Number of entries in 'files'.
+   */
+  unsigned int num_files;
+
+  /**
+   * Number of files whose download is not over.
+   */
+  unsigned int active;
+
+  /**
+   * Pipe to report arriving blocks on.
+   */
+  int progress_fd;
+
+  /**
+   * GNUNET_YES to ask the network at once (i.e. for a hedge).
+   */
+  int skip_local;
+
+  /**
+   * Return value for the process, 0 if all files were downloaded.
+   */
+  int ret;
+
+};
+
+
+/**
+ * Task run when we shut down.
+ *
+ * @param cls our 'struct Session'
+ */
+static void
+shutdown_task (void *cls)
+{
+  struct Session *session = cls;
+  struct GNUNET_FS_DownloadContext *dc;
+  struct Context *ctx;
+  unsigned int i;
+
+  for (i = 0; i < session->num_files; i++)
+  {
+    ctx = &session->files[i];
+    if (NULL != ctx->timeout_task)
+    {
+      GNUNET_SCHEDULER_cancel (ctx->timeout_task);
+      ctx->timeout_task = NULL;
+    }
+    if (NULL != ctx->done_task)
+    {
+      GNUNET_SCHEDULER_cancel (ctx->done_task);
+      ctx->done_task = NULL;
+    }
+    if (NULL != (dc = ctx->dc))
+    {
+      /* keep what we got, other blocks of the file may be in use;
+	 the STOPPED event must not finish the file again */
+      ctx->dc = NULL;
+      GNUNET_FS_download_stop (dc, GNUNET_NO);
+    }
+    GNUNET_free_non_null (ctx->have);
+    ctx->have = NULL;
+  }
+  if (NULL != session->fs)
+  {
+    GNUNET_FS_stop (session->fs);
+    session->fs = NULL;
+  }
+}
+
+
+/**
+ * Tell the main process about a block or about the state of the
+ * download of a file.
+ *
+ * @param ctx context of the file
+ * @param type type of the message
+ * @param offset offset of the block
+ * @param length length of the block
+ */
+static void
+send_message (struct Context *ctx,
+	      enum MessageType type,
+	      uint64_t offset,
+	      uint64_t length)
+{
+  struct BlockMessage bm;
+
+  memset (&bm, 0, sizeof (bm));
+  bm.offset = offset;
+  bm.length = length;
+  bm.type = (uint32_t) type;
+  bm.file = ctx->index;
+  if (sizeof (bm) != write (ctx->session->progress_fd, &bm, sizeof (bm)))
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "write");
+}
+
+
+/**
+ * Start the FS download for (part of) the range of a file.
+ *
+ * @param ctx context of the file
+ * @param options GNUNET_FS_DOWNLOAD_OPTION_LOOPBACK_ONLY to only
+ *        ask the local datastore
+ * @param first first block of the range to download
+ * @param last last block of the range to download
+ * @return GNUNET_OK on success
+ */
+static int
+start_fs_download (struct Context *ctx,
+		   enum GNUNET_FS_DownloadOptions options,
+		   uint64_t first,
+		   uint64_t last)
+{
+  uint64_t start;
+  uint64_t end;
+
+  start = first * GNUNET_FUSE_BLOCK_SIZE;
+  end = GNUNET_MIN ((last + 1) * GNUNET_FUSE_BLOCK_SIZE,
+		    ctx->length);
+  /* a range of a single file needs no metadata (see
+     GNUNET_FUSE_path_info_get_meta) */
+  ctx->dc = GNUNET_FS_download_start (ctx->session->fs,
+				      ctx->path_info->uri, NULL,
+				      ctx->path_info->content->tmpfile, NULL,
+				      (uint64_t) ctx->start_offset + start,
+				      end - start,
+				      anonymity_level,
+				      options,
+				      ctx, NULL);
+  return (NULL == ctx->dc) ? GNUNET_SYSERR : GNUNET_OK;
+}
+
+
+/**
+ * The download of a file is over: stop it and end the process
+ * once all downloads are over.
+ *
+ * @param cls context of the file
+ */
+static void
+finish_file (void *cls)
+{
+  struct Context *ctx = cls;
+  struct Session *session = ctx->session;
+  struct GNUNET_FS_DownloadContext *dc;
+
+  ctx->done_task = NULL;
+  if (GNUNET_YES == ctx->done)
+    return;
+  ctx->done = GNUNET_YES;
+  if (NULL != ctx->timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (ctx->timeout_task);
+    ctx->timeout_task = NULL;
+  }
+  if (GNUNET_YES == ctx->completed)
+    send_message (ctx, MT_COMPLETED, 0, 0);
+  else
+    session->ret = 1;
+  if (NULL != (dc = ctx->dc))
+  {
+    /* make sure the STOPPED event does not finish us again */
+    ctx->dc = NULL;
+    GNUNET_FS_download_stop (dc, GNUNET_NO);
+  }
+  if (0 == --session->active)
+    GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * The local datastore did not provide the next block in time (or at
+ * all); download the blocks that are still missing from the network.
+ *
+ * @param cls context of the file
+ */
+static void
+escalate (void *cls)
+{
+  struct Context *ctx = cls;
+  struct GNUNET_FS_DownloadContext *dc;
+  uint64_t first;
+  uint64_t last;
+  uint64_t block;
+
+  ctx->timeout_task = NULL;
+  ctx->local_phase = GNUNET_NO;
+  first = ctx->num_blocks;
+  last = 0;
+  for (block = 0; block < ctx->num_blocks; block++)
+  {
+    if (0 != (ctx->have[block / 8] & (1 << (block % 8))))
+      continue;
+    if (first == ctx->num_blocks)
+      first = block;
+    last = block;
+  }
+  if (first == ctx->num_blocks)
+  {
+    /* all data is there, FS only lacks inner blocks */
+    first = 0;
+    last = ctx->num_blocks - 1;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Local datastore lacks blocks of `%s', asking the network\n",
+	      ctx->path_info->filename);
+  /* make sure the STOPPED event does not end the download */
+  dc = ctx->dc;
+  ctx->dc = NULL;
+  GNUNET_FS_download_stop (dc, GNUNET_NO);
+  send_message (ctx, MT_ESCALATED, 0, 0);
+  if (GNUNET_OK != start_fs_download (ctx,
+				      GNUNET_FS_DOWNLOAD_OPTION_NONE,
+				      first,
+				      last))
+    finish_file (ctx);
+}
+
+
+/**
+ * Function called from FS with progress information.
+ *
+ * @param cls our 'struct Session'
+ * @param info progress information
+ * @return context of the file the information is about
+ */
+static void *
+progress_cb (void *cls, const struct GNUNET_FS_ProgressInfo *info)
+{
+  struct Context *ctx = info->value.download.cctx;
+  uint64_t block;
+  char *s;
+
+  switch (info->status)
+    {
+    case GNUNET_FS_STATUS_DOWNLOAD_START:
+      GNUNET_break (info->value.download.dc == ctx->dc);
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Started download `%s'.\n",
+		  info->value.download.filename);
+      break;
+    case GNUNET_FS_STATUS_DOWNLOAD_PROGRESS:
+      GNUNET_break (info->value.download.dc == ctx->dc);
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Downloading `%s' at %llu/%llu\n",
+		  info->value.download.filename,
+		  (unsigned long long) info->value.download.completed,
+		  (unsigned long long) info->value.download.size);
+      if ( (0 != info->value.download.specifics.progress.depth) ||
+	   (0 == info->value.download.specifics.progress.data_len) )
+	break;
+      /* a data block was written to the file, readers may use it */
+      send_message (ctx,
+		    (GNUNET_YES == ctx->local_phase) ? MT_LOCAL_BLOCK : MT_NETWORK_BLOCK,
+		    info->value.download.specifics.progress.offset,
+		    info->value.download.specifics.progress.data_len);
+      block = (info->value.download.specifics.progress.offset - ctx->start_offset)
+	/ GNUNET_FUSE_BLOCK_SIZE;
+      if (block < ctx->num_blocks)
+	ctx->have[block / 8] |= (1 << (block % 8));
+      if (NULL != ctx->timeout_task)
+      {
+	/* the local datastore is making progress, give it more time */
+	GNUNET_SCHEDULER_cancel (ctx->timeout_task);
+	ctx->timeout_task = GNUNET_SCHEDULER_add_delayed (local_timeout,
+							  &escalate,
+							  ctx);
+      }
+      break;
+    case GNUNET_FS_STATUS_DOWNLOAD_ERROR:
+      GNUNET_break (info->value.download.dc == ctx->dc);
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Error downloading: %s.\n",
+		  info->value.download.specifics.error.message);
+      if (NULL != ctx->timeout_task)
+      {
+	/* not from the local datastore, but maybe from the network */
+	GNUNET_SCHEDULER_cancel (ctx->timeout_task);
+	ctx->timeout_task = GNUNET_SCHEDULER_add_now (&escalate,
+						      ctx);
+	break;
+      }
+      if (NULL == ctx->done_task)
+	ctx->done_task = GNUNET_SCHEDULER_add_now (&finish_file,
+						   ctx);
+      break;
+    case GNUNET_FS_STATUS_DOWNLOAD_COMPLETED:
+      GNUNET_break (info->value.download.dc == ctx->dc);
+      s =
+	GNUNET_STRINGS_byte_size_fancy (info->value.download.completed *
+					1000000LL /
+					(info->value.download.
+					 duration.rel_value_us + 1));
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Downloading `%s' done (%s/s).\n",
+		  info->value.download.filename, s);
+      GNUNET_free (s);
+      ctx->completed = GNUNET_YES;
+      if (NULL == ctx->done_task)
+	ctx->done_task = GNUNET_SCHEDULER_add_now (&finish_file,
+						   ctx);
+      break;
+    case GNUNET_FS_STATUS_DOWNLOAD_STOPPED:
+      if ( (info->value.download.dc == ctx->dc) &&
+	   (NULL == ctx->done_task) )
+      {
+	ctx->dc = NULL;
+	ctx->done_task = GNUNET_SCHEDULER_add_now (&finish_file,
+						   ctx);
+      }
+      break;
+    case GNUNET_FS_STATUS_DOWNLOAD_ACTIVE:
+    case GNUNET_FS_STATUS_DOWNLOAD_INACTIVE:
+      break;
+    default:
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		  _("Unexpected status: %d\n"), info->status);
+      break;
+    }
+  /* FS replaces the client context with what we return */
+  return ctx;
+}
+
+
+/**
+ * Main task run by the helper process which downloads the files.
+ *
+ * @param cls 'struct Session' with information about the downloads
+ */
+static void
+download_task (void *cls)
+{
+  struct Session *session = cls;
+  struct Context *ctx;
+  unsigned int i;
+
+  session->fs = GNUNET_FS_start (cfg, "gnunet-fuse", &progress_cb, session,
+				 GNUNET_FS_FLAGS_NONE,
+				 GNUNET_FS_OPTIONS_DOWNLOAD_PARALLELISM, session->num_files,
+				 GNUNET_FS_OPTIONS_REQUEST_PARALLELISM, 1,
+				 GNUNET_FS_OPTIONS_END);
+  if (NULL == session->fs)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("Could not initialize `%s' subsystem.\n"), "FS");
+    return;
+  }
+  GNUNET_SCHEDULER_add_shutdown (&shutdown_task, session);
+  session->ret = 0;
+  for (i = 0; i < session->num_files; i++)
+  {
+    ctx = &session->files[i];
+    ctx->num_blocks = (ctx->length + GNUNET_FUSE_BLOCK_SIZE - 1) / GNUNET_FUSE_BLOCK_SIZE;
+    ctx->have = GNUNET_malloc ((ctx->num_blocks + 7) / 8);
+    /* much of what we mount is in the local datastore already,
+       try there first */
+    ctx->local_phase = ( (GNUNET_YES != session->skip_local) &&
+			 (0 != local_timeout.rel_value_us) ) ? GNUNET_YES : GNUNET_NO;
+    if (GNUNET_OK != start_fs_download (ctx,
+					(GNUNET_YES == ctx->local_phase)
+					? GNUNET_FS_DOWNLOAD_OPTION_LOOPBACK_ONLY
+					: GNUNET_FS_DOWNLOAD_OPTION_NONE,
+					0,
+					ctx->num_blocks - 1))
+    {
+      ctx->done = GNUNET_YES;
+      session->ret = 1;
+      continue;
+    }
+    session->active++;
+    if (GNUNET_YES == ctx->local_phase)
+      ctx->timeout_task = GNUNET_SCHEDULER_add_delayed (local_timeout,
+							&escalate,
+							ctx);
+  }
+  if (0 == session->active)
+    GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Setup the download subsystem.
+ *
+ * @param local how long to wait for the next block from the local
+ *        datastore before asking the network, 0 to always ask
+ *        the network
+ * @param retry how long to retry failed downloads, 0 to not retry
+ * @param hedge percentile of the delays between blocks after which
+ *        a stalled download is hedged, 0 to never hedge
+ */
+void
+GNUNET_FUSE_download_init (struct GNUNET_TIME_Relative local,
+			   struct GNUNET_TIME_Relative retry,
+			   unsigned int hedge)
+{
+  local_timeout = local;
+  retry_deadline = retry;
+  hedge_percentile = GNUNET_MIN (hedge, 100);
+  block_lock = GNUNET_mutex_create (GNUNET_NO);
+  block_cond = GNUNET_cond_create ();
+}
+
+
+/**
+ * Test if a block of a file is available.  Caller must hold
+ * 'block_lock'.
+ *
+ * @param path_info the file
+ * @param block number of the block
+ * @return GNUNET_YES if the block is available
+ */
+static int
+test_block (const struct GNUNET_FUSE_PathInfo *path_info,
+	    uint64_t block)
+{
+  return (0 != (path_info->content->blocks[block / 8] & (1 << (block % 8))))
+    ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Mark blocks of a file as available and wake up the readers.
+ *
+ * @param path_info the file
+ * @param offset offset of the first byte that is available
+ * @param length number of bytes that are available
+ * @return GNUNET_YES if any of the blocks was not available before
+ */
+static int
+mark_blocks (struct GNUNET_FUSE_PathInfo *path_info,
+	     uint64_t offset,
+	     uint64_t length)
+{
+  struct GNUNET_FUSE_Content *content = path_info->content;
+  uint64_t fsize;
+  uint64_t first;
+  uint64_t last;
+  uint64_t block;
+  int fresh;
+  int complete;
+
+  fsize = GNUNET_FS_uri_chk_get_file_size (path_info->uri);
+  if ( (0 == length) ||
+       (offset >= fsize) )
+    return GNUNET_NO;
+  length = GNUNET_MIN (length, fsize - offset);
+  first = offset / GNUNET_FUSE_BLOCK_SIZE;
+  last = (offset + length - 1) / GNUNET_FUSE_BLOCK_SIZE;
+  fresh = GNUNET_NO;
+  GNUNET_mutex_lock (block_lock);
+  for (block = first; block <= last; block++)
+  {
+    if (GNUNET_YES == test_block (path_info, block))
+      continue;
+    fresh = GNUNET_YES;
+    content->blocks[block / 8] |= (1 << (block % 8));
+    content->blocks_missing--;
+  }
+  complete = ( (GNUNET_YES == fresh) &&
+	       (0 == content->blocks_missing) ) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_cond_broadcast (block_cond);
+  GNUNET_mutex_unlock (block_lock);
+  if ( (GNUNET_YES == fresh) &&
+       (NULL != content->partial) )
+  {
+    /* let other processes sharing the cache use the blocks */
+    GNUNET_FUSE_cache_partial_add_blocks (content->partial,
+					  first,
+					  last);
+    if ( (GNUNET_YES == complete) &&
+	 (GNUNET_OK == GNUNET_FUSE_cache_partial_publish (content->partial)) )
+      GNUNET_FUSE_stats_update (gettext_noop ("# files published to the shared cache"),
+				1);
+  }
+  return fresh;
+}
+
+
+/**
+ * Find the span of blocks of a download that are still missing.
+ * Caller must hold 'block_lock'.
+ *
+ * @param d the download
+ * @param first set to the first missing block
+ * @param last set to the last missing block
+ * @return GNUNET_NO if no blocks are missing
+ */
+static int
+get_missing (const struct GNUNET_FUSE_Download *d,
+	     uint64_t *first,
+	     uint64_t *last)
+{
+  uint64_t block;
+  int missing;
+
+  missing = GNUNET_NO;
+  for (block = d->first_block; block <= d->last_block; block++)
+  {
+    if (GNUNET_YES == test_block (d->path_info, block))
+      continue;
+    if (GNUNET_NO == missing)
+      *first = block;
+    *last = block;
+    missing = GNUNET_YES;
+  }
+  return missing;
+}
+
+
+/**
+ * Add a delay to a histogram.
+ *
+ * @param h the histogram
+ * @param delay the delay
+ */
+static void
+histogram_add (struct Histogram *h,
+	       struct GNUNET_TIME_Relative delay)
+{
+  uint64_t ms;
+  unsigned int i;
+
+  ms = delay.rel_value_us / 1000LL;
+  for (i = 0; (0 != ms) && (i < HISTOGRAM_BUCKETS - 1); i++)
+    ms >>= 1;
+  h->buckets[i]++;
+  h->total++;
+}
+
+
+/**
+ * Get a percentile of the delays in a histogram.
+ *
+ * @param h the histogram
+ * @param percentile the percentile
+ * @return the percentile in ms, rounded up to a power of two
+ */
+static uint64_t
+histogram_percentile (const struct Histogram *h,
+		      unsigned int percentile)
+{
+  uint64_t need;
+  uint64_t sum;
+  unsigned int i;
+
+  need = (h->total * percentile + 99) / 100;
+  sum = 0;
+  for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+  {
+    sum += h->buckets[i];
+    if (sum >= need)
+      break;
+  }
+  return 1LLU << i;
+}
+
+
+/**
+ * Record a delay between blocks and update the statistics on the
+ * delays.  Caller must hold 'block_lock'.
+ *
+ * @param h histogram to add the delay to
+ * @param delay the delay
+ */
+static void
+record_delay (struct Histogram *h,
+	      struct GNUNET_TIME_Relative delay)
+{
+  uint64_t primary;
+  uint64_t delivered;
+
+  histogram_add (h, delay);
+  primary = histogram_percentile (&primary_delays, 99);
+  delivered = histogram_percentile (&delivered_delays, 99);
+  GNUNET_FUSE_stats_set (gettext_noop ("# p99 delay between blocks (ms)"),
+			 delivered);
+  GNUNET_FUSE_stats_set (gettext_noop ("# p99 delay between blocks without hedging (ms)"),
+			 primary);
+  GNUNET_FUSE_stats_set (gettext_noop ("# p99 delay saved by hedging (ms)"),
+			 (primary > delivered) ? primary - delivered : 0);
+}
+
+
+/**
+ * Get the time a download may go without progress before we hedge
+ * it.  Caller must hold 'block_lock'.
+ *
+ * @return the delay
+ */
+static struct GNUNET_TIME_Relative
+get_hedge_delay ()
+{
+  uint64_t ms;
+
+  if (primary_delays.total < MIN_HEDGE_SAMPLES)
+    ms = DEFAULT_HEDGE_DELAY_MS;
+  else
+    ms = GNUNET_MAX (MIN_HEDGE_DELAY_MS,
+		     histogram_percentile (&primary_delays,
+					   hedge_percentile));
+  return GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+					ms);
+}
+
+
+/**
+ * Handle a message from a download process.
+ *
+ * @param d the download
+ * @param bm the message
+ * @return GNUNET_YES if the message provided a block that
+ *         was not available before
+ */
+static int
+handle_message (struct GNUNET_FUSE_Download *d,
+		const struct BlockMessage *bm)
+{
+  switch ((enum MessageType) bm->type)
+  {
+  case MT_LOCAL_BLOCK:
+    GNUNET_FUSE_stats_update (gettext_noop ("# bytes from the local datastore"),
+			      bm->length);
+    return mark_blocks (d->path_info,
+			bm->offset,
+			bm->length);
+  case MT_NETWORK_BLOCK:
+    GNUNET_FUSE_stats_update (gettext_noop ("# bytes from the network"),
+			      bm->length);
+    return mark_blocks (d->path_info,
+			bm->offset,
+			bm->length);
+  case MT_ESCALATED:
+    if (GNUNET_YES != d->escalated)
+      GNUNET_FUSE_stats_update (gettext_noop ("# downloads escalated to the network"),
+				1);
+    d->escalated = GNUNET_YES;
+    break;
+  case MT_COMPLETED:
+    return mark_blocks (d->path_info,
+			d->first_block * GNUNET_FUSE_BLOCK_SIZE,
+			(d->last_block - d->first_block + 1) * GNUNET_FUSE_BLOCK_SIZE);
+  default:
+    GNUNET_break (0);
+    break;
+  }
+  return GNUNET_NO;
+}
+
+
+/**
+ * Start a process which downloads ranges of blocks of files using FS.
+ *
+ * @param ranges the ranges to download
+ * @param num number of entries in 'ranges'
+ * @param skip_local GNUNET_YES to ask the network at once
+ * @param p where to store information about the process
+ * @return GNUNET_OK on success
+ */
+static int
+spawn (const struct Range *ranges,
+       unsigned int num,
+       int skip_local,
+       struct Process *p)
+{
+  struct Session session;
+  struct Context *ctx;
+  uint64_t start;
+  uint64_t end;
+  unsigned int i;
+  int fds[2];
+  pid_t pid;
+
+  if (0 != pipe (fds))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "pipe");
+    return GNUNET_SYSERR;
+  }
+  pid = fork ();
+  if (-1 == pid)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "fork");
+    GNUNET_break (0 == close (fds[0]));
+    GNUNET_break (0 == close (fds[1]));
+    return GNUNET_SYSERR;
+  }
+  if (0 == pid)
+  {
+    (void) close (fds[0]);
+    memset (&session, 0, sizeof (session));
+    session.ret = 1;
+    session.progress_fd = fds[1];
+    session.skip_local = skip_local;
+    session.num_files = num;
+    session.files = GNUNET_new_array (num, struct Context);
+    for (i = 0; i < num; i++)
+    {
+      ctx = &session.files[i];
+      start = ranges[i].first_block * GNUNET_FUSE_BLOCK_SIZE;
+      end = GNUNET_MIN ((ranges[i].last_block + 1) * GNUNET_FUSE_BLOCK_SIZE,
+			GNUNET_FS_uri_chk_get_file_size (ranges[i].path_info->uri));
+      ctx->session = &session;
+      ctx->index = i;
+      ctx->path_info = ranges[i].path_info;
+      ctx->start_offset = start;
+      ctx->length = end - start;
+    }
+    GNUNET_SCHEDULER_run (&download_task, &session);
+    _exit (session.ret);
+  }
+  GNUNET_break (0 == close (fds[1]));
+  (void) fcntl (fds[0], F_SETFL, O_NONBLOCK);
+  p->pid = pid;
+  p->fd = fds[0];
+  p->status = -1;
+  p->last_block = GNUNET_TIME_absolute_get ();
+  return GNUNET_OK;
+}
+
+
+/**
+ * Reap a process once it terminated.  The scheduler forgets the
+ * process first, so that it never signals its ID once it is reused.
+ *
+ * @param p the process
+ * @param options 0 to wait for the process, WNOHANG to return at
+ *        once if it is still running
+ * @return ID of the process if it was reaped, 0 if it is still
+ *         running, -1 on error
+ */
+static pid_t
+reap (struct Process *p,
+      int options)
+{
+  siginfo_t si;
+
+  memset (&si, 0, sizeof (si));
+  /* only look, the process stays a zombie (keeping its ID) */
+  if (0 != waitid (P_PID, p->pid, &si, WEXITED | WNOWAIT | options))
+    return -1;
+  if (0 == si.si_pid)
+    return 0;
+  if (NULL != p->registered)
+  {
+    GNUNET_FUSE_scheduler_exited (p->registered);
+    p->registered = NULL;
+  }
+  return waitpid (p->pid, &p->status, 0);
+}
+
+
+/**
+ * Clean up after a process terminated.
+ *
+ * @param p the process
+ */
+static void
+finish (struct Process *p)
+{
+  GNUNET_break (0 == close (p->fd));
+  p->pid = 0;
+  if (NULL != p->job)
+  {
+    (void) GNUNET_FUSE_scheduler_release (p->job);
+    p->job = NULL;
+  }
+}
+
+
+/**
+ * Stop a running process.  Like on preemption, the process stops
+ * its FS download and keeps what it got.
+ *
+ * @param p the process
+ */
+static void
+stop_process (struct Process *p)
+{
+  (void) kill (p->pid, SIGTERM);
+  (void) reap (p, 0);
+  finish (p);
+}
+
+
+/**
+ * Stop the processes of downloads that were cancelled and report
+ * the resources we saved.
+ *
+ * @param members the downloads
+ * @param num number of entries in 'members'
+ * @param procs the processes of the downloads
+ */
+static void
+stop_cancelled (struct GNUNET_FUSE_Download **members,
+		unsigned int num,
+		struct Process procs[2])
+{
+  struct GNUNET_FUSE_Download *d;
+  uint64_t block;
+  uint64_t missing;
+  unsigned int i;
+
+  GNUNET_mutex_lock (block_lock);
+  missing = 0;
+  for (i = 0; i < num; i++)
+  {
+    d = members[i];
+    for (block = d->first_block; block <= d->last_block; block++)
+      if (GNUNET_NO == test_block (d->path_info, block))
+	missing++;
+  }
+  GNUNET_mutex_unlock (block_lock);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Download of `%s' was cancelled, %llu blocks left\n",
+	      members[0]->path_info->filename,
+	      (unsigned long long) missing);
+  GNUNET_FUSE_stats_update (gettext_noop ("# bytes not downloaded after cancelling"),
+			    missing * GNUNET_FUSE_BLOCK_SIZE);
+  for (i = 0; i < 2; i++)
+  {
+    if (0 == procs[i].pid)
+      continue;
+    GNUNET_FUSE_stats_update (gettext_noop ("# download slots freed by cancelling"),
+			      1);
+    stop_process (&procs[i]);
+  }
+}
+
+
+/**
+ * Start a hedge for a stalled download: a second process which
+ * asks the network for the blocks that are still missing.
+ *
+ * @param d the download
+ * @param p where to store information about the hedge
+ * @return GNUNET_OK if the hedge was started, GNUNET_NO if no
+ *         slot is free, GNUNET_SYSERR if we should not hedge
+ */
+static int
+start_hedge (struct GNUNET_FUSE_Download *d,
+	     struct Process *p)
+{
+  enum GNUNET_FUSE_DownloadPriority priority;
+  struct Range range;
+
+  range.path_info = d->path_info;
+  GNUNET_mutex_lock (block_lock);
+  priority = d->priority;
+  if (GNUNET_NO == get_missing (d, &range.first_block, &range.last_block))
+  {
+    GNUNET_mutex_unlock (block_lock);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_unlock (block_lock);
+  if (NULL == (p->job = GNUNET_FUSE_scheduler_try_acquire (priority)))
+    return GNUNET_NO;
+  if (GNUNET_OK != spawn (&range,
+			  1,
+			  GNUNET_YES,
+			  p))
+  {
+    (void) GNUNET_FUSE_scheduler_release (p->job);
+    p->job = NULL;
+    return GNUNET_SYSERR;
+  }
+  GNUNET_FUSE_scheduler_started (p->job, p->pid);
+  p->registered = p->job;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Download of `%s' stalled, hedging blocks %llu-%llu\n",
+	      d->path_info->filename,
+	      (unsigned long long) range.first_block,
+	      (unsigned long long) range.last_block);
+  GNUNET_FUSE_stats_update (gettext_noop ("# hedged requests"),
+			    1);
+  GNUNET_mutex_lock (block_lock);
+  num_hedges++;
+  GNUNET_FUSE_stats_set (gettext_noop ("# hedged requests per 1000 attempts"),
+			 num_hedges * 1000 / num_attempts);
+  GNUNET_mutex_unlock (block_lock);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Should we hedge a download once it stalls?
+ *
+ * @param d the download
+ * @return GNUNET_YES if a reader waits (or may soon wait) for the
+ *         download and it already asks the network
+ */
+static int
+may_hedge (struct GNUNET_FUSE_Download *d)
+{
+  int ret;
+
+  if (0 == hedge_percentile)
+    return GNUNET_NO;
+  if ( (GNUNET_YES != d->escalated) &&
+       (0 != local_timeout.rel_value_us) )
+    return GNUNET_NO;
+  GNUNET_mutex_lock (block_lock);
+  ret = (GNUNET_FUSE_DOWNLOAD_BACKGROUND != d->priority) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_mutex_unlock (block_lock);
+  return ret;
+}
+
+
+/**
+ * Test if the downloads of a process are complete.  Caller must
+ * hold 'block_lock'.
+ *
+ * @param members the downloads
+ * @param num number of entries in 'members'
+ * @return GNUNET_YES if no blocks are missing for downloads that
+ *         were not cancelled
+ */
+static int
+test_complete (struct GNUNET_FUSE_Download **members,
+	       unsigned int num)
+{
+  uint64_t first;
+  uint64_t last;
+  unsigned int i;
+
+  for (i = 0; i < num; i++)
+    if ( (GNUNET_YES != members[i]->cancelled) &&
+	 (GNUNET_YES == get_missing (members[i], &first, &last)) )
+      return GNUNET_NO;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Test if all downloads of a process were cancelled.  Caller must
+ * hold 'block_lock'.
+ *
+ * @param members the downloads
+ * @param num number of entries in 'members'
+ * @return GNUNET_YES if nobody needs the downloads anymore
+ */
+static int
+test_cancelled (struct GNUNET_FUSE_Download **members,
+		unsigned int num)
+{
+  unsigned int i;
+
+  for (i = 0; i < num; i++)
+    if (GNUNET_YES != members[i]->cancelled)
+      return GNUNET_NO;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Pass the blocks reported by the processes of a download (or of a
+ * batch of downloads) on to the readers until the downloads are
+ * complete or all processes failed.  If the first process of a
+ * single download stalls, a hedge is started for the blocks that
+ * are still missing; whichever process completes the range first
+ * wins and the other one is stopped.
+ *
+ * @param members the downloads, more than one for a batch
+ * @param num number of entries in 'members'
+ * @param procs the first process of the downloads and room for
+ *        the hedge
+ * @return GNUNET_OK if the ranges of the downloads are complete,
+ *         GNUNET_NO if the downloads were cancelled
+ */
+static int
+monitor (struct GNUNET_FUSE_Download **members,
+	 unsigned int num,
+	 struct Process procs[2])
+{
+  struct BlockMessage bm[64];
+  struct pollfd pfd[2];
+  struct GNUNET_TIME_Absolute last_delivery;
+  struct GNUNET_TIME_Absolute now;
+  struct GNUNET_TIME_Relative hedge_delay;
+  struct Process *p;
+  ssize_t got;
+  unsigned int i;
+  unsigned int j;
+  unsigned int n;
+  pid_t ret;
+  int hedged;
+  int fresh;
+  int done;
+  int cancelled;
+
+  hedged = GNUNET_NO;
+  done = GNUNET_NO;
+  last_delivery = GNUNET_TIME_absolute_get ();
+  while (1)
+  {
+    GNUNET_mutex_lock (block_lock);
+    cancelled = test_cancelled (members, num);
+    GNUNET_mutex_unlock (block_lock);
+    if (GNUNET_YES == cancelled)
+    {
+      stop_cancelled (members, num, procs);
+      return GNUNET_NO;
+    }
+    for (i = 0; i < 2; i++)
+    {
+      p = &procs[i];
+      if (0 == p->pid)
+	continue;
+      ret = reap (p, WNOHANG);
+      if ( (-1 == ret) &&
+	   (EINTR != errno) )
+      {
+	GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "waitid");
+	(void) kill (p->pid, SIGKILL);
+	if (NULL != p->registered)
+	{
+	  GNUNET_FUSE_scheduler_exited (p->registered);
+	  p->registered = NULL;
+	}
+	(void) waitpid (p->pid, NULL, 0);
+	p->status = -1;
+	ret = p->pid;
+      }
+      /* messages are smaller than PIPE_BUF, so we only get whole ones */
+      while (0 < (got = read (p->fd, bm, sizeof (bm))))
+	for (j = 0; j < got / sizeof (struct BlockMessage); j++)
+	{
+	  if (bm[j].file >= num)
+	  {
+	    GNUNET_break (0);
+	    continue;
+	  }
+	  fresh = handle_message (members[bm[j].file], &bm[j]);
+	  if ( (MT_ESCALATED == bm[j].type) ||
+	       (MT_COMPLETED == bm[j].type) )
+	    continue;
+	  now = GNUNET_TIME_absolute_get ();
+	  GNUNET_mutex_lock (block_lock);
+	  if (0 == i)
+	    record_delay (&primary_delays,
+			  GNUNET_TIME_absolute_get_difference (p->last_block,
+							       now));
+	  if (GNUNET_YES == fresh)
+	    record_delay (&delivered_delays,
+			  GNUNET_TIME_absolute_get_difference (last_delivery,
+							       now));
+	  GNUNET_mutex_unlock (block_lock);
+	  p->last_block = now;
+	  if (GNUNET_YES == fresh)
+	    last_delivery = now;
+	}
+      if (p->pid != ret)
+	continue;
+      finish (p);
+      if ( (-1 != p->status) &&
+	   (WIFEXITED (p->status)) &&
+	   (0 == WEXITSTATUS (p->status)) )
+	done = GNUNET_YES;
+    }
+    if (GNUNET_YES != done)
+    {
+      /* the processes may have completed the range together */
+      GNUNET_mutex_lock (block_lock);
+      done = test_complete (members, num);
+      GNUNET_mutex_unlock (block_lock);
+    }
+    if (GNUNET_YES == done)
+      break;
+    if ( (0 == procs[0].pid) &&
+	 (0 == procs[1].pid) )
+      return GNUNET_SYSERR;
+    if ( (GNUNET_YES != hedged) &&
+	 (1 == num) &&
+	 (0 != procs[0].pid) &&
+	 (GNUNET_YES == may_hedge (members[0])) )
+    {
+      GNUNET_mutex_lock (block_lock);
+      hedge_delay = get_hedge_delay ();
+      GNUNET_mutex_unlock (block_lock);
+      if ( (GNUNET_TIME_absolute_get_duration (procs[0].last_block).rel_value_us >=
+	    hedge_delay.rel_value_us) &&
+	   (GNUNET_NO != start_hedge (members[0], &procs[1])) )
+	hedged = GNUNET_YES;
+    }
+    n = 0;
+    for (i = 0; i < 2; i++)
+    {
+      if (0 == procs[i].pid)
+	continue;
+      pfd[n].fd = procs[i].fd;
+      pfd[n].events = POLLIN;
+      n++;
+    }
+    (void) poll (pfd, n, MONITOR_INTERVAL_MS);
+  }
+  if ( (GNUNET_YES == hedged) &&
+       (0 != procs[0].pid) )
+    GNUNET_FUSE_stats_update (gettext_noop ("# hedged requests that won"),
+			      1);
+  /* stop the loser */
+  for (i = 0; i < 2; i++)
+  {
+    p = &procs[i];
+    if (0 == p->pid)
+      continue;
+    if (0 == i)
+    {
+      GNUNET_mutex_lock (block_lock);
+      record_delay (&primary_delays,
+		    GNUNET_TIME_absolute_get_duration (p->last_block));
+      GNUNET_mutex_unlock (block_lock);
+    }
+    stop_process (p);
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Give up the slot of a download.
+ *
+ * @param d the download
+ * @return GNUNET_YES if the download was preempted and should be retried
+ */
+static int
+release_job (struct GNUNET_FUSE_Download *d)
+{
+  struct GNUNET_FUSE_Job *job;
+
+  GNUNET_mutex_lock (block_lock);
+  job = d->job;
+  d->job = NULL;
+  GNUNET_mutex_unlock (block_lock);
+  return GNUNET_FUSE_scheduler_release (job);
+}
+
+
+/**
+ * Restrict a download to the blocks of its range that are still
+ * missing.
+ *
+ * @param d the download
+ * @return GNUNET_YES if no blocks are missing
+ */
+static int
+narrow_download (struct GNUNET_FUSE_Download *d)
+{
+  uint64_t first;
+  uint64_t last;
+
+  GNUNET_mutex_lock (block_lock);
+  if (GNUNET_NO == get_missing (d, &first, &last))
+  {
+    GNUNET_mutex_unlock (block_lock);
+    return GNUNET_YES;
+  }
+  d->first_block = first;
+  d->last_block = last;
+  GNUNET_mutex_unlock (block_lock);
+  return GNUNET_NO;
+}
+
+
+/**
+ * Dissolve a batch after its leader is done with it; the other
+ * members go on alone.
+ *
+ * @param batch the batch
+ */
+static void
+detach_batch (struct Batch *batch)
+{
+  unsigned int i;
+
+  GNUNET_mutex_lock (block_lock);
+  if (open_batch == batch)
+    open_batch = NULL;
+  for (i = 0; i < batch->num; i++)
+    batch->members[i]->batch = NULL;
+  /* wake up 'wait_batch' */
+  GNUNET_cond_broadcast (block_cond);
+  GNUNET_mutex_unlock (block_lock);
+  GNUNET_free (batch);
+}
+
+
+/**
+ * Make one attempt at a download: wait for a slot and run a process
+ * which downloads the blocks of the file using FS.  If the download
+ * leads a batch, the process downloads the files of the other
+ * members as well.
+ *
+ * @param d the download
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the download failed,
+ *         GNUNET_NO if the download was cancelled or speculative
+ *         downloads were stopped
+ */
+static int
+run_attempt (struct GNUNET_FUSE_Download *d)
+{
+  struct GNUNET_FUSE_Job *job;
+  struct GNUNET_FUSE_Download **members;
+  struct Batch *batch;
+  struct Process procs[2];
+  struct Range ranges[MAX_BATCH_SIZE];
+  unsigned int num;
+  unsigned int i;
+  int preempted;
+  int ret;
+
+ retry:
+  GNUNET_mutex_lock (block_lock);
+  batch = d->batch;
+  if ( (GNUNET_YES == d->cancelled) &&
+       (NULL == batch) )
+  {
+    GNUNET_mutex_unlock (block_lock);
+    return GNUNET_NO;
+  }
+  job = GNUNET_FUSE_scheduler_enqueue (d->priority);
+  d->job = job;
+  GNUNET_mutex_unlock (block_lock);
+  if (GNUNET_OK != GNUNET_FUSE_scheduler_wait (job))
+  {
+    (void) release_job (d);
+    if (NULL != batch)
+      detach_batch (batch);
+    return GNUNET_NO;
+  }
+  GNUNET_mutex_lock (block_lock);
+  if (NULL != batch)
+  {
+    /* whoever did not join until now has to wait for the next batch */
+    batch->sealed = GNUNET_YES;
+    if (open_batch == batch)
+      open_batch = NULL;
+    members = batch->members;
+    num = batch->num;
+  }
+  else
+  {
+    members = &d;
+    num = 1;
+  }
+  for (i = 0; i < num; i++)
+  {
+    ranges[i].path_info = members[i]->path_info;
+    ranges[i].first_block = members[i]->first_block;
+    ranges[i].last_block = members[i]->last_block;
+  }
+  GNUNET_mutex_unlock (block_lock);
+  memset (procs, 0, sizeof (procs));
+  if (GNUNET_OK != spawn (ranges,
+			  num,
+			  GNUNET_NO,
+			  &procs[0]))
+  {
+    (void) release_job (d);
+    if (NULL != batch)
+      detach_batch (batch);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_lock (block_lock);
+  num_attempts++;
+  GNUNET_mutex_unlock (block_lock);
+  if (num > 1)
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Downloading %u small files with one process\n",
+		num);
+  GNUNET_FUSE_scheduler_started (job, procs[0].pid);
+  procs[0].registered = job;
+  ret = monitor (members, num, procs);
+  preempted = release_job (d);
+  if (NULL != batch)
+  {
+    detach_batch (batch);
+    /* the batch may have completed without us if we were cancelled */
+    if ( (GNUNET_OK == ret) &&
+	 (GNUNET_YES != narrow_download (d)) )
+      ret = GNUNET_NO;
+  }
+  if ( (GNUNET_YES == preempted) &&
+       (GNUNET_SYSERR == ret) )
+  {
+    /* a foreground download needed our slot; data we already
+       have stays in the file, so we continue later */
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Download of `%s' was preempted, queueing it again\n",
+		d->path_info->filename);
+    goto retry;
+  }
+  return ret;
+}
+
+
+/**
+ * Wait before retrying a download.
+ *
+ * @param d the download
+ * @param delay how long to wait
+ * @return GNUNET_OK after 'delay', GNUNET_SYSERR if the download
+ *         was cancelled or speculative downloads were stopped
+ */
+static int
+wait_retry (struct GNUNET_FUSE_Download *d,
+	    struct GNUNET_TIME_Relative delay)
+{
+  struct GNUNET_TIME_Absolute end;
+  int ret;
+
+  end = GNUNET_TIME_relative_to_absolute (delay);
+  ret = GNUNET_SYSERR;
+  GNUNET_mutex_lock (block_lock);
+  /* woken up by 'cancel_download' and 'GNUNET_FUSE_download_done' */
+  while ( (GNUNET_YES != d->cancelled) &&
+	  (GNUNET_YES != GNUNET_FUSE_scheduler_stopped (d->priority)) )
+  {
+    if (GNUNET_OK != GNUNET_cond_timedwait (block_cond, block_lock, end))
+    {
+      ret = GNUNET_OK;
+      break;
+    }
+  }
+  GNUNET_mutex_unlock (block_lock);
+  return ret;
+}
+
+
+/**
+ * Perform a download.  Failed downloads are retried (for the blocks
+ * that are still missing) with exponential backoff until the retry
+ * deadline passes; blocks that arrived are kept in any case.
+ *
+ * @param d the download
+ * @return GNUNET_OK on success
+ */
+static int
+run_download (struct GNUNET_FUSE_Download *d)
+{
+  struct GNUNET_TIME_Absolute deadline;
+  struct GNUNET_TIME_Relative backoff;
+  struct GNUNET_TIME_Relative remaining;
+  int cancelled;
+  int ret;
+
+  deadline = GNUNET_TIME_relative_to_absolute (retry_deadline);
+  backoff = GNUNET_TIME_UNIT_SECONDS;
+  while (GNUNET_OK != (ret = run_attempt (d)))
+  {
+    if (GNUNET_YES == narrow_download (d))
+      return GNUNET_OK;
+    GNUNET_mutex_lock (block_lock);
+    cancelled = d->cancelled;
+    GNUNET_mutex_unlock (block_lock);
+    if (GNUNET_YES == cancelled)
+      return GNUNET_SYSERR;
+    remaining = GNUNET_TIME_absolute_get_remaining (deadline);
+    if ( (GNUNET_NO == ret) ||
+	 (0 == remaining.rel_value_us) )
+    {
+      GNUNET_FUSE_stats_update (gettext_noop ("# downloads failed"),
+				1);
+      return GNUNET_SYSERR;
+    }
+    backoff = GNUNET_TIME_relative_min (backoff,
+					remaining);
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Download of `%s' failed, retrying in %s\n",
+		d->path_info->filename,
+		GNUNET_STRINGS_relative_time_to_string (backoff,
+							GNUNET_YES));
+    GNUNET_FUSE_stats_update (gettext_noop ("# download retries"),
+			      1);
+    if (GNUNET_OK != wait_retry (d, backoff))
+      return GNUNET_SYSERR;
+    backoff = GNUNET_TIME_STD_BACKOFF (backoff);
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Wait until the leader of the batch of a download is done with it.
+ *
+ * @param d the download
+ * @return GNUNET_YES if the batch provided all blocks of the download,
+ *         GNUNET_NO if the download must go on alone (or leads the batch)
+ */
+static int
+wait_batch (struct GNUNET_FUSE_Download *d)
+{
+  GNUNET_mutex_lock (block_lock);
+  if ( (NULL == d->batch) ||
+       (d->batch->members[0] == d) )
+  {
+    GNUNET_mutex_unlock (block_lock);
+    return GNUNET_NO;
+  }
+  /* woken up by 'detach_batch' */
+  while (NULL != d->batch)
+    GNUNET_cond_wait (block_cond, block_lock);
+  GNUNET_mutex_unlock (block_lock);
+  return narrow_download (d);
+}
+
+
+/**
+ * Thread performing a download.
+ *
+ * @param cls the 'struct GNUNET_FUSE_Download'
+ * @return NULL
+ */
+static void *
+download_thread (void *cls)
+{
+  struct GNUNET_FUSE_Download *d = cls;
+  struct GNUNET_FUSE_PathInfo *path_info = d->path_info;
+
+  if ( (GNUNET_YES == wait_batch (d)) ||
+       (GNUNET_OK == run_download (d)) )
+  {
+    mark_blocks (path_info,
+		 d->first_block * GNUNET_FUSE_BLOCK_SIZE,
+		 (d->last_block - d->first_block + 1) * GNUNET_FUSE_BLOCK_SIZE);
+    if ( (GNUNET_YES != d->escalated) &&
+	 (0 != local_timeout.rel_value_us) )
+      GNUNET_FUSE_stats_update (gettext_noop ("# downloads satisfied locally"),
+				1);
+  }
+  /* whether we completed or gave up, share what arrived so far */
+  if (NULL != path_info->content->partial)
+    GNUNET_FUSE_cache_partial_flush (path_info->content->partial);
+  GNUNET_mutex_lock (block_lock);
+  GNUNET_CONTAINER_DLL_remove (path_info->content->download_head,
+			       path_info->content->download_tail,
+			       d);
+  active_downloads--;
+  GNUNET_cond_broadcast (block_cond);
+  GNUNET_mutex_unlock (block_lock);
+  GNUNET_FUSE_path_info_done (path_info);
+  GNUNET_free (d);
+  return NULL;
+}
 
-  /**
-   * Download handle.
-   */
-  struct GNUNET_FS_DownloadContext *dc;
 
-  /**
-   * FS handle.
-   */
-  struct GNUNET_FS_Handle *fs;
+/**
+ * Add a download of a whole small file to the open batch, or open a
+ * new batch led by the download.  Caller must hold 'block_lock'.
+ *
+ * @param d the download
+ */
+static void
+join_batch (struct GNUNET_FUSE_Download *d)
+{
+  struct Batch *batch = open_batch;
 
-  /**
-   * Start offset.
-   */
-  off_t start_offset;
+  if ( (NULL != batch) &&
+       (GNUNET_YES != batch->sealed) &&
+       (batch->num < MAX_BATCH_SIZE) &&
+       (batch->members[0]->priority == d->priority) &&
+       (GNUNET_YES != batch->members[0]->cancelled) )
+  {
+    GNUNET_FUSE_stats_update (gettext_noop ("# download processes saved by batching"),
+			      1);
+    batch->members[batch->num++] = d;
+    d->batch = batch;
+    return;
+  }
+  batch = GNUNET_new (struct Batch);
+  batch->members[0] = d;
+  batch->num = 1;
+  d->batch = batch;
+  open_batch = batch;
+}
 
-  /**
-   * Number of bytes to download.
-   */
-  uint64_t length;
 
-  /**
-   * Return value for the operation, 0 on success.
-   */
-  int ret;
+/**
+ * Start a download of a range of blocks.  Downloads of whole small
+ * files are batched.  Caller must hold 'block_lock' and a reference
+ * to the file which is passed on to the download.
+ *
+ * @param path_info file to download
+ * @param first_block first block to download
+ * @param last_block last block to download
+ * @param priority priority of the download
+ * @return GNUNET_OK on success
+ */
+static int
+start_download (struct GNUNET_FUSE_PathInfo *path_info,
+		uint64_t first_block,
+		uint64_t last_block,
+		enum GNUNET_FUSE_DownloadPriority priority)
+{
+  struct GNUNET_FUSE_Download *d;
+  pthread_t thread;
+  uint64_t fsize;
 
-};
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Downloading blocks %llu-%llu of `%s'\n",
+	      (unsigned long long) first_block,
+	      (unsigned long long) last_block,
+	      path_info->filename);
+  d = GNUNET_new (struct GNUNET_FUSE_Download);
+  d->path_info = path_info;
+  d->first_block = first_block;
+  d->last_block = last_block;
+  d->priority = priority;
+  fsize = GNUNET_FS_uri_chk_get_file_size (path_info->uri);
+  if ( (fsize <= small_file_threshold) &&
+       (0 == first_block) &&
+       ((last_block + 1) * GNUNET_FUSE_BLOCK_SIZE >= fsize) )
+  {
+    GNUNET_FUSE_stats_update (gettext_noop ("# small files fetched whole"),
+			      1);
+    join_batch (d);
+  }
+  if (0 != (errno = pthread_create (&thread,
+				    NULL,
+				    &download_thread,
+				    d)))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "pthread_create");
+    if (NULL != d->batch)
+    {
+      /* we joined last, or lead a batch nobody else joined yet */
+      d->batch->num--;
+      if (0 == d->batch->num)
+      {
+	if (open_batch == d->batch)
+	  open_batch = NULL;
+	GNUNET_free (d->batch);
+      }
+    }
+    GNUNET_free (d);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_CONTAINER_DLL_insert (path_info->content->download_head,
+			       path_info->content->download_tail,
+			       d);
+  GNUNET_break (0 == pthread_detach (thread));
+  active_downloads++;
+  return GNUNET_OK;
+}
 
 
 /**
- * Task run when we shut down.
+ * Find the download (if any) that provides a block of a file.
+ * Caller must hold 'block_lock'.
+ *
+ * @param path_info the file
+ * @param block the block
+ * @return NULL if the block is not being downloaded
+ */
+static struct GNUNET_FUSE_Download *
+find_download (const struct GNUNET_FUSE_PathInfo *path_info,
+	       uint64_t block)
+{
+  struct GNUNET_FUSE_Download *pos;
+
+  for (pos = path_info->content->download_head; NULL != pos; pos = pos->next)
+    if ( (pos->first_block <= block) &&
+	 (pos->last_block >= block) )
+      return pos;
+  return NULL;
+}
+
+
+/**
+ * Get the job which provides the slot for a download.  Caller must
+ * hold 'block_lock'.
+ *
+ * @param d the download
+ * @return the job of the leader of the batch of 'd', or the job of
+ *         'd' if it is not batched; NULL if there is none
+ */
+static struct GNUNET_FUSE_Job *
+get_job (const struct GNUNET_FUSE_Download *d)
+{
+  if (NULL != d->batch)
+    return d->batch->members[0]->job;
+  return d->job;
+}
+
+
+/**
+ * Cancel a download.  The slot of a batch is only given up once
+ * all members of the batch were cancelled.  Caller must hold
+ * 'block_lock'.
  *
- * @param cls our 'struct Context'
+ * @param d the download
  */
 static void
-shutdown_task (void *cls)
+cancel_download (struct GNUNET_FUSE_Download *d)
 {
-  struct Context *ctx = cls;
+  struct GNUNET_FUSE_Job *job;
 
-  if (NULL != ctx->dc)
+  if (GNUNET_YES == d->cancelled)
+    return;
+  d->cancelled = GNUNET_YES;
+  if ( (NULL == d->batch) ||
+       (GNUNET_YES == test_cancelled (d->batch->members,
+				      d->batch->num)) )
   {
-    GNUNET_FS_download_stop (ctx->dc, GNUNET_YES);
-    ctx->dc = NULL;
+    if (NULL != (job = get_job (d)))
+      GNUNET_FUSE_scheduler_cancel (job);
   }
-  if (NULL != ctx->fs)
+  GNUNET_FUSE_stats_update (gettext_noop ("# downloads cancelled"),
+			    1);
+  /* wake up 'wait_retry' */
+  GNUNET_cond_broadcast (block_cond);
+}
+
+
+/**
+ * Cancel the downloads of a file, unless an operation waits for
+ * blocks of the file.  Caller must hold 'block_lock'.
+ *
+ * @param path_info the file
+ * @param priority only cancel downloads of this or a higher priority
+ */
+static void
+cancel_downloads (struct GNUNET_FUSE_PathInfo *path_info,
+		  enum GNUNET_FUSE_DownloadPriority priority)
+{
+  struct GNUNET_FUSE_Download *pos;
+
+  if (0 != path_info->content->waiters)
+    return;
+  for (pos = path_info->content->download_head; NULL != pos; pos = pos->next)
+    if (pos->priority <= priority)
+      cancel_download (pos);
+}
+
+
+/**
+ * Allocate the block map of a file if it has none.  Caller must
+ * hold 'block_lock'.
+ *
+ * @param path_info the file
+ */
+static void
+alloc_blocks (struct GNUNET_FUSE_PathInfo *path_info)
+{
+  uint64_t fsize;
+
+  if (NULL != path_info->content->blocks)
+    return;
+  fsize = GNUNET_FS_uri_chk_get_file_size (path_info->uri);
+  path_info->content->blocks
+    = GNUNET_malloc ((fsize + 8 * GNUNET_FUSE_BLOCK_SIZE - 1) / (8 * GNUNET_FUSE_BLOCK_SIZE));
+  path_info->content->blocks_missing
+    = (fsize + GNUNET_FUSE_BLOCK_SIZE - 1) / GNUNET_FUSE_BLOCK_SIZE;
+}
+
+
+/**
+ * Add the blocks that other processes sharing the persistent cache
+ * downloaded into the partial download of a file.  Caller must hold
+ * 'block_lock'.
+ *
+ * @param path_info the file, its content must have a partial download
+ * @return GNUNET_YES if any blocks were added
+ */
+static int
+import_blocks (struct GNUNET_FUSE_PathInfo *path_info)
+{
+  struct GNUNET_FUSE_Content *content = path_info->content;
+  uint8_t *map;
+  uint64_t num_blocks;
+  uint64_t block;
+  uint64_t added;
+  size_t size;
+
+  num_blocks = (GNUNET_FS_uri_chk_get_file_size (path_info->uri)
+		+ GNUNET_FUSE_BLOCK_SIZE - 1) / GNUNET_FUSE_BLOCK_SIZE;
+  size = (size_t) ((num_blocks + 7) / 8);
+  if (0 == size)
+    return GNUNET_NO;
+  alloc_blocks (path_info);
+  map = GNUNET_malloc (size);
+  GNUNET_FUSE_cache_partial_read_map (content->partial,
+				      map,
+				      size);
+  added = 0;
+  for (block = 0; block < num_blocks; block++)
   {
-    GNUNET_FS_stop (ctx->fs);
-    ctx->fs = NULL;
+    if ( (0 == (map[block / 8] & (1 << (block % 8)))) ||
+	 (GNUNET_YES == test_block (path_info, block)) )
+      continue;
+    content->blocks[block / 8] |= (1 << (block % 8));
+    added++;
   }
+  GNUNET_free (map);
+  if (0 == added)
+    return GNUNET_NO;
+  content->blocks_missing -= added;
+  GNUNET_FUSE_stats_update (gettext_noop ("# blocks downloaded by other processes"),
+			    added);
+  GNUNET_cond_broadcast (block_cond);
+  return GNUNET_YES;
 }
 
 
 /**
- * Function called from FS with progress information.
+ * Request a range of a file.  Downloads the blocks of the range
+ * that are neither available nor being downloaded.
  *
- * @param cls our 'struct Context'
- * @param info progress information
- * @return NULL
+ * @param path_info the file, its 'tmpfile' must be set
+ * @param start_offset offset of the first byte of the range
+ * @param length number of bytes in the range
+ * @param priority priority of the download
+ * @param wait GNUNET_YES to wait until the range is available
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
  */
-static void *
-progress_cb (void *cls, const struct GNUNET_FS_ProgressInfo *info)
+static int
+request (struct GNUNET_FUSE_PathInfo *path_info,
+	 off_t start_offset,
+	 uint64_t length,
+	 enum GNUNET_FUSE_DownloadPriority priority,
+	 int wait,
+	 int *eno)
 {
-  struct Context *ctx = cls;
-  char *s;
+  struct GNUNET_FUSE_Download *d;
+  struct GNUNET_FUSE_Job *job;
+  struct GNUNET_TIME_Absolute deadline;
+  struct GNUNET_TIME_Absolute timeout;
+  uint64_t fsize;
+  uint64_t first;
+  uint64_t last;
+  uint64_t block;
+  uint64_t missing_first;
+  uint64_t missing_last;
+  int missing;
+  int started;
+  int refreshed;
+  int interruptible;
+  int interrupted;
+  int ret;
 
-  switch (info->status)
+  fsize = GNUNET_FS_uri_chk_get_file_size (path_info->uri);
+  if ( (0 == length) ||
+       (start_offset >= fsize) )
+    return GNUNET_OK;
+  length = GNUNET_MIN (length, fsize - start_offset);
+  first = start_offset / GNUNET_FUSE_BLOCK_SIZE;
+  last = (start_offset + length - 1) / GNUNET_FUSE_BLOCK_SIZE;
+  /* reference for the download we may start */
+  GNUNET_mutex_lock (path_info->lock);
+  ++path_info->rc;
+  GNUNET_mutex_unlock (path_info->lock);
+  started = GNUNET_NO;
+  refreshed = GNUNET_NO;
+  interrupted = GNUNET_NO;
+  /* only threads serving a FUSE operation (and not the ones loading
+     the root or directories in the background) can be interrupted
+     or have a deadline; 'fuse_interrupted' must not be called on
+     other threads */
+  interruptible = ( (GNUNET_YES == wait) &&
+		    (GNUNET_FUSE_DOWNLOAD_FOREGROUND == priority) &&
+		    (GNUNET_YES == GNUNET_FUSE_in_operation ()) ) ? GNUNET_YES : GNUNET_NO;
+  deadline = GNUNET_TIME_relative_to_absolute (operation_deadline);
+  GNUNET_mutex_lock (block_lock);
+  alloc_blocks (path_info);
+  if (GNUNET_YES == wait)
+    path_info->content->waiters++;
+  while (1)
+  {
+    missing = GNUNET_NO;
+    missing_first = last + 1;
+    missing_last = 0;
+    for (block = first; block <= last; block++)
     {
-    case GNUNET_FS_STATUS_DOWNLOAD_START:
-      GNUNET_break (info->value.download.dc == ctx->dc);
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		  "Started download `%s'.\n",
-		  info->value.download.filename);
+      if (GNUNET_YES == test_block (path_info, block))
+	continue;
+      missing = GNUNET_YES;
+      if (NULL == (d = find_download (path_info, block)))
+      {
+	if (missing_first > last)
+	  missing_first = block;
+	missing_last = block;
+      }
+      else if ( (GNUNET_YES == wait) &&
+		(d->priority > priority) )
+      {
+	/* we wait for it now, so it is no longer speculative */
+	d->priority = priority;
+	if (NULL != (job = get_job (d)))
+	  GNUNET_FUSE_scheduler_boost (job, priority);
+      }
+    }
+    if (GNUNET_NO == missing)
+    {
+      ret = GNUNET_OK;
       break;
-    case GNUNET_FS_STATUS_DOWNLOAD_PROGRESS:
-      GNUNET_break (info->value.download.dc == ctx->dc);
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		  "Downloading `%s' at %llu/%llu\n",
-		  info->value.download.filename,
-		  (unsigned long long) info->value.download.completed,
-		  (unsigned long long) info->value.download.size);
+    }
+    if (GNUNET_YES == offline)
+    {
+      if (GNUNET_YES == wait)
+	GNUNET_FUSE_stats_update (gettext_noop ("# operations failed offline"),
+				  1);
+      *eno = ENODATA;
+      ret = GNUNET_SYSERR;
       break;
-    case GNUNET_FS_STATUS_DOWNLOAD_ERROR:
-      GNUNET_break (info->value.download.dc == ctx->dc);
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		  "Error downloading: %s.\n",
-		  info->value.download.specifics.error.message);
-      GNUNET_SCHEDULER_shutdown ();
+    }
+    if ( (missing_first <= last) &&
+	 (GNUNET_NO == refreshed) &&
+	 (NULL != path_info->content->partial) )
+    {
+      /* other processes may have downloaded the blocks meanwhile */
+      refreshed = GNUNET_YES;
+      if (GNUNET_YES == import_blocks (path_info))
+	continue;
+    }
+    if (missing_first <= last)
+    {
+      /* only try once; if our own download did not provide the
+	 blocks, it failed */
+      if ( (GNUNET_YES == started) ||
+	   (GNUNET_OK != start_download (path_info,
+					 missing_first,
+					 missing_last,
+					 priority)) )
+      {
+	*eno = EIO; /* low level IO error */
+	ret = GNUNET_SYSERR;
+	break;
+      }
+      started = GNUNET_YES;
+    }
+    if (GNUNET_YES != wait)
+    {
+      ret = GNUNET_OK;
       break;
-    case GNUNET_FS_STATUS_DOWNLOAD_COMPLETED:
-      GNUNET_break (info->value.download.dc == ctx->dc);
-      s =
-	GNUNET_STRINGS_byte_size_fancy (info->value.download.completed *
-					1000000LL /
-					(info->value.download.
-					 duration.rel_value_us + 1));
+    }
+    if (GNUNET_YES != interruptible)
+    {
+      GNUNET_cond_wait (block_cond, block_lock);
+      continue;
+    }
+    if (0 == GNUNET_TIME_absolute_get_remaining (deadline).rel_value_us)
+    {
+      /* the downloads go on and warm the cache for the next attempt */
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		  "Downloading `%s' done (%s/s).\n",
-		  info->value.download.filename, s);
-      GNUNET_free (s);
-      ctx->ret = 0;
-      GNUNET_SCHEDULER_shutdown ();
-      break;
-    case GNUNET_FS_STATUS_DOWNLOAD_STOPPED:
-      GNUNET_SCHEDULER_shutdown ();
+		  "Operation on `%s' passed its deadline\n",
+		  path_info->filename);
+      GNUNET_FUSE_stats_update (gettext_noop ("# operations past their deadline"),
+				1);
+      *eno = EAGAIN;
+      ret = GNUNET_SYSERR;
       break;
-    case GNUNET_FS_STATUS_DOWNLOAD_ACTIVE:
-    case GNUNET_FS_STATUS_DOWNLOAD_INACTIVE:
-      break;
-    default:
-      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		  _("Unexpected status: %d\n"), info->status);
+    }
+    timeout = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+									       MONITOR_INTERVAL_MS));
+    (void) GNUNET_cond_timedwait (block_cond,
+				  block_lock,
+				  GNUNET_TIME_absolute_min (timeout,
+							    deadline));
+    if (0 != fuse_interrupted ())
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Operation on `%s' was interrupted\n",
+		  path_info->filename);
+      GNUNET_FUSE_stats_update (gettext_noop ("# operations interrupted"),
+				1);
+      *eno = EINTR;
+      interrupted = GNUNET_YES;
+      ret = GNUNET_SYSERR;
       break;
     }
-  return NULL;
+  }
+  if (GNUNET_YES == wait)
+    path_info->content->waiters--;
+  /* if nobody else waits, nobody needs what we were waiting for */
+  if (GNUNET_YES == interrupted)
+    cancel_downloads (path_info,
+		      GNUNET_FUSE_DOWNLOAD_FOREGROUND);
+  GNUNET_mutex_unlock (block_lock);
+  if (GNUNET_YES != started)
+    GNUNET_FUSE_path_info_done (path_info);
+  return ret;
 }
 
 
 /**
- * Main task run by the helper process which downloads the file.
+ * Download a range of a file into its 'tmpfile'.  Blocks until all
+ * of the range is available, which may be before the downloads that
+ * provide it are complete.  Parts of the range that are already
+ * available or that are being downloaded are not requested again.
  *
- * @param cls 'struct Context' with information about the download
+ * @param path_info information about the file to download,
+ *        its 'tmpfile' must be set
+ * @param start_offset offset of the first byte to download
+ * @param length number of bytes to download from 'start_offset'
+ * @param priority priority of the download (see gfs_scheduler.h)
+ * @param eno where to store 'errno' on errors: EINTR if the FUSE
+ *        operation was interrupted, EAGAIN if it passed its
+ *        deadline (the downloads go on), ENODATA if the range is
+ *        not available and we are offline, EIO if the range could
+ *        not be downloaded (even after retrying)
+ * @return GNUNET_OK on success
  */
-static void
-download_task (void *cls)
+int
+GNUNET_FUSE_download_file (struct GNUNET_FUSE_PathInfo *path_info,
+			   off_t start_offset,
+			   uint64_t length,
+			   enum GNUNET_FUSE_DownloadPriority priority,
+			   int *eno)
 {
-  struct Context *ctx = cls;
+  return request (path_info,
+		  start_offset,
+		  length,
+		  priority,
+		  GNUNET_YES,
+		  eno);
+}
+
+
+/**
+ * Start downloading a range of a file into its 'tmpfile' without
+ * waiting for the data (i.e. for readahead).
+ *
+ * @param path_info information about the file to download,
+ *        its 'tmpfile' must be set
+ * @param start_offset offset of the first byte to download
+ * @param length number of bytes to download from 'start_offset'
+ * @param priority priority of the download (see gfs_scheduler.h)
+ */
+void
+GNUNET_FUSE_download_start (struct GNUNET_FUSE_PathInfo *path_info,
+			    off_t start_offset,
+			    uint64_t length,
+			    enum GNUNET_FUSE_DownloadPriority priority)
+{
+  int eno;
+
+  (void) request (path_info,
+		  start_offset,
+		  length,
+		  priority,
+		  GNUNET_NO,
+		  &eno);
+}
+
+
+/**
+ * Start downloading small files whole into their 'tmpfile's without
+ * waiting for the data.  Files that are available or that are being
+ * downloaded are skipped.  Unlike separate calls to
+ * 'GNUNET_FUSE_download_start', the downloads are batched together
+ * (up to the maximum size of a batch) even if a slot is free, so
+ * that they are performed by a single process.
+ *
+ * @param files the files, their 'tmpfile' must be set and they
+ *        must not be larger than the 'SMALL_FILE_THRESHOLD'
+ * @param num number of entries in 'files'
+ * @param priority priority of the downloads (see gfs_scheduler.h)
+ * @return number of downloads started
+ */
+unsigned int
+GNUNET_FUSE_download_start_batch (struct GNUNET_FUSE_PathInfo **files,
+				  unsigned int num,
+				  enum GNUNET_FUSE_DownloadPriority priority)
+{
+  struct GNUNET_FUSE_PathInfo *path_info;
+  uint64_t last;
+  uint64_t block;
+  unsigned int i;
+  unsigned int started;
+  int *keep;
 
-  ctx->fs = GNUNET_FS_start (cfg, "gnunet-fuse", &progress_cb, ctx,
-			     GNUNET_FS_FLAGS_NONE,
-			     GNUNET_FS_OPTIONS_DOWNLOAD_PARALLELISM, 1,
-			     GNUNET_FS_OPTIONS_REQUEST_PARALLELISM, 1,
-			     GNUNET_FS_OPTIONS_END);
-  if (NULL == ctx->fs)
+  if (GNUNET_YES == offline)
+    return 0;
+  /* references for the downloads we may start */
+  for (i = 0; i < num; i++)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("Could not initialize `%s' subsystem.\n"), "FS");
-    return;
+    GNUNET_mutex_lock (files[i]->lock);
+    ++files[i]->rc;
+    GNUNET_mutex_unlock (files[i]->lock);
   }
-  ctx->dc = GNUNET_FS_download_start (ctx->fs,
-				      ctx->path_info->uri, ctx->path_info->meta,
-				      ctx->path_info->tmpfile, NULL,
-				      (uint64_t) ctx->start_offset,
-				      ctx->length,
-				      anonymity_level,
-				      GNUNET_FS_DOWNLOAD_OPTION_NONE,
-				      NULL, NULL);
-  if (NULL == ctx->dc)
+  keep = GNUNET_new_array (num, int);
+  started = 0;
+  GNUNET_mutex_lock (block_lock);
+  for (i = 0; i < num; i++)
   {
-    GNUNET_FS_stop (ctx->fs);
-    ctx->fs = NULL;
-    return;
+    path_info = files[i];
+    if ( (0 == GNUNET_FS_uri_chk_get_file_size (path_info->uri)) ||
+	 (NULL != path_info->content->download_head) )
+      continue;
+    alloc_blocks (path_info);
+    last = (GNUNET_FS_uri_chk_get_file_size (path_info->uri) - 1) / GNUNET_FUSE_BLOCK_SIZE;
+    for (block = 0; block <= last; block++)
+      if (GNUNET_NO == test_block (path_info, block))
+	break;
+    if (block > last)
+      continue;
+    /* we hold 'block_lock', so the leader cannot seal the batch
+       before all of them joined */
+    if (GNUNET_OK != start_download (path_info,
+				     0,
+				     last,
+				     priority))
+      continue;
+    keep[i] = GNUNET_YES;
+    started++;
   }
-  GNUNET_SCHEDULER_add_shutdown (&shutdown_task, ctx);
+  GNUNET_mutex_unlock (block_lock);
+  for (i = 0; i < num; i++)
+    if (GNUNET_YES != keep[i])
+      GNUNET_FUSE_path_info_done (files[i]);
+  GNUNET_free (keep);
+  return started;
 }
 
 
 /**
- * Download a file.  Blocks until we're done.
+ * Make sure a file has a 'tmpfile' to download into.  Uses the
+ * complete copy of the file in the persistent cache if there is
+ * one, otherwise its partial download in the persistent cache (so
+ * that we use the blocks other processes sharing the cache
+ * downloaded, and they use ours), or a temporary file if we have no
+ * persistent cache.  Caller must hold the lock of the content of
+ * the file.
  *
- * @param path_info information about the file to download
- * @param start_offset offset of the first byte to download
- * @param length number of bytes to download from 'start_offset'
+ * @param path_info the file
  * @return GNUNET_OK on success
  */
 int
-GNUNET_FUSE_download_file (struct GNUNET_FUSE_PathInfo *path_info,
-			   off_t start_offset,
-			   uint64_t length)
+GNUNET_FUSE_download_prepare (struct GNUNET_FUSE_PathInfo *path_info)
 {
-  struct Context ctx;
-  pid_t pid;
-  int status;
-  int ret;
+  struct GNUNET_FUSE_Content *content = path_info->content;
 
-  /* lock to prevent two processes from downloading / manipulating the
-     same file at the same time */
-  GNUNET_mutex_lock (path_info->lock);
-  pid = fork ();
-  if (-1 == pid)
+  if (NULL != content->tmpfile)
+    return GNUNET_OK;
+  if (GNUNET_YES == GNUNET_FUSE_cache_test (path_info->uri))
   {
-    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "fork");
-    GNUNET_mutex_unlock (path_info->lock);
-    return GNUNET_SYSERR;
+    content->tmpfile = GNUNET_FUSE_cache_get_filename (path_info->uri, NULL);
+    content->tmpfile_cached = GNUNET_YES;
+    GNUNET_FUSE_download_mark_available (path_info);
+    return GNUNET_OK;
   }
-  if (0 != pid)
+  if ( (NULL == content->partial) &&
+       (0 != GNUNET_FS_uri_chk_get_file_size (path_info->uri)) )
+    content->partial = GNUNET_FUSE_cache_partial_open (path_info->uri);
+  if (NULL == content->partial)
   {
-    while ( (-1 == (ret = waitpid (pid, &status, 0))) &&
-	    (EINTR == errno) ) ;
-    if (pid != ret)
-    {
-      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "waitpid");
-      (void) kill (pid, SIGKILL);
-      (void) waitpid (pid, &status, 0);
-      GNUNET_mutex_unlock (path_info->lock);
-      return GNUNET_SYSERR;
-    }
-    GNUNET_mutex_unlock (path_info->lock);
-    if ( (WIFEXITED (status)) &&
-	 (0 == WEXITSTATUS (status)) )
-      return GNUNET_OK;
-    return GNUNET_SYSERR;
+    content->tmpfile = GNUNET_DISK_mktemp ("gnunet-fuse-tempfile");
+    return (NULL == content->tmpfile) ? GNUNET_SYSERR : GNUNET_OK;
   }
-  memset (&ctx, 0, sizeof (ctx));
-  ctx.ret = 1;
-  ctx.path_info = path_info;
-  ctx.start_offset = start_offset;
-  ctx.length = length;
-  GNUNET_SCHEDULER_run (&download_task, &ctx);
-  _exit (ctx.ret);
+  content->tmpfile = GNUNET_strdup (GNUNET_FUSE_cache_partial_get_filename (content->partial));
+  content->tmpfile_cached = GNUNET_YES;
+  GNUNET_mutex_lock (block_lock);
+  (void) import_blocks (path_info);
+  GNUNET_mutex_unlock (block_lock);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Mark all blocks of a file as available (i.e. because its
+ * 'tmpfile' was downloaded as a whole by other means).
+ *
+ * @param path_info the file, its 'tmpfile' must be complete
+ */
+void
+GNUNET_FUSE_download_mark_available (struct GNUNET_FUSE_PathInfo *path_info)
+{
+  uint64_t fsize;
+
+  fsize = GNUNET_FS_uri_chk_get_file_size (path_info->uri);
+  if (0 == fsize)
+    return;
+  GNUNET_mutex_lock (block_lock);
+  alloc_blocks (path_info);
+  memset (path_info->content->blocks,
+	  0xFF,
+	  (fsize + 8 * GNUNET_FUSE_BLOCK_SIZE - 1) / (8 * GNUNET_FUSE_BLOCK_SIZE));
+  path_info->content->blocks_missing = 0;
+  GNUNET_cond_broadcast (block_cond);
+  GNUNET_mutex_unlock (block_lock);
+}
+
+
+/**
+ * Forget which parts of the 'tmpfile' of a file are available
+ * (i.e. because the 'tmpfile' is about to be removed).
+ *
+ * @param path_info the file
+ * @return GNUNET_OK on success, GNUNET_NO if downloads into
+ *         the 'tmpfile' are still running
+ */
+int
+GNUNET_FUSE_download_forget (struct GNUNET_FUSE_PathInfo *path_info)
+{
+  GNUNET_mutex_lock (block_lock);
+  if (NULL != path_info->content->download_head)
+  {
+    GNUNET_mutex_unlock (block_lock);
+    return GNUNET_NO;
+  }
+  GNUNET_free_non_null (path_info->content->blocks);
+  path_info->content->blocks = NULL;
+  GNUNET_mutex_unlock (block_lock);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Cancel the downloads of a file that no operation waits for
+ * (i.e. readahead once the file was closed).
+ *
+ * @param path_info the file
+ */
+void
+GNUNET_FUSE_download_cancel (struct GNUNET_FUSE_PathInfo *path_info)
+{
+  GNUNET_mutex_lock (block_lock);
+  cancel_downloads (path_info,
+		    GNUNET_FUSE_DOWNLOAD_BACKGROUND);
+  GNUNET_mutex_unlock (block_lock);
+}
+
+
+/**
+ * Shutdown the download subsystem.  Waits for running downloads,
+ * so speculative downloads should be stopped first.
+ */
+void
+GNUNET_FUSE_download_done ()
+{
+  GNUNET_mutex_lock (block_lock);
+  /* speculative downloads waiting to retry stop now */
+  GNUNET_cond_broadcast (block_cond);
+  while (0 != active_downloads)
+    GNUNET_cond_wait (block_cond, block_lock);
+  GNUNET_mutex_unlock (block_lock);
+  GNUNET_cond_destroy (block_cond);
+  block_cond = NULL;
+  GNUNET_mutex_destroy (block_lock);
+  block_lock = NULL;
 }
 
 /* end of gfs_download.c */
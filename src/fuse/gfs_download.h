@@ -28,16 +28,145 @@
 #include "gnunet-fuse.h"
 
 /**
- * Download a file.  Blocks until we're done.
+ * Granularity at which we track which parts of a file are
+ * available (the size of the data blocks of FS).
+ */
+#define GNUNET_FUSE_BLOCK_SIZE (32 * 1024)
+
+
+/**
+ * Setup the download subsystem.  Downloads first ask the local
+ * datastore and only ask the network for blocks it does not have.
+ *
+ * @param local how long to wait for the next block from the local
+ *        datastore before asking the network, 0 to always ask
+ *        the network
+ * @param retry how long to retry failed downloads, 0 to not retry
+ * @param hedge percentile of the delays between blocks after which
+ *        a stalled download is hedged, 0 to never hedge
+ */
+void
+GNUNET_FUSE_download_init (struct GNUNET_TIME_Relative local,
+                           struct GNUNET_TIME_Relative retry,
+                           unsigned int hedge);
+
+
+/**
+ * Download a range of a file into its 'tmpfile'.  Blocks until all
+ * of the range is available, which may be before the downloads that
+ * provide it are complete.  Parts of the range that are already
+ * available or that are being downloaded are not requested again.
  *
- * @param path_info information about the file to download
+ * @param path_info information about the file to download,
+ *        its 'tmpfile' must be set
  * @param start_offset offset of the first byte to download
  * @param length number of bytes to download from 'start_offset'
+ * @param priority priority of the download (see gfs_scheduler.h)
+ * @param eno where to store 'errno' on errors: EINTR if the FUSE
+ *        operation was interrupted, EAGAIN if it passed its
+ *        deadline (the downloads go on), ENODATA if the range is
+ *        not available and we are offline, EIO if the range could
+ *        not be downloaded (even after retrying)
  * @return GNUNET_OK on success
  */
 int
 GNUNET_FUSE_download_file (struct GNUNET_FUSE_PathInfo *path_info,
                            off_t start_offset,
-                           uint64_t length);
+                           uint64_t length,
+                           enum GNUNET_FUSE_DownloadPriority priority,
+                           int *eno);
+
+
+/**
+ * Start downloading a range of a file into its 'tmpfile' without
+ * waiting for the data (i.e. for readahead).
+ *
+ * @param path_info information about the file to download,
+ *        its 'tmpfile' must be set
+ * @param start_offset offset of the first byte to download
+ * @param length number of bytes to download from 'start_offset'
+ * @param priority priority of the download (see gfs_scheduler.h)
+ */
+void
+GNUNET_FUSE_download_start (struct GNUNET_FUSE_PathInfo *path_info,
+                            off_t start_offset,
+                            uint64_t length,
+                            enum GNUNET_FUSE_DownloadPriority priority);
+
+
+/**
+ * Start downloading small files whole into their 'tmpfile's without
+ * waiting for the data.  Files that are available or that are being
+ * downloaded are skipped.  Unlike separate calls to
+ * 'GNUNET_FUSE_download_start', the downloads are batched together
+ * (up to the maximum size of a batch) even if a slot is free, so
+ * that they are performed by a single process.
+ *
+ * @param files the files, their 'tmpfile' must be set and they
+ *        must not be larger than the 'SMALL_FILE_THRESHOLD'
+ * @param num number of entries in 'files'
+ * @param priority priority of the downloads (see gfs_scheduler.h)
+ * @return number of downloads started
+ */
+unsigned int
+GNUNET_FUSE_download_start_batch (struct GNUNET_FUSE_PathInfo **files,
+                                  unsigned int num,
+                                  enum GNUNET_FUSE_DownloadPriority priority);
+
+
+/**
+ * Make sure a file has a 'tmpfile' to download into.  Uses the
+ * complete copy of the file in the persistent cache if there is
+ * one, otherwise its partial download in the persistent cache (so
+ * that we use the blocks other processes sharing the cache
+ * downloaded, and they use ours), or a temporary file if we have no
+ * persistent cache.  Caller must hold the lock of the content of
+ * the file.
+ *
+ * @param path_info the file
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_download_prepare (struct GNUNET_FUSE_PathInfo *path_info);
+
+
+/**
+ * Mark all blocks of a file as available (i.e. because its
+ * 'tmpfile' was downloaded as a whole by other means).
+ *
+ * @param path_info the file, its 'tmpfile' must be complete
+ */
+void
+GNUNET_FUSE_download_mark_available (struct GNUNET_FUSE_PathInfo *path_info);
+
+
+/**
+ * Cancel the downloads of a file that no operation waits for
+ * (i.e. readahead once the file was closed).
+ *
+ * @param path_info the file
+ */
+void
+GNUNET_FUSE_download_cancel (struct GNUNET_FUSE_PathInfo *path_info);
+
+
+/**
+ * Forget which parts of the 'tmpfile' of a file are available
+ * (i.e. because the 'tmpfile' is about to be removed).
+ *
+ * @param path_info the file
+ * @return GNUNET_OK on success, GNUNET_NO if downloads into
+ *         the 'tmpfile' are still running
+ */
+int
+GNUNET_FUSE_download_forget (struct GNUNET_FUSE_PathInfo *path_info);
+
+
+/**
+ * Shutdown the download subsystem.  Waits for running downloads,
+ * so speculative downloads should be stopped first.
+ */
+void
+GNUNET_FUSE_download_done (void);
 
 #endif
@@ -0,0 +1,716 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_hot_cache.c
+ * @brief blocks that are read often, kept in memory
+ *
+ * Small files such as indices or configuration data may be read many
+ * times per second.  Instead of reading them from the 'tmpfile' each
+ * time, we keep their blocks in memory (by the key of the content
+ * and the number of the block; content never changes, so blocks
+ * never become invalid).
+ *
+ * The cache is split into shards by block, each with its own lock
+ * and LRU lists, so that readers of different blocks rarely wait for
+ * each other.  A block is only added once it was read twice within a
+ * while (each shard remembers the blocks it saw once in a bitmap that
+ * is cleared regularly), so data that is read once (i.e. by 'cp' or
+ * a backup) does not evict the blocks that are used all the time.
+ *
+ * Blocks are kept as they are while they are used a lot.  Blocks
+ * that drop out of this (small) working set are compressed and kept
+ * in a second, larger LRU list if that makes them smaller (text,
+ * i.e. configuration data, typically shrinks to a fraction).  Reading
+ * a compressed block decompresses it and moves it back into the
+ * working set.
+ */
+#include "gfs_hot_cache.h"
+#include "gfs_download.h"
+#include "gfs_stats.h"
+
+
+/**
+ * Number of shards.
+ */
+#define NUM_SHARDS 16
+
+/**
+ * Number of bits in the map of blocks a shard saw once.
+ */
+#define SEEN_BITS (64 * 1024)
+
+/**
+ * Number of blocks a shard notes in the map of blocks it saw once
+ * before it clears the map.
+ */
+#define SEEN_LIMIT (SEEN_BITS / 4)
+
+/**
+ * Number of hits a shard counts before it adds them to the
+ * statistics (to keep the lock of the statistics off the fast path).
+ */
+#define HIT_BATCH 1024
+
+
+/**
+ * A block in the cache.
+ */
+struct HotBlock
+{
+
+  /**
+   * Blocks are kept in DLLs in LRU order (one for blocks as they
+   * are, one for compressed blocks).
+   */
+  struct HotBlock *next;
+
+  /**
+   * Blocks are kept in DLLs in LRU order.
+   */
+  struct HotBlock *prev;
+
+  /**
+   * Key of the block in the map of its shard.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Key of the content of the block.
+   */
+  struct GNUNET_HashCode content;
+
+  /**
+   * Number of the block in the content.
+   */
+  uint64_t block;
+
+  /**
+   * Data of the block, compressed if 'csize' is not 0.
+   */
+  char *data;
+
+  /**
+   * Number of bytes in the block.
+   */
+  size_t size;
+
+  /**
+   * Number of bytes of compressed data, 0 if the block is
+   * not compressed.
+   */
+  size_t csize;
+
+};
+
+
+/**
+ * Part of the cache.
+ */
+struct Shard
+{
+
+  /**
+   * Lock for all other fields.
+   */
+  struct GNUNET_Mutex *lock;
+
+  /**
+   * Map from keys to 'struct HotBlock'.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *map;
+
+  /**
+   * Least recently used block that is not compressed.
+   */
+  struct HotBlock *lru_head;
+
+  /**
+   * Most recently used block that is not compressed.
+   */
+  struct HotBlock *lru_tail;
+
+  /**
+   * Least recently used compressed block.
+   */
+  struct HotBlock *compressed_head;
+
+  /**
+   * Most recently used compressed block.
+   */
+  struct HotBlock *compressed_tail;
+
+  /**
+   * Number of bytes of blocks that are not compressed.
+   */
+  uint64_t size;
+
+  /**
+   * Number of bytes of compressed data.
+   */
+  uint64_t compressed_size;
+
+  /**
+   * Number of blocks noted in 'seen' since it was cleared.
+   */
+  unsigned int seen_count;
+
+  /**
+   * Hits not yet added to the statistics.
+   */
+  unsigned int hits;
+
+  /**
+   * Map of the blocks the shard saw once (by key).
+   */
+  uint8_t seen[SEEN_BITS / 8];
+
+};
+
+
+/**
+ * The shards, NULL if the cache is disabled.
+ */
+static struct Shard *shards;
+
+/**
+ * Maximum number of bytes of blocks in a shard that are not
+ * compressed.
+ */
+static uint64_t max_shard_size;
+
+/**
+ * Maximum number of bytes of compressed data in a shard.
+ */
+static uint64_t max_compressed_shard_size;
+
+
+/**
+ * Setup the hot block cache.
+ *
+ * @param max_bytes maximum number of bytes of blocks to keep as
+ *        they are
+ * @param max_compressed_bytes maximum number of bytes of compressed
+ *        data to keep, 0 to not compress blocks
+ */
+void
+GNUNET_FUSE_hot_cache_init (unsigned long long max_bytes,
+			    unsigned long long max_compressed_bytes)
+{
+  unsigned int i;
+
+  if ( (0 == max_bytes) &&
+       (0 == max_compressed_bytes) )
+    return;
+  max_shard_size = max_bytes / NUM_SHARDS;
+  max_compressed_shard_size = max_compressed_bytes / NUM_SHARDS;
+  shards = GNUNET_malloc (NUM_SHARDS * sizeof (struct Shard));
+  for (i = 0; i < NUM_SHARDS; i++)
+  {
+    shards[i].lock = GNUNET_mutex_create (GNUNET_NO);
+    shards[i].map = GNUNET_CONTAINER_multihashmap_create (256, GNUNET_YES);
+  }
+}
+
+
+/**
+ * Get the key of a block and the shard it belongs to.
+ *
+ * @param content key of the content
+ * @param block number of the block
+ * @param key set to the key of the block
+ * @return the shard of the block
+ */
+static struct Shard *
+get_key (const struct GNUNET_HashCode *content,
+	 uint64_t block,
+	 struct GNUNET_HashCode *key)
+{
+  /* content keys are hashes, so this spreads the blocks of a
+     content over the shards and keeps keys of contents apart */
+  *key = *content;
+  key->bits[0] ^= (uint32_t) block;
+  key->bits[1] ^= (uint32_t) (block >> 32);
+  return &shards[key->bits[0] % NUM_SHARDS];
+}
+
+
+/**
+ * Find a block in its shard.  Caller must hold the lock of the shard.
+ *
+ * @param shard the shard
+ * @param key key of the block
+ * @param content key of the content
+ * @param block number of the block
+ * @return NULL if the block is not in the cache
+ */
+static struct HotBlock *
+find_block (struct Shard *shard,
+	    const struct GNUNET_HashCode *key,
+	    const struct GNUNET_HashCode *content,
+	    uint64_t block)
+{
+  struct HotBlock *hb;
+
+  if ( (NULL == (hb = GNUNET_CONTAINER_multihashmap_get (shard->map, key))) ||
+       (block != hb->block) ||
+       (0 != memcmp (content, &hb->content, sizeof (struct GNUNET_HashCode))) )
+    return NULL;
+  return hb;
+}
+
+
+/**
+ * Take a block out of its shard (but do not free it).  Caller must
+ * hold the lock of the shard.
+ *
+ * @param shard the shard
+ * @param hb block to take out
+ */
+static void
+detach_block (struct Shard *shard,
+	      struct HotBlock *hb)
+{
+  GNUNET_assert (GNUNET_YES ==
+		 GNUNET_CONTAINER_multihashmap_remove (shard->map,
+						       &hb->key,
+						       hb));
+  if (0 == hb->csize)
+  {
+    GNUNET_CONTAINER_DLL_remove (shard->lru_head,
+				 shard->lru_tail,
+				 hb);
+    shard->size -= hb->size;
+  }
+  else
+  {
+    GNUNET_CONTAINER_DLL_remove (shard->compressed_head,
+				 shard->compressed_tail,
+				 hb);
+    shard->compressed_size -= hb->csize;
+  }
+}
+
+
+/**
+ * Free a block.
+ *
+ * @param hb block to free
+ */
+static void
+free_block (struct HotBlock *hb)
+{
+  GNUNET_free (hb->data);
+  GNUNET_free (hb);
+}
+
+
+/**
+ * Add a block to its shard.  Caller must hold the lock of the shard
+ * and make sure that there is room for the block.
+ *
+ * @param shard the shard
+ * @param hb block to add
+ */
+static void
+attach_block (struct Shard *shard,
+	      struct HotBlock *hb)
+{
+  struct HotBlock *old;
+
+  /* another block with the same key (unlikely) is replaced */
+  if (NULL != (old = GNUNET_CONTAINER_multihashmap_get (shard->map, &hb->key)))
+  {
+    detach_block (shard, old);
+    free_block (old);
+  }
+  GNUNET_assert (GNUNET_OK ==
+		 GNUNET_CONTAINER_multihashmap_put (shard->map,
+						    &hb->key,
+						    hb,
+						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  if (0 == hb->csize)
+  {
+    GNUNET_CONTAINER_DLL_insert_tail (shard->lru_head,
+				      shard->lru_tail,
+				      hb);
+    shard->size += hb->size;
+  }
+  else
+  {
+    GNUNET_CONTAINER_DLL_insert_tail (shard->compressed_head,
+				      shard->compressed_tail,
+				      hb);
+    shard->compressed_size += hb->csize;
+  }
+}
+
+
+/**
+ * Make room for a block that is not compressed.  The blocks that
+ * have to go are taken out of the shard so that they can be
+ * compressed without holding the lock.  Caller must hold the lock
+ * of the shard.
+ *
+ * @param shard the shard
+ * @param size number of bytes to make room for
+ * @param victims_head head of the list of blocks that had to go
+ * @param victims_tail tail of the list of blocks that had to go
+ */
+static void
+make_room (struct Shard *shard,
+	   size_t size,
+	   struct HotBlock **victims_head,
+	   struct HotBlock **victims_tail)
+{
+  struct HotBlock *hb;
+
+  while (shard->size + size > max_shard_size)
+  {
+    hb = shard->lru_head;
+    detach_block (shard, hb);
+    GNUNET_CONTAINER_DLL_insert_tail (*victims_head,
+				      *victims_tail,
+				      hb);
+  }
+}
+
+
+/**
+ * Compress blocks and keep them in the list of compressed blocks
+ * (if that makes them smaller).  Caller must not hold the lock of
+ * the shard.
+ *
+ * @param shard the shard of the blocks
+ * @param victims_head head of the list of blocks to compress
+ */
+static void
+compress_blocks (struct Shard *shard,
+		 struct HotBlock *victims_head)
+{
+  struct HotBlock *hb;
+  struct HotBlock *old;
+  char *cdata;
+  size_t csize;
+
+  while (NULL != (hb = victims_head))
+  {
+    victims_head = hb->next;
+    if ( (0 == max_compressed_shard_size) ||
+	 (GNUNET_YES != GNUNET_try_compression (hb->data,
+						hb->size,
+						&cdata,
+						&csize)) )
+    {
+      free_block (hb);
+      continue;
+    }
+    if (csize > max_compressed_shard_size)
+    {
+      GNUNET_free (cdata);
+      free_block (hb);
+      continue;
+    }
+    GNUNET_free (hb->data);
+    hb->data = cdata;
+    hb->csize = csize;
+    GNUNET_mutex_lock (shard->lock);
+    if (NULL != find_block (shard, &hb->key, &hb->content, hb->block))
+    {
+      /* a reader added it again meanwhile */
+      GNUNET_mutex_unlock (shard->lock);
+      free_block (hb);
+      continue;
+    }
+    while (shard->compressed_size + csize > max_compressed_shard_size)
+    {
+      old = shard->compressed_head;
+      detach_block (shard, old);
+      free_block (old);
+    }
+    attach_block (shard, hb);
+    GNUNET_mutex_unlock (shard->lock);
+    GNUNET_FUSE_stats_update (gettext_noop ("# blocks compressed in the hot cache"),
+			      1);
+  }
+}
+
+
+/**
+ * Read data from the hot block cache.
+ *
+ * @param content the content to read from
+ * @param offset offset of the first byte to read
+ * @param size number of bytes to read (must be within the content)
+ * @param buf where to store the data
+ * @return GNUNET_YES if all of the data was in the cache (and
+ *         is now in 'buf'), GNUNET_NO if not
+ */
+int
+GNUNET_FUSE_hot_cache_get (const struct GNUNET_FUSE_Content *content,
+			   uint64_t offset,
+			   size_t size,
+			   void *buf)
+{
+  struct GNUNET_HashCode key;
+  struct Shard *shard;
+  struct HotBlock *hb;
+  struct HotBlock *victims_head;
+  struct HotBlock *victims_tail;
+  uint64_t block;
+  uint64_t start;
+  size_t len;
+  size_t pos;
+  char *data;
+  int report;
+
+  if ( (NULL == shards) ||
+       (0 == size) )
+    return GNUNET_NO;
+  for (pos = 0; pos < size; pos += len)
+  {
+    block = (offset + pos) / GNUNET_FUSE_BLOCK_SIZE;
+    start = (offset + pos) % GNUNET_FUSE_BLOCK_SIZE;
+    shard = get_key (&content->key, block, &key);
+    GNUNET_mutex_lock (shard->lock);
+    if ( (NULL == (hb = find_block (shard, &key, &content->key, block))) ||
+	 (start >= hb->size) )
+    {
+      GNUNET_mutex_unlock (shard->lock);
+      return GNUNET_NO;
+    }
+    len = GNUNET_MIN (size - pos, hb->size - start);
+    if (0 == hb->csize)
+    {
+      memcpy ((char *) buf + pos, &hb->data[start], len);
+      GNUNET_CONTAINER_DLL_remove (shard->lru_head,
+				   shard->lru_tail,
+				   hb);
+      GNUNET_CONTAINER_DLL_insert_tail (shard->lru_head,
+					shard->lru_tail,
+					hb);
+      report = (HIT_BATCH == ++shard->hits) ? GNUNET_YES : GNUNET_NO;
+      if (GNUNET_YES == report)
+	shard->hits = 0;
+      GNUNET_mutex_unlock (shard->lock);
+      if (GNUNET_YES == report)
+	GNUNET_FUSE_stats_update (gettext_noop ("# hot cache hits"),
+				  HIT_BATCH);
+      continue;
+    }
+    if (NULL == (data = GNUNET_decompress (hb->data, hb->csize, hb->size)))
+    {
+      GNUNET_break (0);
+      detach_block (shard, hb);
+      free_block (hb);
+      GNUNET_mutex_unlock (shard->lock);
+      return GNUNET_NO;
+    }
+    memcpy ((char *) buf + pos, &data[start], len);
+    victims_head = NULL;
+    victims_tail = NULL;
+    if (hb->size <= max_shard_size)
+    {
+      /* used again, back into the working set */
+      detach_block (shard, hb);
+      GNUNET_free (hb->data);
+      hb->data = data;
+      hb->csize = 0;
+      make_room (shard, hb->size, &victims_head, &victims_tail);
+      attach_block (shard, hb);
+    }
+    else
+    {
+      GNUNET_CONTAINER_DLL_remove (shard->compressed_head,
+				   shard->compressed_tail,
+				   hb);
+      GNUNET_CONTAINER_DLL_insert_tail (shard->compressed_head,
+					shard->compressed_tail,
+					hb);
+      GNUNET_free (data);
+    }
+    GNUNET_mutex_unlock (shard->lock);
+    compress_blocks (shard, victims_head);
+    GNUNET_FUSE_stats_update (gettext_noop ("# hot cache hits on compressed blocks"),
+			      1);
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * Check if a block was seen before recently enough to be added to
+ * the cache, and note that we saw it.  Caller must hold the lock of
+ * the shard.
+ *
+ * @param shard the shard of the block
+ * @param key key of the block
+ * @return GNUNET_YES if the block should be added
+ */
+static int
+admit (struct Shard *shard,
+       const struct GNUNET_HashCode *key)
+{
+  uint32_t bit;
+
+  bit = (key->bits[0] / NUM_SHARDS) % SEEN_BITS;
+  if (0 != (shard->seen[bit / 8] & (1 << (bit % 8))))
+    return GNUNET_YES;
+  if (SEEN_LIMIT == shard->seen_count)
+  {
+    /* forget what was seen long ago */
+    memset (shard->seen, 0, sizeof (shard->seen));
+    shard->seen_count = 0;
+  }
+  shard->seen[bit / 8] |= (1 << (bit % 8));
+  shard->seen_count++;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Tell the hot block cache that data was read from the file of a
+ * content.  Blocks that were read before recently enough are added
+ * to the cache.
+ *
+ * @param content the content that was read
+ * @param fh open handle of the file of the content
+ * @param fsize size of the content
+ * @param offset offset of the first byte that was read
+ * @param size number of bytes that were read (all blocks they
+ *        touch must be available in the file)
+ */
+void
+GNUNET_FUSE_hot_cache_put (const struct GNUNET_FUSE_Content *content,
+			   struct GNUNET_DISK_FileHandle *fh,
+			   uint64_t fsize,
+			   uint64_t offset,
+			   size_t size)
+{
+  struct GNUNET_HashCode key;
+  struct Shard *shard;
+  struct HotBlock *hb;
+  struct HotBlock *victims_head;
+  struct HotBlock *victims_tail;
+  uint64_t block;
+  uint64_t last;
+  size_t len;
+
+  if ( (NULL == shards) ||
+       (0 == size) )
+    return;
+  last = (offset + size - 1) / GNUNET_FUSE_BLOCK_SIZE;
+  for (block = offset / GNUNET_FUSE_BLOCK_SIZE; block <= last; block++)
+  {
+    len = (size_t) GNUNET_MIN (GNUNET_FUSE_BLOCK_SIZE,
+			       fsize - block * GNUNET_FUSE_BLOCK_SIZE);
+    if ( (len > max_shard_size) &&
+	 (0 == max_compressed_shard_size) )
+      return;
+    shard = get_key (&content->key, block, &key);
+    GNUNET_mutex_lock (shard->lock);
+    if ( (NULL != find_block (shard, &key, &content->key, block)) ||
+	 (GNUNET_YES != admit (shard, &key)) )
+    {
+      GNUNET_mutex_unlock (shard->lock);
+      continue;
+    }
+    GNUNET_mutex_unlock (shard->lock);
+    /* read the whole block, the reader may only have wanted a part */
+    hb = GNUNET_new (struct HotBlock);
+    hb->key = key;
+    hb->content = content->key;
+    hb->block = block;
+    hb->size = len;
+    hb->data = GNUNET_malloc (len);
+    if ( (block * GNUNET_FUSE_BLOCK_SIZE !=
+	  GNUNET_DISK_file_seek (fh,
+				 block * GNUNET_FUSE_BLOCK_SIZE,
+				 GNUNET_DISK_SEEK_SET)) ||
+	 (len != GNUNET_DISK_file_read (fh, hb->data, len)) )
+    {
+      free_block (hb);
+      return;
+    }
+    victims_head = NULL;
+    victims_tail = NULL;
+    GNUNET_mutex_lock (shard->lock);
+    if (NULL != find_block (shard, &key, &content->key, block))
+    {
+      /* another reader was faster */
+      GNUNET_mutex_unlock (shard->lock);
+      free_block (hb);
+      continue;
+    }
+    if (len <= max_shard_size)
+    {
+      make_room (shard, len, &victims_head, &victims_tail);
+      attach_block (shard, hb);
+    }
+    else
+    {
+      /* no working set, keep it compressed right away */
+      GNUNET_CONTAINER_DLL_insert_tail (victims_head,
+					victims_tail,
+					hb);
+    }
+    GNUNET_mutex_unlock (shard->lock);
+    compress_blocks (shard, victims_head);
+    GNUNET_FUSE_stats_update (gettext_noop ("# blocks added to the hot cache"),
+			      1);
+  }
+}
+
+
+/**
+ * Destroy the hot block cache.
+ */
+void
+GNUNET_FUSE_hot_cache_done ()
+{
+  struct HotBlock *hb;
+  unsigned int i;
+  uint64_t hits;
+
+  if (NULL == shards)
+    return;
+  hits = 0;
+  for (i = 0; i < NUM_SHARDS; i++)
+  {
+    hits += shards[i].hits;
+    while (NULL != (hb = shards[i].lru_head))
+    {
+      detach_block (&shards[i], hb);
+      free_block (hb);
+    }
+    while (NULL != (hb = shards[i].compressed_head))
+    {
+      detach_block (&shards[i], hb);
+      free_block (hb);
+    }
+    GNUNET_CONTAINER_multihashmap_destroy (shards[i].map);
+    GNUNET_mutex_destroy (shards[i].lock);
+  }
+  GNUNET_FUSE_stats_update (gettext_noop ("# hot cache hits"),
+			    hits);
+  GNUNET_free (shards);
+  shards = NULL;
+}
+
+/* end of gfs_hot_cache.c */
@@ -0,0 +1,85 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_hot_cache.h
+ * @brief blocks that are read often, kept in memory
+ */
+#ifndef GFS_HOT_CACHE_H
+#define GFS_HOT_CACHE_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Setup the hot block cache.
+ *
+ * @param max_bytes maximum number of bytes of blocks to keep as
+ *        they are
+ * @param max_compressed_bytes maximum number of bytes of compressed
+ *        data to keep, 0 to not compress blocks
+ */
+void
+GNUNET_FUSE_hot_cache_init (unsigned long long max_bytes,
+                            unsigned long long max_compressed_bytes);
+
+
+/**
+ * Read data from the hot block cache.
+ *
+ * @param content the content to read from
+ * @param offset offset of the first byte to read
+ * @param size number of bytes to read (must be within the content)
+ * @param buf where to store the data
+ * @return GNUNET_YES if all of the data was in the cache (and
+ *         is now in 'buf'), GNUNET_NO if not
+ */
+int
+GNUNET_FUSE_hot_cache_get (const struct GNUNET_FUSE_Content *content,
+                           uint64_t offset,
+                           size_t size,
+                           void *buf);
+
+
+/**
+ * Tell the hot block cache that data was read from the file of a
+ * content.  Blocks that were read before recently enough are added
+ * to the cache.
+ *
+ * @param content the content that was read
+ * @param fh open handle of the file of the content
+ * @param fsize size of the content
+ * @param offset offset of the first byte that was read
+ * @param size number of bytes that were read (all blocks they
+ *        touch must be available in the file)
+ */
+void
+GNUNET_FUSE_hot_cache_put (const struct GNUNET_FUSE_Content *content,
+                           struct GNUNET_DISK_FileHandle *fh,
+                           uint64_t fsize,
+                           uint64_t offset,
+                           size_t size);
+
+
+/**
+ * Destroy the hot block cache.
+ */
+void
+GNUNET_FUSE_hot_cache_done (void);
+
+#endif
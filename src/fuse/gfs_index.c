@@ -0,0 +1,852 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_index.c
+ * @brief compact, mmap-able index of the entries of a directory
+ *
+ * The index of a directory is built once from the serialized GNUnet
+ * directory and stored in the persistent cache under the hash of the
+ * directory's URI.  Its layout is a header, followed by an array of
+ * fixed-size entries sorted by name, followed by a table of
+ * 0-terminated strings (names and URIs).  All numbers are in network
+ * byte order, so the index is used directly from the mapped file:
+ * lookups are a binary search over the entries, and listing the
+ * directory walks the array without any allocation.  Subdirectories
+ * have their own index, keyed by their own URI.
+ *
+ * The metadata of the entries (which may include thumbnails) is not
+ * copied into the index: each entry only records where it is in the
+ * serialized directory, and its metadata is decoded from there when
+ * it is needed (see GNUNET_FUSE_path_info_get_meta).
+ */
+#include "gfs_index.h"
+#include "gfs_cache.h"
+
+/**
+ * Magic number at the beginning of an index ("GFSI").
+ */
+#define INDEX_MAGIC 0x47465349
+
+/**
+ * Version of the index format.
+ */
+#define INDEX_VERSION 2
+
+/**
+ * Suffix of index files in the persistent cache.
+ */
+#define INDEX_SUFFIX "idx"
+
+/**
+ * Flag for entries that are directories.
+ */
+#define INDEX_FLAG_DIRECTORY 1
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of an index.
+ */
+struct IndexHeader
+{
+  /**
+   * Always INDEX_MAGIC (in NBO).
+   */
+  uint32_t magic GNUNET_PACKED;
+
+  /**
+   * Always INDEX_VERSION (in NBO).
+   */
+  uint32_t version GNUNET_PACKED;
+
+  /**
+   * Number of entries following the header (in NBO).
+   */
+  uint32_t entry_count GNUNET_PACKED;
+
+  /**
+   * Number of bytes in the string table following the entries (in NBO).
+   */
+  uint32_t strings_size GNUNET_PACKED;
+};
+
+
+/**
+ * Entry in an index.
+ */
+struct IndexEntry
+{
+  /**
+   * Size of the file in bytes (in NBO).
+   */
+  uint64_t size GNUNET_PACKED;
+
+  /**
+   * Offset of the name in the string table (in NBO).
+   */
+  uint32_t name_offset GNUNET_PACKED;
+
+  /**
+   * Offset of the URI in the string table (in NBO).
+   */
+  uint32_t uri_offset GNUNET_PACKED;
+
+  /**
+   * INDEX_FLAG_* values (in NBO).
+   */
+  uint32_t flags GNUNET_PACKED;
+
+  /**
+   * Number of bytes of the entry in the serialized directory, 0 if
+   * unknown (in NBO).
+   */
+  uint32_t dir_size GNUNET_PACKED;
+
+  /**
+   * Offset of the entry in the serialized directory (in NBO).
+   */
+  uint64_t dir_offset GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Index of the entries of a directory, sorted by name.
+ */
+struct GNUNET_FUSE_DirectoryIndex
+{
+
+  /**
+   * Entries of the index.
+   */
+  const struct IndexEntry *entries;
+
+  /**
+   * String table of the index.
+   */
+  const char *strings;
+
+  /**
+   * Number of entries.
+   */
+  unsigned int entry_count;
+
+  /**
+   * Handle of the index file, NULL if the index is in memory.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Mapping of the index file, NULL if the index is in memory.
+   */
+  struct GNUNET_DISK_MapHandle *mh;
+
+  /**
+   * Buffer with the index, NULL if the index is mapped.
+   */
+  void *buf;
+
+};
+
+
+/**
+ * Check that a buffer contains a well-formed index and setup
+ * 'idx' to use it.
+ *
+ * @param idx index to setup
+ * @param size number of bytes in 'data'
+ * @param data the index
+ * @return GNUNET_OK if the index is well-formed
+ */
+static int
+setup_index (struct GNUNET_FUSE_DirectoryIndex *idx,
+	     size_t size,
+	     const void *data)
+{
+  const struct IndexHeader *hdr = data;
+  uint32_t count;
+  uint32_t strings_size;
+  const char *prev;
+  const char *name;
+  unsigned int i;
+
+  if (size < sizeof (struct IndexHeader))
+    return GNUNET_SYSERR;
+  if ( (INDEX_MAGIC != ntohl (hdr->magic)) ||
+       (INDEX_VERSION != ntohl (hdr->version)) )
+    return GNUNET_SYSERR;
+  count = ntohl (hdr->entry_count);
+  strings_size = ntohl (hdr->strings_size);
+  if ( (count > (size - sizeof (struct IndexHeader)) / sizeof (struct IndexEntry)) ||
+       (size != sizeof (struct IndexHeader)
+	+ count * sizeof (struct IndexEntry)
+	+ (size_t) strings_size) )
+    return GNUNET_SYSERR;
+  idx->entry_count = count;
+  idx->entries = (const struct IndexEntry *) &hdr[1];
+  idx->strings = (const char *) &idx->entries[count];
+  if ( (0 != strings_size) &&
+       ('\0' != idx->strings[strings_size - 1]) )
+    return GNUNET_SYSERR;
+  prev = NULL;
+  for (i = 0; i < count; i++)
+  {
+    if ( (ntohl (idx->entries[i].name_offset) >= strings_size) ||
+	 (ntohl (idx->entries[i].uri_offset) >= strings_size) )
+      return GNUNET_SYSERR;
+    name = GNUNET_FUSE_index_get_name (idx, i);
+    if ( (NULL != prev) &&
+	 (0 < strcmp (prev, name)) )
+      return GNUNET_SYSERR; /* not sorted */
+    prev = name;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Load the index of a directory from the persistent cache.
+ *
+ * @param uri URI of the directory
+ * @return NULL if the index is not in the cache (or invalid)
+ */
+struct GNUNET_FUSE_DirectoryIndex *
+GNUNET_FUSE_index_load (const struct GNUNET_FS_Uri *uri)
+{
+  struct GNUNET_FUSE_DirectoryIndex *idx;
+  char *fn;
+  uint64_t size;
+  void *data;
+
+  if (NULL == (fn = GNUNET_FUSE_cache_get_filename (uri, INDEX_SUFFIX)))
+    return NULL;
+  if ( (GNUNET_YES != GNUNET_DISK_file_test (fn)) ||
+       (GNUNET_OK != GNUNET_DISK_file_size (fn, &size, GNUNET_YES, GNUNET_YES)) ||
+       (size != (size_t) size) )
+  {
+    GNUNET_free (fn);
+    return NULL;
+  }
+  idx = GNUNET_new (struct GNUNET_FUSE_DirectoryIndex);
+  idx->fh = GNUNET_DISK_file_open (fn,
+				   GNUNET_DISK_OPEN_READ,
+				   GNUNET_DISK_PERM_NONE);
+  if (NULL == idx->fh)
+  {
+    GNUNET_free (idx);
+    GNUNET_free (fn);
+    return NULL;
+  }
+  data = GNUNET_DISK_file_map (idx->fh,
+			       &idx->mh,
+			       GNUNET_DISK_MAP_TYPE_READ,
+			       (size_t) size);
+  if ( (NULL == data) ||
+       (GNUNET_OK != setup_index (idx, (size_t) size, data)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("Ignoring invalid directory index `%s'\n"),
+		fn);
+    GNUNET_free (fn);
+    GNUNET_FUSE_index_destroy (idx);
+    return NULL;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Loaded directory index `%s' with %u entries\n",
+	      fn,
+	      idx->entry_count);
+  GNUNET_free (fn);
+  return idx;
+}
+
+
+/**
+ * Entry of a directory while we build the index.
+ */
+struct BuildEntry
+{
+  /**
+   * Name of the entry.
+   */
+  char *name;
+
+  /**
+   * URI of the entry (as a string).
+   */
+  char *uri;
+
+  /**
+   * Size of the entry.
+   */
+  uint64_t size;
+
+  /**
+   * INDEX_FLAG_* values.
+   */
+  uint32_t flags;
+
+  /**
+   * Number of bytes of the entry in the serialized directory, 0 if
+   * unknown.
+   */
+  uint32_t dir_size;
+
+  /**
+   * Offset of the entry in the serialized directory.
+   */
+  uint64_t dir_offset;
+};
+
+
+/**
+ * Closure for #process_directory_entry().
+ */
+struct BuildContext
+{
+  /**
+   * Entries found so far.
+   */
+  struct BuildEntry *entries;
+
+  /**
+   * Number of entries used in 'entries'.
+   */
+  unsigned int entries_length;
+
+  /**
+   * Number of entries allocated in 'entries'.
+   */
+  unsigned int entries_size;
+
+  /**
+   * Total size of the strings of all entries.
+   */
+  size_t strings_size;
+
+  /**
+   * Serialized directory, NULL for a virtual directory.
+   */
+  const char *data;
+
+  /**
+   * Number of bytes in 'data'.
+   */
+  size_t size;
+
+  /**
+   * Offset in 'data' after the last entry that was found.
+   */
+  size_t pos;
+};
+
+
+/**
+ * Find where an entry is in the serialized directory, so that its
+ * metadata can be decoded later.  Entries are reported in the order
+ * in which they are serialized, each as its URI (0-terminated),
+ * followed by the size of its metadata (32 bit, NBO) and the
+ * metadata.
+ *
+ * @param bc build context with the serialized directory
+ * @param be the entry (with its URI)
+ */
+static void
+locate_entry (struct BuildContext *bc,
+	      struct BuildEntry *be)
+{
+  const char *start;
+  size_t ulen;
+  size_t off;
+  uint32_t msize;
+
+  if (NULL == bc->data)
+    return;
+  ulen = strlen (be->uri) + 1;
+  start = memmem (&bc->data[bc->pos],
+		  bc->size - bc->pos,
+		  be->uri,
+		  ulen);
+  if (NULL == start)
+    return;
+  off = start - bc->data;
+  if (sizeof (uint32_t) > bc->size - off - ulen)
+    return;
+  memcpy (&msize, &bc->data[off + ulen], sizeof (uint32_t));
+  msize = ntohl (msize);
+  if ( (msize > bc->size - off - ulen - sizeof (uint32_t)) ||
+       (msize > UINT32_MAX - ulen - sizeof (uint32_t)) )
+    return;
+  be->dir_offset = off;
+  be->dir_size = (uint32_t) (ulen + sizeof (uint32_t) + msize);
+  bc->pos = off + be->dir_size;
+}
+
+
+/**
+ * Function used to process entries in a directory; adds the
+ * respective entry to the index being built.
+ *
+ * @param cls closure with the 'struct BuildContext'
+ * @param filename name of the file in the directory
+ * @param uri URI of the file
+ * @param metadata metadata for the file; metadata for
+ *        the directory if everything else is NULL/zero
+ * @param length length of the available data for the file
+ *           (of type size_t since data must certainly fit
+ *            into memory; if files are larger than size_t
+ *            permits, then they will certainly not be
+ *            embedded with the directory itself).
+ * @param data data available for the file (length bytes)
+ */
+static void
+process_directory_entry (void *cls,
+			 const char *filename,
+			 const struct GNUNET_FS_Uri *
+			 uri,
+			 const struct
+			 GNUNET_CONTAINER_MetaData *
+			 meta, size_t length,
+			 const void *data)
+{
+  struct BuildContext *bc = cls;
+  struct BuildEntry *be;
+  size_t len;
+  int is_directory;
+
+  if (NULL == filename)
+    return; /* info about the directory itself */
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Adding file `%s' to directory index\n",
+	      filename);
+  if (bc->entries_length == bc->entries_size)
+    GNUNET_array_grow (bc->entries,
+		       bc->entries_size,
+		       GNUNET_MAX (16, 2 * bc->entries_size));
+  be = &bc->entries[bc->entries_length++];
+  be->name = GNUNET_strdup (filename);
+  len = strlen (be->name);
+  if ( (len > 1) &&
+       ('/' == be->name[len - 1]) )
+    be->name[--len] = '\0';
+  be->uri = GNUNET_FS_uri_to_string (uri);
+  be->dir_size = 0;
+  be->dir_offset = 0;
+  locate_entry (bc, be);
+  is_directory = GNUNET_FS_meta_data_test_for_directory (meta);
+  be->flags = (GNUNET_YES == is_directory) ? INDEX_FLAG_DIRECTORY : 0; /* if in doubt, say no */
+  be->size = GNUNET_FS_uri_chk_get_file_size (uri);
+  bc->strings_size += len + 1 + strlen (be->uri) + 1;
+}
+
+
+/**
+ * Compare two entries by name (for qsort).
+ *
+ * @param a first 'struct BuildEntry'
+ * @param b second 'struct BuildEntry'
+ * @return result of strcmp on the names
+ */
+static int
+compare_entries (const void *a,
+		 const void *b)
+{
+  const struct BuildEntry *ea = a;
+  const struct BuildEntry *eb = b;
+
+  return strcmp (ea->name, eb->name);
+}
+
+
+/**
+ * Write an index to the persistent cache.
+ *
+ * @param uri URI of the directory
+ * @param size number of bytes in 'buf'
+ * @param buf the index
+ * @return GNUNET_OK on success
+ */
+static int
+store_index (const struct GNUNET_FS_Uri *uri,
+	     size_t size,
+	     const void *buf)
+{
+  char *tmp;
+  char *fn;
+
+  if (NULL == (fn = GNUNET_FUSE_cache_get_filename (uri, INDEX_SUFFIX)))
+    return GNUNET_NO;
+  GNUNET_free (fn);
+  tmp = GNUNET_FUSE_cache_mktemp ();
+  if (size != GNUNET_DISK_fn_write (tmp,
+				    buf,
+				    size,
+				    GNUNET_DISK_PERM_USER_READ | GNUNET_DISK_PERM_USER_WRITE))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "write",
+			      tmp);
+    GNUNET_break (0 == unlink (tmp));
+    GNUNET_free (tmp);
+    return GNUNET_SYSERR;
+  }
+  fn = GNUNET_FUSE_cache_publish (uri, INDEX_SUFFIX, tmp);
+  if (NULL == fn)
+  {
+    GNUNET_break (0 == unlink (tmp));
+    GNUNET_free (tmp);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (tmp);
+  GNUNET_free (fn);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Build an index from the entries collected in a build context and
+ * store it in the persistent cache (if we have one and if the index
+ * belongs to a URI).  Frees the entries of the build context.
+ *
+ * @param bc entries of the directory
+ * @param uri URI of the directory, NULL to keep the index in memory
+ * @return the index
+ */
+static struct GNUNET_FUSE_DirectoryIndex *
+build_index (struct BuildContext *bc,
+	     const struct GNUNET_FS_Uri *uri)
+{
+  struct GNUNET_FUSE_DirectoryIndex *idx;
+  struct IndexHeader *hdr;
+  struct IndexEntry *ie;
+  char *strings;
+  size_t isize;
+  size_t off;
+  size_t len;
+  unsigned int i;
+
+  qsort (bc->entries,
+	 bc->entries_length,
+	 sizeof (struct BuildEntry),
+	 &compare_entries);
+  isize = sizeof (struct IndexHeader)
+    + bc->entries_length * sizeof (struct IndexEntry)
+    + bc->strings_size;
+  hdr = GNUNET_malloc (isize);
+  hdr->magic = htonl (INDEX_MAGIC);
+  hdr->version = htonl (INDEX_VERSION);
+  hdr->entry_count = htonl (bc->entries_length);
+  hdr->strings_size = htonl ((uint32_t) bc->strings_size);
+  ie = (struct IndexEntry *) &hdr[1];
+  strings = (char *) &ie[bc->entries_length];
+  off = 0;
+  for (i = 0; i < bc->entries_length; i++)
+  {
+    ie[i].size = GNUNET_htonll (bc->entries[i].size);
+    ie[i].flags = htonl (bc->entries[i].flags);
+    ie[i].dir_size = htonl (bc->entries[i].dir_size);
+    ie[i].dir_offset = GNUNET_htonll (bc->entries[i].dir_offset);
+    len = strlen (bc->entries[i].name) + 1;
+    ie[i].name_offset = htonl ((uint32_t) off);
+    memcpy (&strings[off], bc->entries[i].name, len);
+    off += len;
+    len = strlen (bc->entries[i].uri) + 1;
+    ie[i].uri_offset = htonl ((uint32_t) off);
+    memcpy (&strings[off], bc->entries[i].uri, len);
+    off += len;
+  }
+  GNUNET_assert (off == bc->strings_size);
+  if ( (NULL == uri) ||
+       (GNUNET_OK != store_index (uri, isize, hdr)) ||
+       (NULL == (idx = GNUNET_FUSE_index_load (uri))) )
+  {
+    /* no persistent cache, keep the index in memory */
+    idx = GNUNET_new (struct GNUNET_FUSE_DirectoryIndex);
+    idx->buf = hdr;
+    GNUNET_assert (GNUNET_OK == setup_index (idx, isize, hdr));
+  }
+  else
+  {
+    GNUNET_free (hdr);
+  }
+  return idx;
+}
+
+
+/**
+ * Free the entries of a build context.
+ *
+ * @param bc build context to clean up
+ */
+static void
+free_entries (struct BuildContext *bc)
+{
+  unsigned int i;
+
+  for (i = 0; i < bc->entries_length; i++)
+  {
+    GNUNET_free (bc->entries[i].name);
+    GNUNET_free (bc->entries[i].uri);
+  }
+  GNUNET_array_grow (bc->entries,
+		     bc->entries_size,
+		     0);
+}
+
+
+/**
+ * Build the index of a directory from the serialized directory and
+ * store it in the persistent cache (if we have one).
+ *
+ * @param uri URI of the directory
+ * @param size number of bytes in 'data'
+ * @param data serialized directory
+ * @return NULL if 'data' is not a directory
+ */
+struct GNUNET_FUSE_DirectoryIndex *
+GNUNET_FUSE_index_create (const struct GNUNET_FS_Uri *uri,
+			  size_t size,
+			  const void *data)
+{
+  struct BuildContext bc;
+  struct GNUNET_FUSE_DirectoryIndex *idx;
+  int ret;
+
+  memset (&bc, 0, sizeof (bc));
+  bc.data = data;
+  bc.size = size;
+  ret = GNUNET_FS_directory_list_contents (size,
+					   data, 0LL,
+					   &process_directory_entry,
+					   &bc);
+  if ( (GNUNET_OK == ret) &&
+       (bc.strings_size > UINT32_MAX) )
+    ret = GNUNET_SYSERR;
+  idx = NULL;
+  if (GNUNET_OK == ret)
+    idx = build_index (&bc, uri);
+  free_entries (&bc);
+  return idx;
+}
+
+
+/**
+ * Build the index of a virtual directory (that was not published)
+ * from a list of directories.  The index is only kept in memory.
+ *
+ * @param num number of entries
+ * @param names names of the entries
+ * @param uris URIs of the entries (all directories)
+ * @return the index
+ */
+struct GNUNET_FUSE_DirectoryIndex *
+GNUNET_FUSE_index_create_virtual (unsigned int num,
+				  const char *const *names,
+				  const struct GNUNET_FS_Uri *const *uris)
+{
+  struct BuildContext bc;
+  struct GNUNET_FUSE_DirectoryIndex *idx;
+  struct BuildEntry *be;
+  unsigned int i;
+
+  memset (&bc, 0, sizeof (bc));
+  GNUNET_array_grow (bc.entries,
+		     bc.entries_size,
+		     num);
+  for (i = 0; i < num; i++)
+  {
+    be = &bc.entries[bc.entries_length++];
+    be->name = GNUNET_strdup (names[i]);
+    be->uri = GNUNET_FS_uri_to_string (uris[i]);
+    be->flags = INDEX_FLAG_DIRECTORY;
+    be->size = GNUNET_FS_uri_chk_get_file_size (uris[i]);
+    bc.strings_size += strlen (be->name) + 1 + strlen (be->uri) + 1;
+  }
+  idx = build_index (&bc, NULL);
+  free_entries (&bc);
+  return idx;
+}
+
+
+/**
+ * Free resources associated with an index.
+ *
+ * @param idx index to destroy
+ */
+void
+GNUNET_FUSE_index_destroy (struct GNUNET_FUSE_DirectoryIndex *idx)
+{
+  if (NULL != idx->mh)
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_unmap (idx->mh));
+  if (NULL != idx->fh)
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (idx->fh));
+  GNUNET_free_non_null (idx->buf);
+  GNUNET_free (idx);
+}
+
+
+/**
+ * Check if an index is mapped from the persistent cache (and can
+ * thus be loaded again cheaply after it was destroyed).
+ *
+ * @param idx index to inspect
+ * @return GNUNET_YES if the index is in the persistent cache
+ */
+int
+GNUNET_FUSE_index_is_cached (const struct GNUNET_FUSE_DirectoryIndex *idx)
+{
+  return (NULL != idx->fh) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Get the number of entries in an index.
+ *
+ * @param idx index to inspect
+ * @return number of entries
+ */
+unsigned int
+GNUNET_FUSE_index_get_size (const struct GNUNET_FUSE_DirectoryIndex *idx)
+{
+  return idx->entry_count;
+}
+
+
+/**
+ * Find an entry in the index by name.
+ *
+ * @param idx index to search
+ * @param name name of the entry
+ * @param pos set to the position of the entry
+ * @return GNUNET_YES if found, GNUNET_NO if not
+ */
+int
+GNUNET_FUSE_index_lookup (const struct GNUNET_FUSE_DirectoryIndex *idx,
+			  const char *name,
+			  unsigned int *pos)
+{
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+  int cmp;
+
+  lo = 0;
+  hi = idx->entry_count;
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    cmp = strcmp (name,
+		  GNUNET_FUSE_index_get_name (idx, mid));
+    if (0 == cmp)
+    {
+      *pos = mid;
+      return GNUNET_YES;
+    }
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return GNUNET_NO;
+}
+
+
+/**
+ * Get the name of an entry.
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return name of the entry (valid as long as 'idx')
+ */
+const char *
+GNUNET_FUSE_index_get_name (const struct GNUNET_FUSE_DirectoryIndex *idx,
+			    unsigned int pos)
+{
+  return &idx->strings[ntohl (idx->entries[pos].name_offset)];
+}
+
+
+/**
+ * Get the URI of an entry (as a string).
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return URI of the entry (valid as long as 'idx')
+ */
+const char *
+GNUNET_FUSE_index_get_uri (const struct GNUNET_FUSE_DirectoryIndex *idx,
+			   unsigned int pos)
+{
+  return &idx->strings[ntohl (idx->entries[pos].uri_offset)];
+}
+
+
+/**
+ * Get the size of an entry.
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return size of the file (or directory) in bytes
+ */
+uint64_t
+GNUNET_FUSE_index_get_file_size (const struct GNUNET_FUSE_DirectoryIndex *idx,
+				 unsigned int pos)
+{
+  return GNUNET_ntohll (idx->entries[pos].size);
+}
+
+
+/**
+ * Get where an entry is in the serialized directory the index was
+ * built from (to decode the metadata of the entry).
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @param offset set to the offset of the entry in the directory
+ * @return number of bytes of the entry in the directory, 0 if unknown
+ */
+uint32_t
+GNUNET_FUSE_index_get_location (const struct GNUNET_FUSE_DirectoryIndex *idx,
+				unsigned int pos,
+				uint64_t *offset)
+{
+  *offset = GNUNET_ntohll (idx->entries[pos].dir_offset);
+  return ntohl (idx->entries[pos].dir_size);
+}
+
+
+/**
+ * Check if an entry is a directory.
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return GNUNET_YES if the entry is a directory
+ */
+int
+GNUNET_FUSE_index_is_directory (const struct GNUNET_FUSE_DirectoryIndex *idx,
+				unsigned int pos)
+{
+  if (0 != (ntohl (idx->entries[pos].flags) & INDEX_FLAG_DIRECTORY))
+    return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+/* end of gfs_index.c */
@@ -0,0 +1,181 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_index.h
+ * @brief compact, mmap-able index of the entries of a directory
+ */
+#ifndef GFS_INDEX_H
+#define GFS_INDEX_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Index of the entries of a directory, sorted by name.
+ */
+struct GNUNET_FUSE_DirectoryIndex;
+
+
+/**
+ * Load the index of a directory from the persistent cache.
+ *
+ * @param uri URI of the directory
+ * @return NULL if the index is not in the cache (or invalid)
+ */
+struct GNUNET_FUSE_DirectoryIndex *
+GNUNET_FUSE_index_load (const struct GNUNET_FS_Uri *uri);
+
+
+/**
+ * Build the index of a directory from the serialized directory and
+ * store it in the persistent cache (if we have one).
+ *
+ * @param uri URI of the directory
+ * @param size number of bytes in 'data'
+ * @param data serialized directory
+ * @return NULL if 'data' is not a directory
+ */
+struct GNUNET_FUSE_DirectoryIndex *
+GNUNET_FUSE_index_create (const struct GNUNET_FS_Uri *uri,
+                          size_t size,
+                          const void *data);
+
+
+/**
+ * Build the index of a virtual directory (that was not published)
+ * from a list of directories.  The index is only kept in memory.
+ *
+ * @param num number of entries
+ * @param names names of the entries
+ * @param uris URIs of the entries (all directories)
+ * @return the index
+ */
+struct GNUNET_FUSE_DirectoryIndex *
+GNUNET_FUSE_index_create_virtual (unsigned int num,
+                                  const char *const *names,
+                                  const struct GNUNET_FS_Uri *const *uris);
+
+
+/**
+ * Free resources associated with an index.
+ *
+ * @param idx index to destroy
+ */
+void
+GNUNET_FUSE_index_destroy (struct GNUNET_FUSE_DirectoryIndex *idx);
+
+
+/**
+ * Check if an index is mapped from the persistent cache (and can
+ * thus be loaded again cheaply after it was destroyed).
+ *
+ * @param idx index to inspect
+ * @return GNUNET_YES if the index is in the persistent cache
+ */
+int
+GNUNET_FUSE_index_is_cached (const struct GNUNET_FUSE_DirectoryIndex *idx);
+
+
+/**
+ * Get the number of entries in an index.
+ *
+ * @param idx index to inspect
+ * @return number of entries
+ */
+unsigned int
+GNUNET_FUSE_index_get_size (const struct GNUNET_FUSE_DirectoryIndex *idx);
+
+
+/**
+ * Find an entry in the index by name.
+ *
+ * @param idx index to search
+ * @param name name of the entry
+ * @param pos set to the position of the entry
+ * @return GNUNET_YES if found, GNUNET_NO if not
+ */
+int
+GNUNET_FUSE_index_lookup (const struct GNUNET_FUSE_DirectoryIndex *idx,
+                          const char *name,
+                          unsigned int *pos);
+
+
+/**
+ * Get the name of an entry.
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return name of the entry (valid as long as 'idx')
+ */
+const char *
+GNUNET_FUSE_index_get_name (const struct GNUNET_FUSE_DirectoryIndex *idx,
+                            unsigned int pos);
+
+
+/**
+ * Get the URI of an entry (as a string).
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return URI of the entry (valid as long as 'idx')
+ */
+const char *
+GNUNET_FUSE_index_get_uri (const struct GNUNET_FUSE_DirectoryIndex *idx,
+                           unsigned int pos);
+
+
+/**
+ * Get the size of an entry.
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return size of the file (or directory) in bytes
+ */
+uint64_t
+GNUNET_FUSE_index_get_file_size (const struct GNUNET_FUSE_DirectoryIndex *idx,
+                                 unsigned int pos);
+
+
+/**
+ * Get where an entry is in the serialized directory the index was
+ * built from (to decode the metadata of the entry).
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @param offset set to the offset of the entry in the directory
+ * @return number of bytes of the entry in the directory, 0 if unknown
+ */
+uint32_t
+GNUNET_FUSE_index_get_location (const struct GNUNET_FUSE_DirectoryIndex *idx,
+                                unsigned int pos,
+                                uint64_t *offset);
+
+
+/**
+ * Check if an entry is a directory.
+ *
+ * @param idx index to inspect
+ * @param pos position of the entry
+ * @return GNUNET_YES if the entry is a directory
+ */
+int
+GNUNET_FUSE_index_is_directory (const struct GNUNET_FUSE_DirectoryIndex *idx,
+                                unsigned int pos);
+
+#endif
@@ -0,0 +1,394 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_prefetch.c
+ * @brief background loading of subdirectories
+ *
+ * Once a directory was accessed, a single crawler thread loads its
+ * subdirectories breadth-first, up to a maximum depth and a maximum
+ * number of bytes per accessed directory, so that changing into them
+ * later does not block on the network.  The crawler waits while
+ * foreground downloads are pending and downloads with background
+ * priority (see gfs_scheduler.c).
+ */
+#include "gfs_prefetch.h"
+#include "gfs_scheduler.h"
+#include <pthread.h>
+
+
+/**
+ * Crawl started from one accessed directory.
+ */
+struct Crawl
+{
+
+  /**
+   * Number of bytes of directories we may still load.
+   */
+  uint64_t remaining;
+
+  /**
+   * Number of queue entries of this crawl.
+   */
+  unsigned int rc;
+
+};
+
+
+/**
+ * Directory waiting to be processed by the crawler.
+ */
+struct QueueEntry
+{
+
+  /**
+   * This is a DLL.
+   */
+  struct QueueEntry *next;
+
+  /**
+   * This is a DLL.
+   */
+  struct QueueEntry *prev;
+
+  /**
+   * The directory (we hold a reference).
+   */
+  struct GNUNET_FUSE_PathInfo *pi;
+
+  /**
+   * Crawl this entry belongs to.
+   */
+  struct Crawl *crawl;
+
+  /**
+   * Distance of the directory from the accessed directory.
+   */
+  unsigned int depth;
+
+};
+
+
+/**
+ * Head of the queue.
+ */
+static struct QueueEntry *queue_head;
+
+/**
+ * Tail of the queue.
+ */
+static struct QueueEntry *queue_tail;
+
+/**
+ * Lock for the queue and the reference counters of the crawls.
+ */
+static struct GNUNET_Mutex *queue_lock;
+
+/**
+ * Signalled when the queue is extended or when we shut down.
+ */
+static struct GNUNET_Cond *queue_cond;
+
+/**
+ * The crawler thread.
+ */
+static pthread_t crawler;
+
+/**
+ * GNUNET_YES if 'crawler' was started.
+ */
+static int crawler_started;
+
+/**
+ * GNUNET_YES once we are shutting down.
+ */
+static int in_shutdown;
+
+/**
+ * How many levels of subdirectories to load.
+ */
+static unsigned int max_depth;
+
+/**
+ * Number of bytes to load per crawl.
+ */
+static uint64_t crawl_budget;
+
+
+/**
+ * Add a directory to the queue.  Caller must hold the queue lock.
+ *
+ * @param pi the directory, reference is taken over by the queue
+ * @param crawl crawl the directory belongs to
+ * @param depth distance of the directory from the accessed directory
+ */
+static void
+enqueue (struct GNUNET_FUSE_PathInfo *pi,
+	 struct Crawl *crawl,
+	 unsigned int depth)
+{
+  struct QueueEntry *qe;
+
+  qe = GNUNET_new (struct QueueEntry);
+  qe->pi = pi;
+  qe->crawl = crawl;
+  qe->depth = depth;
+  crawl->rc++;
+  GNUNET_CONTAINER_DLL_insert_tail (queue_head,
+				    queue_tail,
+				    qe);
+  GNUNET_cond_signal (queue_cond);
+}
+
+
+/**
+ * Release a queue entry.  Caller must hold the queue lock.
+ *
+ * @param qe entry to release
+ */
+static void
+release (struct QueueEntry *qe)
+{
+  if (0 == --qe->crawl->rc)
+    GNUNET_free (qe->crawl);
+  GNUNET_free (qe);
+}
+
+
+/**
+ * Load a directory from the queue (if needed) and queue its
+ * subdirectories (if they are not too deep).
+ *
+ * @param qe entry to process
+ */
+static void
+process (struct QueueEntry *qe)
+{
+  struct GNUNET_FUSE_PathInfo *pi = qe->pi;
+  struct GNUNET_FUSE_PathInfo *child;
+  struct stat stbuf;
+  uint64_t size;
+  unsigned int i;
+  int eno;
+
+  /* do not compete with foreground operations for the network
+     while we wait for our turn */
+  GNUNET_FUSE_scheduler_wait_idle ();
+  GNUNET_mutex_lock (pi->lock);
+  if ( (GNUNET_YES == pi->delete_later) ||
+       (GNUNET_YES == in_shutdown) )
+  {
+    GNUNET_mutex_unlock (pi->lock);
+    return;
+  }
+  if (NULL == pi->index)
+  {
+    size = GNUNET_FS_uri_chk_get_file_size (pi->uri);
+    if (size > qe->crawl->remaining)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Not prefetching directory `%s', budget exhausted\n",
+		  pi->filename);
+      GNUNET_mutex_unlock (pi->lock);
+      return;
+    }
+    qe->crawl->remaining -= size;
+    GNUNET_mutex_unlock (pi->lock);
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Prefetching directory `%s'\n",
+		pi->filename);
+    /* foreground operations on the directory must not wait for us
+       on its lock, they would never get to raise our priority */
+    if (GNUNET_OK != GNUNET_FUSE_load_directory_unlocked (pi,
+							  GNUNET_FUSE_DOWNLOAD_BACKGROUND,
+							  &eno))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Failed to prefetch directory `%s': %s\n",
+		  pi->filename,
+		  strerror (eno));
+      return;
+    }
+    GNUNET_mutex_lock (pi->lock);
+    /* the entry may have been removed or trimmed meanwhile */
+    if ( (GNUNET_YES == pi->delete_later) ||
+	 (NULL == pi->index) )
+    {
+      GNUNET_mutex_unlock (pi->lock);
+      return;
+    }
+  }
+  if (qe->depth < max_depth)
+  {
+    for (i = 0;
+	 NULL != GNUNET_FUSE_path_info_get_entry (pi, i, &stbuf);
+	 i++)
+    {
+      if (! S_ISDIR (stbuf.st_mode))
+	continue;
+      if (NULL == (child = GNUNET_FUSE_path_info_get_child (pi, i)))
+	continue;
+      GNUNET_mutex_lock (queue_lock);
+      enqueue (child, qe->crawl, qe->depth + 1);
+      GNUNET_mutex_unlock (queue_lock);
+    }
+  }
+  GNUNET_mutex_unlock (pi->lock);
+}
+
+
+/**
+ * Main function of the crawler thread.
+ *
+ * @param cls NULL
+ * @return NULL
+ */
+static void *
+crawl (void *cls)
+{
+  struct QueueEntry *qe;
+
+  GNUNET_mutex_lock (queue_lock);
+  while (GNUNET_YES != in_shutdown)
+  {
+    if (NULL == (qe = queue_head))
+    {
+      GNUNET_cond_wait (queue_cond, queue_lock);
+      continue;
+    }
+    GNUNET_CONTAINER_DLL_remove (queue_head,
+				 queue_tail,
+				 qe);
+    GNUNET_mutex_unlock (queue_lock);
+    process (qe);
+    GNUNET_FUSE_path_info_done (qe->pi);
+    /* collapse directories if we loaded too much */
+    GNUNET_FUSE_path_info_trim ();
+    GNUNET_mutex_lock (queue_lock);
+    release (qe);
+  }
+  GNUNET_mutex_unlock (queue_lock);
+  return NULL;
+}
+
+
+/**
+ * Setup prefetching.
+ *
+ * @param depth how many levels of subdirectories to load
+ *        below a directory that was accessed, 0 to disable prefetching
+ * @param budget maximum number of bytes of directories to load
+ *        for each directory that was accessed
+ */
+void
+GNUNET_FUSE_prefetch_init (unsigned long long depth,
+			   unsigned long long budget)
+{
+  max_depth = (unsigned int) GNUNET_MIN (depth, UINT_MAX);
+  crawl_budget = budget;
+  in_shutdown = GNUNET_NO;
+  if (0 == max_depth)
+    return;
+  queue_lock = GNUNET_mutex_create (GNUNET_NO);
+  queue_cond = GNUNET_cond_create ();
+}
+
+
+/**
+ * Start the thread that loads the queued directories.  Must be
+ * called after FUSE daemonized the process.
+ */
+void
+GNUNET_FUSE_prefetch_start ()
+{
+  if (NULL == queue_lock)
+    return;
+  if (0 != (errno = pthread_create (&crawler,
+				    NULL,
+				    &crawl,
+				    NULL)))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+			 "pthread_create");
+    return;
+  }
+  crawler_started = GNUNET_YES;
+}
+
+
+/**
+ * Queue the subdirectories of a directory for loading in the
+ * background.  Does nothing if this was already done for the
+ * directory.  Caller must hold the lock of 'pi'.
+ *
+ * @param pi a loaded directory
+ */
+void
+GNUNET_FUSE_prefetch_directory (struct GNUNET_FUSE_PathInfo *pi)
+{
+  struct Crawl *crawl;
+
+  if ( (NULL == queue_lock) ||
+       (GNUNET_YES == pi->prefetched) )
+    return;
+  pi->prefetched = GNUNET_YES;
+  ++pi->rc;
+  crawl = GNUNET_new (struct Crawl);
+  crawl->remaining = crawl_budget;
+  GNUNET_mutex_lock (queue_lock);
+  enqueue (pi, crawl, 0);
+  GNUNET_mutex_unlock (queue_lock);
+}
+
+
+/**
+ * Stop prefetching and drop the queued directories.
+ */
+void
+GNUNET_FUSE_prefetch_done ()
+{
+  struct QueueEntry *qe;
+
+  if (NULL == queue_lock)
+    return;
+  GNUNET_mutex_lock (queue_lock);
+  in_shutdown = GNUNET_YES;
+  GNUNET_cond_broadcast (queue_cond);
+  GNUNET_mutex_unlock (queue_lock);
+  if (GNUNET_YES == crawler_started)
+  {
+    GNUNET_break (0 == pthread_join (crawler, NULL));
+    crawler_started = GNUNET_NO;
+  }
+  while (NULL != (qe = queue_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (queue_head,
+				 queue_tail,
+				 qe);
+    GNUNET_FUSE_path_info_done (qe->pi);
+    release (qe);
+  }
+  GNUNET_cond_destroy (queue_cond);
+  queue_cond = NULL;
+  GNUNET_mutex_destroy (queue_lock);
+  queue_lock = NULL;
+}
+
+/* end of gfs_prefetch.c */
@@ -0,0 +1,67 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_prefetch.h
+ * @brief background loading of subdirectories
+ */
+#ifndef GFS_PREFETCH_H
+#define GFS_PREFETCH_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Setup prefetching.
+ *
+ * @param depth how many levels of subdirectories to load
+ *        below a directory that was accessed, 0 to disable prefetching
+ * @param budget maximum number of bytes of directories to load
+ *        for each directory that was accessed
+ */
+void
+GNUNET_FUSE_prefetch_init (unsigned long long depth,
+                           unsigned long long budget);
+
+
+/**
+ * Start the thread that loads the queued directories.  Must be
+ * called after FUSE daemonized the process.
+ */
+void
+GNUNET_FUSE_prefetch_start (void);
+
+
+/**
+ * Queue the subdirectories of a directory for loading in the
+ * background.  Does nothing if this was already done for the
+ * directory.  Caller must hold the lock of 'pi'.
+ *
+ * @param pi a loaded directory
+ */
+void
+GNUNET_FUSE_prefetch_directory (struct GNUNET_FUSE_PathInfo *pi);
+
+
+/**
+ * Stop prefetching and drop the queued directories.
+ */
+void
+GNUNET_FUSE_prefetch_done (void);
+
+#endif
@@ -0,0 +1,810 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_preload.c
+ * @brief recursive download of whole subtrees
+ *
+ * Walking a subtree through FUSE downloads one file after another.
+ * A preload instead has FS download a directory recursively (with
+ * many files in parallel) into a staging directory, using a single
+ * download slot.  Once the download is complete, the downloaded
+ * files are moved into the persistent cache (or into temporary files
+ * of their own if we have none) and the entries of the subtree that
+ * were not accessed so far take them as their 'tmpfile', with all
+ * blocks available; then the staging directory is removed.  FS names the
+ * downloaded files after the entries of the directories (with
+ * GNUNET_FS_DIRECTORY_EXT appended for directories); entries whose
+ * file is missing or has the wrong size are downloaded on demand as
+ * usual.
+ */
+#include "gfs_preload.h"
+#include "gfs_cache.h"
+#include "gfs_download.h"
+#include "gfs_scheduler.h"
+#include "gfs_stats.h"
+#include <pthread.h>
+
+
+/**
+ * Number of files FS downloads in parallel for a preload.
+ */
+#define PRELOAD_PARALLELISM 16
+
+
+/**
+ * State of a preload.
+ */
+enum State
+{
+
+  /**
+   * Waiting for a slot or downloading.
+   */
+  PS_RUNNING = 0,
+
+  /**
+   * The subtree was downloaded.
+   */
+  PS_DONE = 1,
+
+  /**
+   * The download failed or was stopped.
+   */
+  PS_FAILED = 2
+
+};
+
+
+/**
+ * Message sent by a preload process about its progress.
+ */
+struct ProgressMessage
+{
+
+  /**
+   * Number of bytes of data that arrived.
+   */
+  uint64_t bytes;
+
+  /**
+   * Number of files (and directories) that were completed.
+   */
+  uint64_t files;
+
+};
+
+
+/**
+ * A preload of a directory.
+ */
+struct Preload
+{
+
+  /**
+   * This is a DLL.
+   */
+  struct Preload *next;
+
+  /**
+   * This is a DLL.
+   */
+  struct Preload *prev;
+
+  /**
+   * The directory (we hold a reference).
+   */
+  struct GNUNET_FUSE_PathInfo *dir;
+
+  /**
+   * Staging directory FS downloads into (next to the cache),
+   * NULL once the preload finished.
+   */
+  char *stage;
+
+  /**
+   * Name of the downloaded directory in 'stage', NULL once the
+   * preload finished.
+   */
+  char *filename;
+
+  /**
+   * Our job with the scheduler, NULL if none.
+   */
+  struct GNUNET_FUSE_Job *job;
+
+  /**
+   * Number of bytes of data that arrived so far.
+   */
+  uint64_t bytes;
+
+  /**
+   * Number of files that were completed so far.
+   */
+  uint64_t files;
+
+  /**
+   * Number of files that took the downloaded files as 'tmpfile'.
+   */
+  uint64_t adopted;
+
+  /**
+   * Process performing the download, 0 if none.
+   */
+  pid_t pid;
+
+  /**
+   * State of the preload.
+   */
+  enum State state;
+
+};
+
+
+/**
+ * Context of a preload process.
+ */
+struct Context
+{
+
+  /**
+   * The preload.
+   */
+  const struct Preload *preload;
+
+  /**
+   * FS handle.
+   */
+  struct GNUNET_FS_Handle *fs;
+
+  /**
+   * The recursive download.
+   */
+  struct GNUNET_FS_DownloadContext *dc;
+
+  /**
+   * Metadata of the directory (can be NULL).
+   */
+  struct GNUNET_CONTAINER_MetaData *meta;
+
+  /**
+   * Pipe to report progress on.
+   */
+  int progress_fd;
+
+  /**
+   * Return value for the process, 0 once the download completed.
+   */
+  int ret;
+
+};
+
+
+/**
+ * Head of all preloads (the most recent first).
+ */
+static struct Preload *preload_head;
+
+/**
+ * Tail of all preloads.
+ */
+static struct Preload *preload_tail;
+
+/**
+ * Lock for the preloads.
+ */
+static struct GNUNET_Mutex *preload_lock;
+
+/**
+ * Signalled when a preload thread terminates.
+ */
+static struct GNUNET_Cond *preload_cond;
+
+/**
+ * Number of preload threads that are running.
+ */
+static unsigned int active_preloads;
+
+/**
+ * GNUNET_YES once we are shutting down.
+ */
+static int in_shutdown;
+
+
+/**
+ * Task run when a preload process shuts down.
+ *
+ * @param cls our 'struct Context'
+ */
+static void
+shutdown_task (void *cls)
+{
+  struct Context *ctx = cls;
+
+  if (NULL != ctx->dc)
+  {
+    GNUNET_FS_download_stop (ctx->dc, GNUNET_NO);
+    ctx->dc = NULL;
+  }
+  if (NULL != ctx->fs)
+  {
+    GNUNET_FS_stop (ctx->fs);
+    ctx->fs = NULL;
+  }
+}
+
+
+/**
+ * Tell the main process about our progress.
+ *
+ * @param ctx our context
+ * @param bytes number of bytes that arrived
+ * @param files number of files that were completed
+ */
+static void
+send_progress (struct Context *ctx,
+	       uint64_t bytes,
+	       uint64_t files)
+{
+  struct ProgressMessage pm;
+
+  pm.bytes = bytes;
+  pm.files = files;
+  if (sizeof (pm) != write (ctx->progress_fd, &pm, sizeof (pm)))
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "write");
+}
+
+
+/**
+ * Function called from FS with progress information.
+ *
+ * @param cls our 'struct Context'
+ * @param info progress information
+ * @return NULL
+ */
+static void *
+progress_cb (void *cls, const struct GNUNET_FS_ProgressInfo *info)
+{
+  struct Context *ctx = cls;
+
+  switch (info->status)
+    {
+    case GNUNET_FS_STATUS_DOWNLOAD_PROGRESS:
+      if ( (0 == info->value.download.specifics.progress.depth) &&
+	   (0 != info->value.download.specifics.progress.data_len) )
+	send_progress (ctx,
+		       info->value.download.specifics.progress.data_len,
+		       0);
+      break;
+    case GNUNET_FS_STATUS_DOWNLOAD_COMPLETED:
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Preloaded `%s'.\n",
+		  info->value.download.filename);
+      send_progress (ctx, 0, 1);
+      if (info->value.download.dc == ctx->dc)
+      {
+	/* completes after everything below it */
+	ctx->ret = 0;
+	GNUNET_SCHEDULER_shutdown ();
+      }
+      break;
+    case GNUNET_FS_STATUS_DOWNLOAD_ERROR:
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		  _("Error preloading `%s': %s\n"),
+		  info->value.download.filename,
+		  info->value.download.specifics.error.message);
+      if (info->value.download.dc == ctx->dc)
+	GNUNET_SCHEDULER_shutdown ();
+      break;
+    default:
+      break;
+    }
+  return NULL;
+}
+
+
+/**
+ * Main task of a preload process.
+ *
+ * @param cls our 'struct Context'
+ */
+static void
+preload_task (void *cls)
+{
+  struct Context *ctx = cls;
+  const struct Preload *p = ctx->preload;
+
+  ctx->fs = GNUNET_FS_start (cfg, "gnunet-fuse", &progress_cb, ctx,
+			     GNUNET_FS_FLAGS_NONE,
+			     GNUNET_FS_OPTIONS_DOWNLOAD_PARALLELISM, PRELOAD_PARALLELISM,
+			     GNUNET_FS_OPTIONS_REQUEST_PARALLELISM, PRELOAD_PARALLELISM,
+			     GNUNET_FS_OPTIONS_END);
+  if (NULL == ctx->fs)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("Could not initialize `%s' subsystem.\n"), "FS");
+    return;
+  }
+  GNUNET_SCHEDULER_add_shutdown (&shutdown_task, ctx);
+  ctx->dc = GNUNET_FS_download_start (ctx->fs,
+				      p->dir->uri, ctx->meta,
+				      p->filename, NULL,
+				      0,
+				      GNUNET_FS_uri_chk_get_file_size (p->dir->uri),
+				      anonymity_level,
+				      GNUNET_FS_DOWNLOAD_OPTION_RECURSIVE,
+				      NULL, NULL);
+  if (NULL == ctx->dc)
+    GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Make a downloaded file (or directory) the 'tmpfile' of an entry
+ * that was not accessed so far, and do the same for the entries
+ * below a directory.  The file is moved out of the staging
+ * directory (into the cache if we have one), as the staging
+ * directory is removed once we are done.
+ *
+ * @param p the preload
+ * @param pi the entry (we hold a reference, but not its lock)
+ * @param fn name of the downloaded file for 'pi'
+ */
+static void
+adopt (struct Preload *p,
+       struct GNUNET_FUSE_PathInfo *pi,
+       const char *fn)
+{
+  struct GNUNET_FUSE_PathInfo **children;
+  struct GNUNET_FUSE_PathInfo *child;
+  struct stat sbuf;
+  struct stat stbuf;
+  char *tmpfile;
+  char *sub;
+  char *cfn;
+  unsigned int num;
+  unsigned int pos;
+  unsigned int i;
+  int cached;
+  int loaded;
+  int eno;
+
+  if ( (0 != stat (fn, &sbuf)) ||
+       ((uint64_t) sbuf.st_size != GNUNET_FS_uri_chk_get_file_size (pi->uri)) )
+    return;
+  cached = GNUNET_YES;
+  if (NULL == (tmpfile = GNUNET_FUSE_cache_publish (pi->uri, NULL, fn)))
+  {
+    cached = GNUNET_NO;
+    if ( (NULL != (tmpfile = GNUNET_FUSE_cache_mktemp ())) &&
+	 (0 != rename (fn, tmpfile)) )
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+				"rename",
+				tmpfile);
+      (void) unlink (tmpfile);
+      GNUNET_free (tmpfile);
+      tmpfile = NULL;
+    }
+  }
+  GNUNET_mutex_lock (pi->content->lock);
+  if ( (NULL != tmpfile) &&
+       (NULL == pi->content->tmpfile) )
+  {
+    /* nobody can have used the 'tmpfile' of the content yet */
+    pi->content->tmpfile = tmpfile;
+    pi->content->tmpfile_cached = cached;
+    tmpfile = NULL;
+    GNUNET_FUSE_download_mark_available (pi);
+    p->adopted++;
+    GNUNET_FUSE_stats_update (gettext_noop ("# files taken from preloads"),
+			      1);
+  }
+  GNUNET_mutex_unlock (pi->content->lock);
+  if (NULL != tmpfile)
+  {
+    if (GNUNET_YES != cached)
+      (void) unlink (tmpfile);
+    GNUNET_free (tmpfile);
+  }
+  if (! S_ISDIR (pi->stbuf.st_mode))
+    return;
+  GNUNET_mutex_lock (pi->lock);
+  loaded = (NULL != pi->index) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_mutex_unlock (pi->lock);
+  /* like prefetching, do not make lookups in the directory wait
+     for us on its lock */
+  if ( (GNUNET_YES != loaded) &&
+       (GNUNET_OK != GNUNET_FUSE_load_directory_unlocked (pi,
+							  GNUNET_FUSE_DOWNLOAD_BACKGROUND,
+							  &eno)) )
+    return;
+  children = NULL;
+  num = 0;
+  GNUNET_mutex_lock (pi->lock);
+  for (pos = 0;
+       NULL != GNUNET_FUSE_path_info_get_entry (pi, pos, &stbuf);
+       pos++)
+    if (NULL != (child = GNUNET_FUSE_path_info_get_child (pi, pos)))
+      GNUNET_array_append (children, num, child);
+  GNUNET_mutex_unlock (pi->lock);
+  /* FS puts the entries of 'X.gnd' into 'X/' */
+  sub = GNUNET_strdup (fn);
+  if ( (strlen (sub) > strlen (GNUNET_FS_DIRECTORY_EXT)) &&
+       (0 == strcmp (sub + strlen (sub) - strlen (GNUNET_FS_DIRECTORY_EXT),
+		     GNUNET_FS_DIRECTORY_EXT)) )
+    sub[strlen (sub) - strlen (GNUNET_FS_DIRECTORY_EXT)] = '\0';
+  for (i = 0; i < num; i++)
+  {
+    child = children[i];
+    GNUNET_asprintf (&cfn,
+		     "%s/%s%s",
+		     sub,
+		     child->filename,
+		     S_ISDIR (child->stbuf.st_mode) ? GNUNET_FS_DIRECTORY_EXT : "");
+    adopt (p, child, cfn);
+    GNUNET_free (cfn);
+    GNUNET_FUSE_path_info_done (child);
+  }
+  GNUNET_free (sub);
+  GNUNET_free_non_null (children);
+}
+
+
+/**
+ * Run a preload: wait for a slot, start the process performing the
+ * recursive download and pass its progress on.
+ *
+ * @param p the preload
+ * @return GNUNET_OK if the download completed
+ */
+static int
+run_preload (struct Preload *p)
+{
+  struct ProgressMessage pm;
+  struct Context ctx;
+  struct GNUNET_CONTAINER_MetaData *meta;
+  siginfo_t si;
+  int fds[2];
+  int status;
+  pid_t pid;
+
+  /* decode the metadata here, the child must not touch our locks;
+     and before we take a slot, as it may have to be downloaded */
+  meta = GNUNET_FUSE_path_info_get_meta (p->dir);
+  GNUNET_mutex_lock (preload_lock);
+  p->job = GNUNET_FUSE_scheduler_enqueue (GNUNET_FUSE_DOWNLOAD_READAHEAD);
+  GNUNET_mutex_unlock (preload_lock);
+  if (GNUNET_OK != GNUNET_FUSE_scheduler_wait (p->job))
+  {
+    if (NULL != meta)
+      GNUNET_CONTAINER_meta_data_destroy (meta);
+    return GNUNET_SYSERR;
+  }
+  if (0 != pipe (fds))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "pipe");
+    if (NULL != meta)
+      GNUNET_CONTAINER_meta_data_destroy (meta);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_lock (preload_lock);
+  if (GNUNET_YES == in_shutdown)
+  {
+    GNUNET_mutex_unlock (preload_lock);
+    if (NULL != meta)
+      GNUNET_CONTAINER_meta_data_destroy (meta);
+    GNUNET_break (0 == close (fds[0]));
+    GNUNET_break (0 == close (fds[1]));
+    return GNUNET_SYSERR;
+  }
+  pid = fork ();
+  if (-1 == pid)
+  {
+    GNUNET_mutex_unlock (preload_lock);
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "fork");
+    if (NULL != meta)
+      GNUNET_CONTAINER_meta_data_destroy (meta);
+    GNUNET_break (0 == close (fds[0]));
+    GNUNET_break (0 == close (fds[1]));
+    return GNUNET_SYSERR;
+  }
+  if (0 == pid)
+  {
+    (void) close (fds[0]);
+    memset (&ctx, 0, sizeof (ctx));
+    ctx.preload = p;
+    ctx.meta = meta;
+    ctx.progress_fd = fds[1];
+    ctx.ret = 1;
+    GNUNET_SCHEDULER_run (&preload_task, &ctx);
+    _exit (ctx.ret);
+  }
+  p->pid = pid;
+  GNUNET_mutex_unlock (preload_lock);
+  if (NULL != meta)
+    GNUNET_CONTAINER_meta_data_destroy (meta);
+  GNUNET_break (0 == close (fds[1]));
+  GNUNET_FUSE_scheduler_started (p->job, pid);
+  while (sizeof (pm) == read (fds[0], &pm, sizeof (pm)))
+  {
+    GNUNET_FUSE_stats_update (gettext_noop ("# bytes preloaded"),
+			      pm.bytes);
+    GNUNET_mutex_lock (preload_lock);
+    p->bytes += pm.bytes;
+    p->files += pm.files;
+    GNUNET_mutex_unlock (preload_lock);
+  }
+  GNUNET_break (0 == close (fds[0]));
+  /* only look, the process stays a zombie (keeping its ID) until
+     nobody who may signal it knows its ID anymore */
+  memset (&si, 0, sizeof (si));
+  while ( (0 != waitid (P_PID, pid, &si, WEXITED | WNOWAIT)) &&
+	  (EINTR == errno) )
+    ;
+  GNUNET_FUSE_scheduler_exited (p->job);
+  GNUNET_mutex_lock (preload_lock);
+  p->pid = 0;
+  GNUNET_mutex_unlock (preload_lock);
+  if (pid != waitpid (pid, &status, 0))
+    status = -1;
+  return ( (-1 != status) &&
+	   (WIFEXITED (status)) &&
+	   (0 == WEXITSTATUS (status)) ) ? GNUNET_OK : GNUNET_SYSERR;
+}
+
+
+/**
+ * Thread performing a preload.
+ *
+ * @param cls the 'struct Preload'
+ * @return NULL
+ */
+static void *
+preload_thread (void *cls)
+{
+  struct Preload *p = cls;
+  struct GNUNET_FUSE_Job *job;
+  enum State state;
+  int ret;
+
+  ret = run_preload (p);
+  GNUNET_mutex_lock (preload_lock);
+  job = p->job;
+  p->job = NULL;
+  GNUNET_mutex_unlock (preload_lock);
+  (void) GNUNET_FUSE_scheduler_release (job);
+  state = PS_FAILED;
+  if (GNUNET_OK == ret)
+  {
+    adopt (p, p->dir, p->filename);
+    state = PS_DONE;
+  }
+  /* everything we could use was moved out of it */
+  if (GNUNET_OK != GNUNET_DISK_directory_remove (p->stage))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "rmdir",
+			      p->stage);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+	      _("Preload of `%s' %s: %llu bytes, %llu files\n"),
+	      p->dir->filename,
+	      (PS_DONE == state) ? _("done") : _("failed"),
+	      (unsigned long long) p->bytes,
+	      (unsigned long long) p->files);
+  GNUNET_mutex_lock (preload_lock);
+  GNUNET_free (p->filename);
+  p->filename = NULL;
+  GNUNET_free (p->stage);
+  p->stage = NULL;
+  p->state = state;
+  active_preloads--;
+  GNUNET_cond_broadcast (preload_cond);
+  GNUNET_mutex_unlock (preload_lock);
+  return NULL;
+}
+
+
+/**
+ * Setup preloading.
+ */
+void
+GNUNET_FUSE_preload_init ()
+{
+  in_shutdown = GNUNET_NO;
+  preload_lock = GNUNET_mutex_create (GNUNET_NO);
+  preload_cond = GNUNET_cond_create ();
+}
+
+
+/**
+ * Find the last preload of a directory.  Caller must hold
+ * 'preload_lock'.
+ *
+ * @param dir the directory
+ * @return NULL if the directory was never preloaded
+ */
+static struct Preload *
+find_preload (const struct GNUNET_FUSE_PathInfo *dir)
+{
+  struct Preload *pos;
+
+  for (pos = preload_head; NULL != pos; pos = pos->next)
+    if (pos->dir == dir)
+      return pos;
+  return NULL;
+}
+
+
+/**
+ * Start downloading a directory and everything below it with a
+ * single recursive FS download.  Does nothing if a preload of the
+ * directory is running.
+ *
+ * @param dir the directory
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_preload_start (struct GNUNET_FUSE_PathInfo *dir,
+			   int *eno)
+{
+  struct Preload *p;
+  pthread_t thread;
+  char *stage;
+
+  if (GNUNET_YES == offline)
+  {
+    *eno = ENODATA;
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_lock (preload_lock);
+  if ( (GNUNET_YES == in_shutdown) ||
+       ( (NULL != (p = find_preload (dir))) &&
+	 (PS_RUNNING == p->state) ) )
+  {
+    GNUNET_mutex_unlock (preload_lock);
+    return GNUNET_OK;
+  }
+  if (NULL == (stage = GNUNET_FUSE_cache_mkdtemp ()))
+  {
+    GNUNET_mutex_unlock (preload_lock);
+    *eno = EIO;
+    return GNUNET_SYSERR;
+  }
+  if (NULL != p)
+  {
+    /* a finished preload only remains for its status, which the new
+       one replaces; it keeps holding the reference to 'dir' */
+    GNUNET_CONTAINER_DLL_remove (preload_head,
+				 preload_tail,
+				 p);
+    p->bytes = 0;
+    p->files = 0;
+    p->adopted = 0;
+    p->state = PS_RUNNING;
+  }
+  else
+  {
+    p = GNUNET_new (struct Preload);
+    p->dir = dir;
+    GNUNET_mutex_lock (dir->lock);
+    ++dir->rc;
+    GNUNET_mutex_unlock (dir->lock);
+  }
+  p->stage = stage;
+  GNUNET_asprintf (&p->filename,
+		   "%s/root%s",
+		   stage,
+		   GNUNET_FS_DIRECTORY_EXT);
+  if (0 != (errno = pthread_create (&thread,
+				    NULL,
+				    &preload_thread,
+				    p)))
+  {
+    *eno = errno;
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "pthread_create");
+    GNUNET_mutex_unlock (preload_lock);
+    GNUNET_FUSE_path_info_done (dir);
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_directory_remove (stage));
+    GNUNET_free (p->filename);
+    GNUNET_free (stage);
+    GNUNET_free (p);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_break (0 == pthread_detach (thread));
+  GNUNET_CONTAINER_DLL_insert (preload_head,
+			       preload_tail,
+			       p);
+  active_preloads++;
+  GNUNET_mutex_unlock (preload_lock);
+  GNUNET_FUSE_stats_update (gettext_noop ("# preloads started"),
+			    1);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Describe the progress of the last preload of a directory.
+ *
+ * @param dir the directory
+ * @return description of the progress (caller must free),
+ *         NULL if the directory was never preloaded
+ */
+char *
+GNUNET_FUSE_preload_status (const struct GNUNET_FUSE_PathInfo *dir)
+{
+  static const char *states[] = { "running", "done", "failed" };
+  struct Preload *p;
+  char *ret;
+
+  GNUNET_mutex_lock (preload_lock);
+  if (NULL == (p = find_preload (dir)))
+  {
+    GNUNET_mutex_unlock (preload_lock);
+    return NULL;
+  }
+  GNUNET_asprintf (&ret,
+		   "%s: %llu bytes, %llu files downloaded, %llu files taken over\n",
+		   states[p->state],
+		   (unsigned long long) p->bytes,
+		   (unsigned long long) p->files,
+		   (unsigned long long) p->adopted);
+  GNUNET_mutex_unlock (preload_lock);
+  return ret;
+}
+
+
+/**
+ * Stop all preloads and remove what they downloaded.  Must be
+ * called before the path info tree is cleaned up.
+ */
+void
+GNUNET_FUSE_preload_done ()
+{
+  struct Preload *p;
+
+  if (NULL == preload_lock)
+    return;
+  GNUNET_mutex_lock (preload_lock);
+  in_shutdown = GNUNET_YES;
+  for (p = preload_head; NULL != p; p = p->next)
+  {
+    if (0 != p->pid)
+      (void) kill (p->pid, SIGTERM);
+    else if (NULL != p->job)
+      GNUNET_FUSE_scheduler_cancel (p->job);
+  }
+  while (0 != active_preloads)
+    GNUNET_cond_wait (preload_cond, preload_lock);
+  GNUNET_mutex_unlock (preload_lock);
+  while (NULL != (p = preload_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (preload_head,
+				 preload_tail,
+				 p);
+    /* the threads removed their staging directories */
+    GNUNET_FUSE_path_info_done (p->dir);
+    GNUNET_free (p);
+  }
+  GNUNET_cond_destroy (preload_cond);
+  preload_cond = NULL;
+  GNUNET_mutex_destroy (preload_lock);
+  preload_lock = NULL;
+}
+
+/* end of gfs_preload.c */
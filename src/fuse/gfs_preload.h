@@ -0,0 +1,75 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_preload.h
+ * @brief recursive download of whole subtrees
+ */
+#ifndef GFS_PRELOAD_H
+#define GFS_PRELOAD_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Extended attribute of directories to start a preload (by setting
+ * it to any value) and to get its progress.
+ */
+#define GNUNET_FUSE_PRELOAD_XATTR "user.gnunet-fuse.preload"
+
+
+/**
+ * Setup preloading.
+ */
+void
+GNUNET_FUSE_preload_init (void);
+
+
+/**
+ * Start downloading a directory and everything below it with a
+ * single recursive FS download.  Does nothing if a preload of the
+ * directory is running.
+ *
+ * @param dir the directory
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_preload_start (struct GNUNET_FUSE_PathInfo *dir,
+                           int *eno);
+
+
+/**
+ * Describe the progress of the last preload of a directory.
+ *
+ * @param dir the directory
+ * @return description of the progress (caller must free),
+ *         NULL if the directory was never preloaded
+ */
+char *
+GNUNET_FUSE_preload_status (const struct GNUNET_FUSE_PathInfo *dir);
+
+
+/**
+ * Stop all preloads and remove what they downloaded.  Must be
+ * called before the path info tree is cleaned up.
+ */
+void
+GNUNET_FUSE_preload_done (void);
+
+#endif
@@ -0,0 +1,205 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_scan.c
+ * @brief fetching small files ahead of directory scans
+ *
+ * Tree walks (i.e. 'grep -r' or 'tar') open the files of a directory
+ * one after another, in the order of 'readdir'.  Once several
+ * entries of a directory were opened in quick succession, we fetch
+ * the small files that follow the last opened one, up to a budget,
+ * with a single download process (see gfs_download.c).  When the
+ * scan got halfway through what we fetched, we fetch the next
+ * files, so the scan does not wait for each file in turn.
+ */
+#include "gfs_scan.h"
+#include "gfs_download.h"
+#include "gfs_stats.h"
+
+
+/**
+ * Number of different entries of a directory that must be opened
+ * in quick succession before we consider it a scan.
+ */
+#define SCAN_MIN_OPENS 3
+
+/**
+ * Maximum time between opening two entries of a directory during
+ * a scan (in ms).
+ */
+#define SCAN_WINDOW_MS 1000
+
+/**
+ * Maximum number of files to fetch at once (the maximum size of
+ * a batch of downloads).
+ */
+#define SCAN_MAX_FILES 64
+
+
+/**
+ * Number of bytes of small files to fetch ahead of a scan.
+ */
+static uint64_t scan_budget;
+
+
+/**
+ * Setup scan detection.
+ *
+ * @param budget number of bytes of small files to fetch ahead
+ *        of a scan, 0 to disable fetching for scans
+ */
+void
+GNUNET_FUSE_scan_init (unsigned long long budget)
+{
+  scan_budget = budget;
+}
+
+
+/**
+ * Fetch the small files of a directory that follow a position.
+ * Caller must hold the lock of the directory.
+ *
+ * @param dir the directory
+ * @param start position of the first entry to consider
+ */
+static void
+fetch_siblings (struct GNUNET_FUSE_PathInfo *dir,
+		unsigned int start)
+{
+  struct GNUNET_FUSE_PathInfo *files[SCAN_MAX_FILES];
+  struct GNUNET_FUSE_PathInfo *child;
+  struct stat stbuf;
+  uint64_t remaining;
+  unsigned int num;
+  unsigned int pos;
+  unsigned int i;
+
+  remaining = scan_budget;
+  num = 0;
+  for (pos = start;
+       (num < SCAN_MAX_FILES) &&
+	 (NULL != GNUNET_FUSE_path_info_get_entry (dir, pos, &stbuf));
+       pos++)
+  {
+    if ( (! S_ISREG (stbuf.st_mode)) ||
+	 (0 == stbuf.st_size) ||
+	 (stbuf.st_size > small_file_threshold) )
+      continue;
+    if (stbuf.st_size > remaining)
+    {
+      if (0 == num)
+	continue; /* larger than the whole budget */
+      break;
+    }
+    if (NULL == (child = GNUNET_FUSE_path_info_get_child (dir, pos)))
+      continue;
+    GNUNET_mutex_lock (child->content->lock);
+    if (GNUNET_OK != GNUNET_FUSE_download_prepare (child))
+    {
+      GNUNET_mutex_unlock (child->content->lock);
+      GNUNET_FUSE_path_info_done (child);
+      continue;
+    }
+    GNUNET_mutex_unlock (child->content->lock);
+    files[num++] = child;
+    remaining -= stbuf.st_size;
+  }
+  dir->scan_next = pos;
+  dir->scan_refill = start + (pos - start) / 2;
+  if (0 == num)
+    return;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Scan of `%s' detected, fetching %u small files\n",
+	      dir->filename,
+	      num);
+  GNUNET_FUSE_stats_update (gettext_noop ("# small files fetched for scans"),
+			    GNUNET_FUSE_download_start_batch (files,
+							      num,
+							      GNUNET_FUSE_DOWNLOAD_READAHEAD));
+  for (i = 0; i < num; i++)
+    GNUNET_FUSE_path_info_done (files[i]);
+}
+
+
+/**
+ * Tell scan detection that a file was opened.  If other entries of
+ * its directory were opened in quick succession before, the small
+ * files that follow it in the directory are fetched in a batch.
+ * Caller must not hold any locks of path info entries.
+ *
+ * @param pi the file that was opened
+ */
+void
+GNUNET_FUSE_scan_open (struct GNUNET_FUSE_PathInfo *pi)
+{
+  struct GNUNET_FUSE_PathInfo *dir = pi->parent;
+  struct GNUNET_TIME_Absolute now;
+  unsigned int pos;
+
+  if ( (0 == scan_budget) ||
+       (0 == small_file_threshold) ||
+       (GNUNET_YES == offline) ||
+       (NULL == dir) )
+    return;
+  GNUNET_mutex_lock (dir->lock);
+  if (NULL == dir->index)
+  {
+    GNUNET_mutex_unlock (dir->lock);
+    return;
+  }
+  now = GNUNET_TIME_absolute_get ();
+  pos = pi->child_offset;
+  if ( (0 != dir->scan_opens) &&
+       (pos == dir->scan_last_child) )
+  {
+    /* opened again, not a scan */
+    GNUNET_mutex_unlock (dir->lock);
+    return;
+  }
+  if (GNUNET_TIME_absolute_get_difference (dir->scan_last_open,
+					   now).rel_value_us
+      <= SCAN_WINDOW_MS * 1000LL)
+  {
+    dir->scan_opens++;
+  }
+  else
+  {
+    /* a new scan (if any) starts over */
+    dir->scan_opens = 1;
+    dir->scan_next = 0;
+    dir->scan_refill = 0;
+  }
+  dir->scan_last_open = now;
+  dir->scan_last_child = pos;
+  if ( (dir->scan_opens < SCAN_MIN_OPENS) ||
+       (pos < dir->scan_refill) )
+  {
+    GNUNET_mutex_unlock (dir->lock);
+    return;
+  }
+  if (SCAN_MIN_OPENS == dir->scan_opens)
+    GNUNET_FUSE_stats_update (gettext_noop ("# directory scans detected"),
+			      1);
+  fetch_siblings (dir,
+		  GNUNET_MAX (dir->scan_next, pos + 1));
+  GNUNET_mutex_unlock (dir->lock);
+}
+
+/* end of gfs_scan.c */
@@ -0,0 +1,50 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_scan.h
+ * @brief fetching small files ahead of directory scans
+ */
+#ifndef GFS_SCAN_H
+#define GFS_SCAN_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Setup scan detection.
+ *
+ * @param budget number of bytes of small files to fetch ahead
+ *        of a scan, 0 to disable fetching for scans
+ */
+void
+GNUNET_FUSE_scan_init (unsigned long long budget);
+
+
+/**
+ * Tell scan detection that a file was opened.  If other entries of
+ * its directory were opened in quick succession before, the small
+ * files that follow it in the directory are fetched in a batch.
+ * Caller must not hold any locks of path info entries.
+ *
+ * @param pi the file that was opened
+ */
+void
+GNUNET_FUSE_scan_open (struct GNUNET_FUSE_PathInfo *pi);
+
+#endif
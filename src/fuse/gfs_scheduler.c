@@ -0,0 +1,586 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_scheduler.c
+ * @brief assignment of download slots by priority and deadline
+ *
+ * Only a limited number of downloads run at the same time.  Waiting
+ * downloads are kept in one heap per priority class, ordered by
+ * deadline.  Background downloads never take the last free slot, and
+ * if a foreground download finds all slots taken, a running
+ * background download is preempted: its process is asked to shut
+ * down (which stops the FS download) and the job is queued again.
+ */
+#include "gfs_scheduler.h"
+
+
+/**
+ * Number of priority classes.
+ */
+#define NUM_CLASSES 3
+
+
+/**
+ * A download waiting for or holding a slot.
+ */
+struct GNUNET_FUSE_Job
+{
+
+  /**
+   * Running jobs are kept in a DLL.
+   */
+  struct GNUNET_FUSE_Job *next;
+
+  /**
+   * Running jobs are kept in a DLL.
+   */
+  struct GNUNET_FUSE_Job *prev;
+
+  /**
+   * Node in the heap of our class while we are waiting, otherwise NULL.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * When should the download be started at the latest.
+   */
+  struct GNUNET_TIME_Absolute deadline;
+
+  /**
+   * Priority of the download.
+   */
+  enum GNUNET_FUSE_DownloadPriority priority;
+
+  /**
+   * Process performing the download, 0 if not yet started or if
+   * it terminated.
+   */
+  pid_t pid;
+
+  /**
+   * GNUNET_YES once the job was given a slot.
+   */
+  int granted;
+
+  /**
+   * GNUNET_YES if the job was preempted.
+   */
+  int preempted;
+
+  /**
+   * GNUNET_YES if the job was cancelled while waiting.
+   */
+  int cancelled;
+
+};
+
+
+/**
+ * Waiting jobs, one heap per priority class.
+ */
+static struct GNUNET_CONTAINER_Heap *queues[NUM_CLASSES];
+
+/**
+ * Head of the running jobs.
+ */
+static struct GNUNET_FUSE_Job *running_head;
+
+/**
+ * Tail of the running jobs.
+ */
+static struct GNUNET_FUSE_Job *running_tail;
+
+/**
+ * Number of running jobs, per priority class.
+ */
+static unsigned int running[NUM_CLASSES];
+
+/**
+ * Number of running jobs.
+ */
+static unsigned int running_total;
+
+/**
+ * Number of running jobs that were preempted but did not yet
+ * release their slot.
+ */
+static unsigned int preempting;
+
+/**
+ * Number of download slots.
+ */
+static unsigned int max_slots;
+
+/**
+ * GNUNET_YES once background downloads were stopped.
+ */
+static int background_stopped;
+
+/**
+ * Lock for all of the above.
+ */
+static struct GNUNET_Mutex *lock;
+
+/**
+ * Broadcast whenever a slot is granted or released.
+ */
+static struct GNUNET_Cond *cond;
+
+/**
+ * How long jobs of each class may wait before their deadline
+ * passes; jobs that were queued earlier thus go first within a
+ * class, unless they were queued with more slack.
+ */
+static const unsigned long long class_delay_ms[NUM_CLASSES] = {
+  0, 1000, 60 * 1000
+};
+
+
+/**
+ * Is the given class speculative (and thus may be stopped)?
+ *
+ * @param priority class to test
+ * @return GNUNET_YES for readahead and background downloads
+ */
+static int
+is_speculative (enum GNUNET_FUSE_DownloadPriority priority)
+{
+  return (GNUNET_FUSE_DOWNLOAD_FOREGROUND != priority) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Preempt a running background job.  Caller must hold the lock.
+ *
+ * @param job job to preempt
+ */
+static void
+preempt (struct GNUNET_FUSE_Job *job)
+{
+  job->preempted = GNUNET_YES;
+  preempting++;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Preempting background download %u\n",
+	      (unsigned int) job->pid);
+  /* if the download was not started yet, 'GNUNET_FUSE_scheduler_started'
+     will stop it at once */
+  if (0 != job->pid)
+    (void) kill (job->pid, SIGTERM);
+}
+
+
+/**
+ * Hand out free slots to waiting jobs and preempt background jobs
+ * if foreground jobs are waiting for a slot.  Caller must hold the
+ * lock.
+ */
+static void
+schedule ()
+{
+  struct GNUNET_FUSE_Job *job;
+  struct GNUNET_FUSE_Job *pos;
+  unsigned int c;
+  unsigned int waiting;
+  int changed;
+
+  changed = GNUNET_NO;
+  while (running_total < max_slots)
+  {
+    for (c = 0; c < NUM_CLASSES; c++)
+      if (0 != GNUNET_CONTAINER_heap_get_size (queues[c]))
+	break;
+    if (NUM_CLASSES == c)
+      break;
+    /* keep one slot for foreground downloads */
+    if ( (GNUNET_FUSE_DOWNLOAD_BACKGROUND == c) &&
+	 (max_slots > 1) &&
+	 (running_total + 1 >= max_slots) )
+      break;
+    job = GNUNET_CONTAINER_heap_remove_root (queues[c]);
+    job->hn = NULL;
+    job->granted = GNUNET_YES;
+    GNUNET_CONTAINER_DLL_insert (running_head,
+				 running_tail,
+				 job);
+    running[c]++;
+    running_total++;
+    changed = GNUNET_YES;
+  }
+  waiting = GNUNET_CONTAINER_heap_get_size (queues[GNUNET_FUSE_DOWNLOAD_FOREGROUND]);
+  while (waiting > preempting)
+  {
+    /* preempt the background job with the latest deadline */
+    job = NULL;
+    for (pos = running_head; NULL != pos; pos = pos->next)
+      if ( (GNUNET_FUSE_DOWNLOAD_BACKGROUND == pos->priority) &&
+	   (GNUNET_YES != pos->preempted) &&
+	   ( (NULL == job) ||
+	     (pos->deadline.abs_value_us > job->deadline.abs_value_us) ) )
+	job = pos;
+    if (NULL == job)
+      break;
+    preempt (job);
+  }
+  if (GNUNET_YES == changed)
+    GNUNET_cond_broadcast (cond);
+}
+
+
+/**
+ * Setup the scheduler.
+ *
+ * @param slots number of downloads that may run at the same time
+ */
+void
+GNUNET_FUSE_scheduler_init (unsigned int slots)
+{
+  unsigned int c;
+
+  max_slots = GNUNET_MAX (1, slots);
+  for (c = 0; c < NUM_CLASSES; c++)
+    queues[c] = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  background_stopped = GNUNET_NO;
+  lock = GNUNET_mutex_create (GNUNET_NO);
+  cond = GNUNET_cond_create ();
+}
+
+
+/**
+ * Compute the deadline of a job queued now.
+ *
+ * @param priority priority of the job
+ * @return deadline for the job
+ */
+static struct GNUNET_TIME_Absolute
+get_deadline (enum GNUNET_FUSE_DownloadPriority priority)
+{
+  return GNUNET_TIME_relative_to_absolute (GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+									  class_delay_ms[priority]));
+}
+
+
+/**
+ * Queue a download.  Slots are given to foreground downloads first,
+ * then to readahead and finally to background downloads; in each
+ * class, the download with the earliest deadline goes first.
+ *
+ * @param priority priority of the download
+ * @return the job waiting for a slot
+ */
+struct GNUNET_FUSE_Job *
+GNUNET_FUSE_scheduler_enqueue (enum GNUNET_FUSE_DownloadPriority priority)
+{
+  struct GNUNET_FUSE_Job *job;
+
+  job = GNUNET_new (struct GNUNET_FUSE_Job);
+  job->priority = priority;
+  job->deadline = get_deadline (priority);
+  GNUNET_mutex_lock (lock);
+  job->hn = GNUNET_CONTAINER_heap_insert (queues[priority],
+					  job,
+					  job->deadline.abs_value_us);
+  schedule ();
+  GNUNET_mutex_unlock (lock);
+  return job;
+}
+
+
+/**
+ * Take a free slot for a duplicate of a running download (see
+ * gfs_download.c), without waiting.  Like background downloads,
+ * duplicates never take the last free slot and never overtake
+ * queued downloads of the same or a higher priority.
+ *
+ * @param priority priority of the download
+ * @return job holding a slot, NULL if no slot is free
+ */
+struct GNUNET_FUSE_Job *
+GNUNET_FUSE_scheduler_try_acquire (enum GNUNET_FUSE_DownloadPriority priority)
+{
+  struct GNUNET_FUSE_Job *job;
+  unsigned int c;
+
+  GNUNET_mutex_lock (lock);
+  if ( (running_total + 1 >= max_slots) ||
+       ( (GNUNET_YES == background_stopped) &&
+	 (GNUNET_YES == is_speculative (priority)) ) )
+  {
+    GNUNET_mutex_unlock (lock);
+    return NULL;
+  }
+  for (c = 0; c <= priority; c++)
+    if (0 != GNUNET_CONTAINER_heap_get_size (queues[c]))
+    {
+      GNUNET_mutex_unlock (lock);
+      return NULL;
+    }
+  job = GNUNET_new (struct GNUNET_FUSE_Job);
+  job->priority = priority;
+  job->deadline = GNUNET_TIME_absolute_get ();
+  job->granted = GNUNET_YES;
+  GNUNET_CONTAINER_DLL_insert (running_head,
+			       running_tail,
+			       job);
+  running[priority]++;
+  running_total++;
+  GNUNET_mutex_unlock (lock);
+  return job;
+}
+
+
+/**
+ * Wait until a job was given a slot.
+ *
+ * @param job the job
+ * @return GNUNET_OK once the job has a slot, GNUNET_SYSERR if
+ *         the job was cancelled or background downloads were
+ *         stopped (the job must still be released)
+ */
+int
+GNUNET_FUSE_scheduler_wait (struct GNUNET_FUSE_Job *job)
+{
+  GNUNET_mutex_lock (lock);
+  while (GNUNET_YES != job->granted)
+  {
+    if ( (GNUNET_YES == job->cancelled) ||
+	 ( (GNUNET_YES == background_stopped) &&
+	   (GNUNET_YES == is_speculative (job->priority)) ) )
+    {
+      GNUNET_mutex_unlock (lock);
+      return GNUNET_SYSERR;
+    }
+    GNUNET_cond_wait (cond, lock);
+  }
+  GNUNET_mutex_unlock (lock);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Raise the priority of a job (i.e. because a foreground operation
+ * now waits for a readahead download).
+ *
+ * @param job the job
+ * @param priority new priority, ignored if not higher than the
+ *        current priority of the job
+ */
+void
+GNUNET_FUSE_scheduler_boost (struct GNUNET_FUSE_Job *job,
+			     enum GNUNET_FUSE_DownloadPriority priority)
+{
+  struct GNUNET_TIME_Absolute deadline;
+
+  GNUNET_mutex_lock (lock);
+  if (priority >= job->priority)
+  {
+    GNUNET_mutex_unlock (lock);
+    return;
+  }
+  deadline = GNUNET_TIME_absolute_min (job->deadline,
+				       get_deadline (priority));
+  if (NULL != job->hn)
+  {
+    GNUNET_CONTAINER_heap_remove_node (job->hn);
+    job->hn = GNUNET_CONTAINER_heap_insert (queues[priority],
+					    job,
+					    deadline.abs_value_us);
+  }
+  else if (GNUNET_YES == job->granted)
+  {
+    running[job->priority]--;
+    running[priority]++;
+  }
+  job->priority = priority;
+  job->deadline = deadline;
+  schedule ();
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Tell the scheduler which process performs the download for a job,
+ * so that background downloads can be preempted.
+ *
+ * @param job the job
+ * @param pid process downloading for 'job'
+ */
+void
+GNUNET_FUSE_scheduler_started (struct GNUNET_FUSE_Job *job,
+			       pid_t pid)
+{
+  GNUNET_mutex_lock (lock);
+  job->pid = pid;
+  if (GNUNET_YES == job->preempted)
+    (void) kill (pid, SIGTERM);
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Tell the scheduler that the process of a job terminated, before
+ * it is reaped: afterwards its ID may be reused by another process,
+ * which preemption must not signal.
+ *
+ * @param job the job
+ */
+void
+GNUNET_FUSE_scheduler_exited (struct GNUNET_FUSE_Job *job)
+{
+  GNUNET_mutex_lock (lock);
+  job->pid = 0;
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Give up the slot of a job (after the download process terminated)
+ * or stop waiting for one.
+ *
+ * @param job job to release
+ * @return GNUNET_YES if the job was preempted and should be retried,
+ *         GNUNET_NO if not
+ */
+int
+GNUNET_FUSE_scheduler_release (struct GNUNET_FUSE_Job *job)
+{
+  int ret;
+
+  GNUNET_mutex_lock (lock);
+  if (NULL != job->hn)
+  {
+    GNUNET_CONTAINER_heap_remove_node (job->hn);
+    job->hn = NULL;
+    ret = GNUNET_NO;
+  }
+  else
+  {
+    GNUNET_CONTAINER_DLL_remove (running_head,
+				 running_tail,
+				 job);
+    running[job->priority]--;
+    running_total--;
+    ret = job->preempted;
+    if (GNUNET_YES == ret)
+      preempting--;
+  }
+  if (GNUNET_YES == background_stopped)
+    ret = GNUNET_NO;
+  schedule ();
+  /* wake up 'GNUNET_FUSE_scheduler_wait_idle' */
+  GNUNET_cond_broadcast (cond);
+  GNUNET_mutex_unlock (lock);
+  GNUNET_free (job);
+  return ret;
+}
+
+
+/**
+ * Cancel a job that waits for a slot, 'GNUNET_FUSE_scheduler_wait'
+ * then returns GNUNET_SYSERR (the job must still be released).
+ * Does not affect jobs that hold a slot.
+ *
+ * @param job the job
+ */
+void
+GNUNET_FUSE_scheduler_cancel (struct GNUNET_FUSE_Job *job)
+{
+  GNUNET_mutex_lock (lock);
+  job->cancelled = GNUNET_YES;
+  GNUNET_cond_broadcast (cond);
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Test if downloads of a priority class were stopped.
+ *
+ * @param priority priority of the download
+ * @return GNUNET_YES if the download is speculative and background
+ *         downloads were stopped
+ */
+int
+GNUNET_FUSE_scheduler_stopped (enum GNUNET_FUSE_DownloadPriority priority)
+{
+  int ret;
+
+  GNUNET_mutex_lock (lock);
+  ret = ( (GNUNET_YES == background_stopped) &&
+	  (GNUNET_YES == is_speculative (priority)) ) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_mutex_unlock (lock);
+  return ret;
+}
+
+
+/**
+ * Wait until no foreground download is queued or running.
+ */
+void
+GNUNET_FUSE_scheduler_wait_idle ()
+{
+  GNUNET_mutex_lock (lock);
+  while ( (GNUNET_YES != background_stopped) &&
+	  ( (0 != running[GNUNET_FUSE_DOWNLOAD_FOREGROUND]) ||
+	    (0 != GNUNET_CONTAINER_heap_get_size (queues[GNUNET_FUSE_DOWNLOAD_FOREGROUND])) ) )
+    GNUNET_cond_wait (cond, lock);
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Stop all background downloads; further background downloads fail.
+ */
+void
+GNUNET_FUSE_scheduler_stop_background ()
+{
+  struct GNUNET_FUSE_Job *pos;
+
+  GNUNET_mutex_lock (lock);
+  background_stopped = GNUNET_YES;
+  for (pos = running_head; NULL != pos; pos = pos->next)
+    if ( (GNUNET_YES == is_speculative (pos->priority)) &&
+	 (GNUNET_YES != pos->preempted) )
+      preempt (pos);
+  GNUNET_cond_broadcast (cond);
+  GNUNET_mutex_unlock (lock);
+}
+
+
+/**
+ * Shutdown the scheduler.  No jobs may be left.
+ */
+void
+GNUNET_FUSE_scheduler_done ()
+{
+  unsigned int c;
+
+  GNUNET_break (NULL == running_head);
+  for (c = 0; c < NUM_CLASSES; c++)
+  {
+    GNUNET_break (0 == GNUNET_CONTAINER_heap_get_size (queues[c]));
+    GNUNET_CONTAINER_heap_destroy (queues[c]);
+    queues[c] = NULL;
+  }
+  GNUNET_cond_destroy (cond);
+  cond = NULL;
+  GNUNET_mutex_destroy (lock);
+  lock = NULL;
+}
+
+/* end of gfs_scheduler.c */
@@ -0,0 +1,171 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_scheduler.h
+ * @brief assignment of download slots by priority and deadline
+ */
+#ifndef GFS_SCHEDULER_H
+#define GFS_SCHEDULER_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * A download waiting for or holding a slot.
+ */
+struct GNUNET_FUSE_Job;
+
+
+/**
+ * Setup the scheduler.
+ *
+ * @param slots number of downloads that may run at the same time
+ */
+void
+GNUNET_FUSE_scheduler_init (unsigned int slots);
+
+
+/**
+ * Queue a download.  Slots are given to foreground downloads first,
+ * then to readahead and finally to background downloads; in each
+ * class, the download with the earliest deadline goes first.
+ *
+ * @param priority priority of the download
+ * @return the job waiting for a slot
+ */
+struct GNUNET_FUSE_Job *
+GNUNET_FUSE_scheduler_enqueue (enum GNUNET_FUSE_DownloadPriority priority);
+
+
+/**
+ * Take a free slot for a duplicate of a running download (see
+ * gfs_download.c), without waiting.  Like background downloads,
+ * duplicates never take the last free slot and never overtake
+ * queued downloads of the same or a higher priority.
+ *
+ * @param priority priority of the download
+ * @return job holding a slot, NULL if no slot is free
+ */
+struct GNUNET_FUSE_Job *
+GNUNET_FUSE_scheduler_try_acquire (enum GNUNET_FUSE_DownloadPriority priority);
+
+
+/**
+ * Wait until a job was given a slot.
+ *
+ * @param job the job
+ * @return GNUNET_OK once the job has a slot, GNUNET_SYSERR if
+ *         the job was cancelled or background downloads were
+ *         stopped (the job must still be released)
+ */
+int
+GNUNET_FUSE_scheduler_wait (struct GNUNET_FUSE_Job *job);
+
+
+/**
+ * Raise the priority of a job (i.e. because a foreground operation
+ * now waits for a readahead download).
+ *
+ * @param job the job
+ * @param priority new priority, ignored if not higher than the
+ *        current priority of the job
+ */
+void
+GNUNET_FUSE_scheduler_boost (struct GNUNET_FUSE_Job *job,
+                             enum GNUNET_FUSE_DownloadPriority priority);
+
+
+/**
+ * Tell the scheduler which process performs the download for a job,
+ * so that background downloads can be preempted.
+ *
+ * @param job the job
+ * @param pid process downloading for 'job'
+ */
+void
+GNUNET_FUSE_scheduler_started (struct GNUNET_FUSE_Job *job,
+                               pid_t pid);
+
+
+/**
+ * Tell the scheduler that the process of a job terminated, before
+ * it is reaped: afterwards its ID may be reused by another process,
+ * which preemption must not signal.
+ *
+ * @param job the job
+ */
+void
+GNUNET_FUSE_scheduler_exited (struct GNUNET_FUSE_Job *job);
+
+
+/**
+ * Give up the slot of a job (after the download process terminated)
+ * or stop waiting for one.
+ *
+ * @param job job to release
+ * @return GNUNET_YES if the job was preempted and should be retried,
+ *         GNUNET_NO if not
+ */
+int
+GNUNET_FUSE_scheduler_release (struct GNUNET_FUSE_Job *job);
+
+
+/**
+ * Cancel a job that waits for a slot, 'GNUNET_FUSE_scheduler_wait'
+ * then returns GNUNET_SYSERR (the job must still be released).
+ * Does not affect jobs that hold a slot.
+ *
+ * @param job the job
+ */
+void
+GNUNET_FUSE_scheduler_cancel (struct GNUNET_FUSE_Job *job);
+
+
+/**
+ * Test if downloads of a priority class were stopped.
+ *
+ * @param priority priority of the download
+ * @return GNUNET_YES if the download is speculative and background
+ *         downloads were stopped
+ */
+int
+GNUNET_FUSE_scheduler_stopped (enum GNUNET_FUSE_DownloadPriority priority);
+
+
+/**
+ * Wait until no foreground download is queued or running.
+ */
+void
+GNUNET_FUSE_scheduler_wait_idle (void);
+
+
+/**
+ * Stop all background downloads; further background downloads fail.
+ */
+void
+GNUNET_FUSE_scheduler_stop_background (void);
+
+
+/**
+ * Shutdown the scheduler.  No jobs may be left.
+ */
+void
+GNUNET_FUSE_scheduler_done (void);
+
+#endif
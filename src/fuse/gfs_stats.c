@@ -0,0 +1,202 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_stats.c
+ * @brief statistics about the operation of gnunet-fuse
+ *
+ * We cannot use the STATISTICS service as the main process does not
+ * run the GNUnet scheduler, so we keep the values ourselves.  They
+ * are logged on exit and can be read from the root of the mount
+ * (see getxattr.c).
+ */
+#include "gfs_stats.h"
+
+
+/**
+ * A statistic.
+ */
+struct Statistic
+{
+
+  /**
+   * This is a DLL.
+   */
+  struct Statistic *next;
+
+  /**
+   * This is a DLL.
+   */
+  struct Statistic *prev;
+
+  /**
+   * Name of the statistic (string constant).
+   */
+  const char *name;
+
+  /**
+   * Current value.
+   */
+  uint64_t value;
+
+};
+
+
+/**
+ * Head of the statistics.
+ */
+static struct Statistic *stats_head;
+
+/**
+ * Tail of the statistics.
+ */
+static struct Statistic *stats_tail;
+
+/**
+ * Lock for the statistics.
+ */
+static struct GNUNET_Mutex *stats_lock;
+
+
+/**
+ * Find (or create) a statistic.  Caller must hold the lock.
+ *
+ * @param name name of the statistic
+ * @return the statistic
+ */
+static struct Statistic *
+get_statistic (const char *name)
+{
+  struct Statistic *pos;
+
+  for (pos = stats_head; NULL != pos; pos = pos->next)
+    if (0 == strcmp (name, pos->name))
+      return pos;
+  pos = GNUNET_new (struct Statistic);
+  pos->name = name;
+  GNUNET_CONTAINER_DLL_insert_tail (stats_head,
+				    stats_tail,
+				    pos);
+  return pos;
+}
+
+
+/**
+ * Setup the statistics.
+ */
+void
+GNUNET_FUSE_stats_init ()
+{
+  stats_lock = GNUNET_mutex_create (GNUNET_NO);
+}
+
+
+/**
+ * Change a statistic.  Statistics that were never set start at 0.
+ *
+ * @param name name of the statistic, must be a string constant
+ *        (i.e. gettext_noop ("# bytes downloaded"))
+ * @param delta amount to add
+ */
+void
+GNUNET_FUSE_stats_update (const char *name,
+			  int64_t delta)
+{
+  struct Statistic *s;
+
+  GNUNET_mutex_lock (stats_lock);
+  s = get_statistic (name);
+  if ( (delta < 0) &&
+       (s->value < (uint64_t) - delta) )
+    s->value = 0;
+  else
+    s->value += delta;
+  GNUNET_mutex_unlock (stats_lock);
+}
+
+
+/**
+ * Set a statistic to a value.
+ *
+ * @param name name of the statistic, must be a string constant
+ * @param value new value
+ */
+void
+GNUNET_FUSE_stats_set (const char *name,
+		       uint64_t value)
+{
+  GNUNET_mutex_lock (stats_lock);
+  get_statistic (name)->value = value;
+  GNUNET_mutex_unlock (stats_lock);
+}
+
+
+/**
+ * Get all statistics in human-readable form, one per line.
+ *
+ * @return the statistics (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_stats_to_string ()
+{
+  struct Statistic *pos;
+  char *ret;
+  char *tmp;
+
+  ret = GNUNET_strdup ("");
+  GNUNET_mutex_lock (stats_lock);
+  for (pos = stats_head; NULL != pos; pos = pos->next)
+  {
+    GNUNET_asprintf (&tmp,
+		     "%s%-40s: %12llu\n",
+		     ret,
+		     _(pos->name),
+		     (unsigned long long) pos->value);
+    GNUNET_free (ret);
+    ret = tmp;
+  }
+  GNUNET_mutex_unlock (stats_lock);
+  return ret;
+}
+
+
+/**
+ * Log all statistics and shutdown.
+ */
+void
+GNUNET_FUSE_stats_done ()
+{
+  struct Statistic *pos;
+
+  while (NULL != (pos = stats_head))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+		"%s: %llu\n",
+		_(pos->name),
+		(unsigned long long) pos->value);
+    GNUNET_CONTAINER_DLL_remove (stats_head,
+				 stats_tail,
+				 pos);
+    GNUNET_free (pos);
+  }
+  GNUNET_mutex_destroy (stats_lock);
+  stats_lock = NULL;
+}
+
+/* end of gfs_stats.c */
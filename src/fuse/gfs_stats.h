@@ -0,0 +1,74 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_stats.h
+ * @brief statistics about the operation of gnunet-fuse
+ */
+#ifndef GFS_STATS_H
+#define GFS_STATS_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Setup the statistics.
+ */
+void
+GNUNET_FUSE_stats_init (void);
+
+
+/**
+ * Change a statistic.  Statistics that were never set start at 0.
+ *
+ * @param name name of the statistic, must be a string constant
+ *        (i.e. gettext_noop ("# bytes downloaded"))
+ * @param delta amount to add
+ */
+void
+GNUNET_FUSE_stats_update (const char *name,
+                          int64_t delta);
+
+
+/**
+ * Set a statistic to a value.
+ *
+ * @param name name of the statistic, must be a string constant
+ * @param value new value
+ */
+void
+GNUNET_FUSE_stats_set (const char *name,
+                       uint64_t value);
+
+
+/**
+ * Get all statistics in human-readable form, one per line.
+ *
+ * @return the statistics (to be freed by the caller)
+ */
+char *
+GNUNET_FUSE_stats_to_string (void);
+
+
+/**
+ * Log all statistics and shutdown.
+ */
+void
+GNUNET_FUSE_stats_done (void);
+
+#endif
@@ -0,0 +1,490 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_verify.c
+ * @brief checking local copies of content against their CHK
+ *
+ * We encode the copy like a publisher would: each block of data is
+ * encrypted with the hash of its plaintext ("key") and identified
+ * by the hash of its ciphertext ("query"); inner blocks hold the
+ * keys and queries of up to CHK_PER_INODE blocks below them.  The
+ * copy is intact if the key and query of the top block match the
+ * URI.
+ *
+ * The data blocks below each inner block of the lowest level form a
+ * unit of work.  Threads take the next unit of the first file that
+ * still has some whenever they are idle, so small and large files
+ * keep all CPUs busy.  Whoever finishes the last unit of a file
+ * encodes the (few) upper levels of its tree.
+ */
+#include "gfs_verify.h"
+#include "gfs_download.h"
+#include <pthread.h>
+
+
+/**
+ * Number of keys and queries in an inner block.
+ */
+#define CHK_PER_INODE 256
+
+/**
+ * Maximum number of threads we use.
+ */
+#define MAX_THREADS 64
+
+
+/**
+ * Key and query of a block (like FS encodes them in inner blocks).
+ */
+struct ContentHashKey
+{
+
+  /**
+   * Hash of the plaintext of the block.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Hash of the ciphertext of the block.
+   */
+  struct GNUNET_HashCode query;
+
+};
+
+
+/**
+ * State of checking one file.
+ */
+struct FileState
+{
+
+  /**
+   * The file we check.
+   */
+  struct GNUNET_FUSE_VerifyFile *vf;
+
+  /**
+   * Key and query of the top block according to the URI.
+   */
+  struct ContentHashKey expected;
+
+  /**
+   * Keys and queries of the inner blocks of the lowest level (or
+   * of the only block of a file with a single block).
+   */
+  struct ContentHashKey *units;
+
+  /**
+   * Size of the file.
+   */
+  uint64_t size;
+
+  /**
+   * Number of data blocks of the file.
+   */
+  uint64_t num_blocks;
+
+  /**
+   * Number of entries in 'units'.
+   */
+  uint64_t num_units;
+
+  /**
+   * Next unit no thread took yet.
+   */
+  uint64_t next_unit;
+
+  /**
+   * Number of units no thread finished yet.
+   */
+  uint64_t pending;
+
+  /**
+   * Open handle of the file.
+   */
+  int fd;
+
+  /**
+   * GNUNET_YES if we failed to read the file.
+   */
+  int failed;
+
+};
+
+
+/**
+ * Work shared by the threads.
+ */
+struct Pool
+{
+
+  /**
+   * Protects the other fields and the units of the files.
+   */
+  struct GNUNET_Mutex *lock;
+
+  /**
+   * Files we check.
+   */
+  struct FileState *files;
+
+  /**
+   * Number of entries in 'files'.
+   */
+  unsigned int num_files;
+
+  /**
+   * First file that has units no thread took yet.
+   */
+  unsigned int next_file;
+
+  /**
+   * Function to call once a file was checked, can be NULL.
+   */
+  GNUNET_FUSE_VerifyCallback cb;
+
+  /**
+   * Closure for 'cb'.
+   */
+  void *cb_cls;
+
+};
+
+
+/**
+ * Encode a block and compute its key and query.
+ *
+ * @param data plaintext of the block
+ * @param size number of bytes in the block
+ * @param enc buffer for the ciphertext (at least 'size' bytes)
+ * @param chk set to the key and query of the block
+ */
+static void
+encode_block (const void *data,
+	      size_t size,
+	      void *enc,
+	      struct ContentHashKey *chk)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey skey;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+
+  GNUNET_CRYPTO_hash (data, size, &chk->key);
+  GNUNET_CRYPTO_hash_to_aes_key (&chk->key, &skey, &iv);
+  GNUNET_CRYPTO_symmetric_encrypt (data, size, &skey, &iv, enc);
+  GNUNET_CRYPTO_hash (enc, size, &chk->query);
+}
+
+
+/**
+ * Get the key and query of the top block from a URI.
+ *
+ * @param uri the URI
+ * @param chk set to the key and query
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the URI
+ *         is not a CHK URI
+ */
+static int
+get_expected (const struct GNUNET_FS_Uri *uri,
+	      struct ContentHashKey *chk)
+{
+  static const char prefix[] = GNUNET_FS_URI_PREFIX GNUNET_FS_URI_CHK_INFIX;
+  const size_t enclen = sizeof (struct GNUNET_CRYPTO_HashAsciiEncoded) - 1;
+  char *us;
+  int ret;
+
+  us = GNUNET_FS_uri_to_string (uri);
+  ret = GNUNET_SYSERR;
+  if ( (GNUNET_YES == GNUNET_FS_uri_test_chk (uri)) &&
+       (strlen (us) > strlen (prefix) + 2 * enclen + 1) &&
+       (0 == strncmp (us, prefix, strlen (prefix))) &&
+       ('.' == us[strlen (prefix) + enclen]) &&
+       (GNUNET_OK == GNUNET_CRYPTO_hash_from_string2 (&us[strlen (prefix)],
+						      enclen,
+						      &chk->key)) &&
+       (GNUNET_OK == GNUNET_CRYPTO_hash_from_string2 (&us[strlen (prefix) + enclen + 1],
+						      enclen,
+						      &chk->query)) )
+    ret = GNUNET_OK;
+  GNUNET_free (us);
+  return ret;
+}
+
+
+/**
+ * Encode the data blocks of a unit and the inner block above them.
+ *
+ * @param fs the file
+ * @param unit number of the unit
+ * @param buf buffer for the plaintext of a block
+ * @param enc buffer for the ciphertext of a block
+ * @param chk set to the key and query of the inner block (or of
+ *        the only block of the file)
+ * @return GNUNET_OK on success, GNUNET_SYSERR if reading failed
+ */
+static int
+encode_unit (const struct FileState *fs,
+	     uint64_t unit,
+	     char *buf,
+	     char *enc,
+	     struct ContentHashKey *chk)
+{
+  struct ContentHashKey chks[CHK_PER_INODE];
+  uint64_t block;
+  uint64_t offset;
+  size_t size;
+  unsigned int num;
+  unsigned int i;
+
+  block = unit * CHK_PER_INODE;
+  num = (unsigned int) GNUNET_MIN (CHK_PER_INODE,
+				   fs->num_blocks - block);
+  for (i = 0; i < num; i++)
+  {
+    offset = (block + i) * GNUNET_FUSE_BLOCK_SIZE;
+    size = (size_t) GNUNET_MIN (GNUNET_FUSE_BLOCK_SIZE,
+				fs->size - offset);
+    if (size != pread (fs->fd, buf, size, offset))
+      return GNUNET_SYSERR;
+    encode_block (buf, size, enc, &chks[i]);
+  }
+  if (1 == fs->num_blocks)
+    *chk = chks[0];
+  else
+    encode_block (chks, num * sizeof (struct ContentHashKey), enc, chk);
+  return GNUNET_OK;
+}
+
+
+/**
+ * All units of a file are done: encode the upper levels of its tree,
+ * compare the top block with the URI, close the file and report
+ * the result.
+ *
+ * @param pool the pool the file belongs to
+ * @param fs the file
+ */
+static void
+finish_file (struct Pool *pool,
+	     struct FileState *fs)
+{
+  struct ContentHashKey *level = fs->units;
+  char *enc;
+  uint64_t num;
+  uint64_t i;
+
+  if (GNUNET_YES == fs->failed)
+  {
+    fs->vf->result = GNUNET_SYSERR;
+  }
+  else
+  {
+    enc = GNUNET_malloc (GNUNET_FUSE_BLOCK_SIZE);
+    /* the blocks of the next level replace the ones they hold */
+    for (num = fs->num_units; num > 1; num = (num + CHK_PER_INODE - 1) / CHK_PER_INODE)
+      for (i = 0; i * CHK_PER_INODE < num; i++)
+	encode_block (&level[i * CHK_PER_INODE],
+		      GNUNET_MIN (CHK_PER_INODE, num - i * CHK_PER_INODE)
+		      * sizeof (struct ContentHashKey),
+		      enc,
+		      &level[i]);
+    GNUNET_free (enc);
+    fs->vf->result = (0 == memcmp (&level[0],
+				   &fs->expected,
+				   sizeof (struct ContentHashKey)))
+      ? GNUNET_YES : GNUNET_NO;
+    /* a copy we vouch for must survive the next crash */
+    if ( (GNUNET_YES == fs->vf->result) &&
+	 (0 != fsync (fs->fd)) )
+      fs->vf->result = GNUNET_SYSERR;
+  }
+  GNUNET_break (0 == close (fs->fd));
+  fs->fd = -1;
+  GNUNET_free (fs->units);
+  fs->units = NULL;
+  if (NULL != pool->cb)
+    pool->cb (pool->cb_cls, fs->vf);
+}
+
+
+/**
+ * Take the next unit of work.  Caller must hold the lock of the pool.
+ *
+ * @param pool the pool
+ * @param fs set to the file of the unit
+ * @param unit set to the number of the unit
+ * @return GNUNET_NO if all units were taken
+ */
+static int
+take_unit (struct Pool *pool,
+	   struct FileState **fs,
+	   uint64_t *unit)
+{
+  struct FileState *f;
+
+  for (; pool->next_file < pool->num_files; pool->next_file++)
+  {
+    f = &pool->files[pool->next_file];
+    if (f->next_unit == f->num_units)
+      continue;
+    *fs = f;
+    *unit = f->next_unit++;
+    return GNUNET_YES;
+  }
+  return GNUNET_NO;
+}
+
+
+/**
+ * Main function of the threads checking files.
+ *
+ * @param cls the 'struct Pool'
+ * @return NULL
+ */
+static void *
+worker (void *cls)
+{
+  struct Pool *pool = cls;
+  struct FileState *fs;
+  struct ContentHashKey chk;
+  char *buf;
+  char *enc;
+  uint64_t unit;
+  int ret;
+
+  buf = GNUNET_malloc (GNUNET_FUSE_BLOCK_SIZE);
+  enc = GNUNET_malloc (GNUNET_FUSE_BLOCK_SIZE);
+  GNUNET_mutex_lock (pool->lock);
+  while (GNUNET_YES == take_unit (pool, &fs, &unit))
+  {
+    GNUNET_mutex_unlock (pool->lock);
+    ret = encode_unit (fs, unit, buf, enc, &chk);
+    GNUNET_mutex_lock (pool->lock);
+    if (GNUNET_OK == ret)
+      fs->units[unit] = chk;
+    else
+      fs->failed = GNUNET_YES;
+    if (0 != --fs->pending)
+      continue;
+    /* nobody else touches the file anymore */
+    GNUNET_mutex_unlock (pool->lock);
+    finish_file (pool, fs);
+    GNUNET_mutex_lock (pool->lock);
+  }
+  GNUNET_mutex_unlock (pool->lock);
+  GNUNET_free (buf);
+  GNUNET_free (enc);
+  return NULL;
+}
+
+
+/**
+ * Check local copies of content by encoding them again and comparing
+ * the resulting CHK with their URI.  Uses one thread per CPU.
+ *
+ * @param files the copies to check
+ * @param num number of entries in 'files'
+ * @param cb function to call as soon as each copy was checked,
+ *        can be NULL
+ * @param cb_cls closure for 'cb'
+ */
+void
+GNUNET_FUSE_verify_files (struct GNUNET_FUSE_VerifyFile *files,
+			  unsigned int num,
+			  GNUNET_FUSE_VerifyCallback cb,
+			  void *cb_cls)
+{
+  pthread_t threads[MAX_THREADS];
+  struct Pool pool;
+  struct FileState *fs;
+  struct stat sbuf;
+  unsigned int num_threads;
+  unsigned int i;
+  long cpus;
+
+  memset (&pool, 0, sizeof (pool));
+  pool.cb = cb;
+  pool.cb_cls = cb_cls;
+  pool.files = GNUNET_malloc (num * sizeof (struct FileState) + 1);
+  for (i = 0; i < num; i++)
+  {
+    fs = &pool.files[pool.num_files];
+    fs->vf = &files[i];
+    files[i].result = GNUNET_SYSERR;
+    if ( (GNUNET_OK != get_expected (files[i].uri, &fs->expected)) ||
+	 (-1 == (fs->fd = open (files[i].filename, O_RDONLY))) )
+    {
+      if (NULL != cb)
+	cb (cb_cls, &files[i]);
+      continue;
+    }
+    if ( (0 != fstat (fs->fd, &sbuf)) ||
+	 ((uint64_t) sbuf.st_size != GNUNET_FS_uri_chk_get_file_size (files[i].uri)) )
+    {
+      files[i].result = GNUNET_NO;
+      GNUNET_break (0 == close (fs->fd));
+      if (NULL != cb)
+	cb (cb_cls, &files[i]);
+      continue;
+    }
+    if (0 == sbuf.st_size)
+    {
+      files[i].result = GNUNET_YES;
+      GNUNET_break (0 == close (fs->fd));
+      if (NULL != cb)
+	cb (cb_cls, &files[i]);
+      continue;
+    }
+    fs->size = (uint64_t) sbuf.st_size;
+    fs->num_blocks = (fs->size + GNUNET_FUSE_BLOCK_SIZE - 1) / GNUNET_FUSE_BLOCK_SIZE;
+    fs->num_units = (fs->num_blocks + CHK_PER_INODE - 1) / CHK_PER_INODE;
+    fs->pending = fs->num_units;
+    fs->units = GNUNET_malloc (fs->num_units * sizeof (struct ContentHashKey));
+    pool.num_files++;
+  }
+  if (0 == pool.num_files)
+  {
+    GNUNET_free (pool.files);
+    return;
+  }
+  pool.lock = GNUNET_mutex_create (GNUNET_NO);
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  num_threads = (unsigned int) GNUNET_MAX (1, GNUNET_MIN (cpus, MAX_THREADS));
+  for (i = 0; i < num_threads; i++)
+  {
+    if (0 == (errno = pthread_create (&threads[i],
+				      NULL,
+				      &worker,
+				      &pool)))
+      continue;
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+			 "pthread_create");
+    break;
+  }
+  num_threads = i;
+  /* without threads we check the files ourselves */
+  if (0 == num_threads)
+    worker (&pool);
+  for (i = 0; i < num_threads; i++)
+    GNUNET_break (0 == pthread_join (threads[i], NULL));
+  GNUNET_mutex_destroy (pool.lock);
+  GNUNET_free (pool.files);
+}
+
+/* end of gfs_verify.c */
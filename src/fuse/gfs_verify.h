@@ -0,0 +1,83 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_verify.h
+ * @brief checking local copies of content against their CHK
+ */
+#ifndef GFS_VERIFY_H
+#define GFS_VERIFY_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * A local copy of content to check.
+ */
+struct GNUNET_FUSE_VerifyFile
+{
+
+  /**
+   * Name of the file with the copy.
+   */
+  const char *filename;
+
+  /**
+   * URI of the content.
+   */
+  const struct GNUNET_FS_Uri *uri;
+
+  /**
+   * Set to GNUNET_YES if the copy matches the URI (it is then
+   * also written to disk), GNUNET_NO if it does not and
+   * GNUNET_SYSERR if it could not be checked.
+   */
+  int result;
+
+};
+
+
+/**
+ * Function called once the result of checking a copy is known.  May
+ * be called from several threads at the same time.
+ *
+ * @param cls closure
+ * @param vf the copy, its 'result' is set
+ */
+typedef void
+(*GNUNET_FUSE_VerifyCallback) (void *cls,
+			       const struct GNUNET_FUSE_VerifyFile *vf);
+
+
+/**
+ * Check local copies of content by encoding them again and comparing
+ * the resulting CHK with their URI.  Uses one thread per CPU.
+ *
+ * @param files the copies to check
+ * @param num number of entries in 'files'
+ * @param cb function to call as soon as each copy was checked,
+ *        can be NULL
+ * @param cb_cls closure for 'cb'
+ */
+void
+GNUNET_FUSE_verify_files (struct GNUNET_FUSE_VerifyFile *files,
+			  unsigned int num,
+			  GNUNET_FUSE_VerifyCallback cb,
+			  void *cb_cls);
+
+#endif
@@ -0,0 +1,618 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_warmup.c
+ * @brief fetching the paths listed in a manifest after mounting
+ *
+ * The manifest lists the paths (or shell patterns matching paths) of
+ * the mount to fetch, one per line:
+ *
+ *   PRIORITY PATTERN [OFFSET:[LENGTH]]
+ *
+ * Entries are fetched in order of decreasing priority.  Directories
+ * that match are fetched with everything below them; for files that
+ * match, only the given range is fetched if there is one.  Empty
+ * lines and lines starting with '#' are ignored.
+ *
+ * After mounting, a single thread walks the entries and starts
+ * background downloads for the matching files, keeping a limited
+ * number of them pending, and waits for all of them before moving on
+ * to the next entry.  Progress is logged and kept in the statistics.
+ */
+#include "gfs_warmup.h"
+#include "gfs_download.h"
+#include "gfs_scheduler.h"
+#include "gfs_stats.h"
+#include <pthread.h>
+#include <fnmatch.h>
+
+
+/**
+ * Maximum number of files with pending downloads.
+ */
+#define WARMUP_WINDOW 16
+
+/**
+ * Maximum length of a line of the manifest.
+ */
+#define MAX_LINE 4096
+
+
+/**
+ * Entry of the manifest.
+ */
+struct Entry
+{
+
+  /**
+   * Pattern for the paths to fetch.
+   */
+  char *pattern;
+
+  /**
+   * Offset of the range to fetch from matching files.
+   */
+  uint64_t offset;
+
+  /**
+   * Length of the range to fetch from matching files.
+   */
+  uint64_t length;
+
+  /**
+   * Priority of the entry, higher is fetched first.
+   */
+  long long priority;
+
+  /**
+   * Line of the entry in the manifest.
+   */
+  unsigned int line;
+
+};
+
+
+/**
+ * File whose download we did not wait for yet.
+ */
+struct Pending
+{
+
+  /**
+   * This is a DLL.
+   */
+  struct Pending *next;
+
+  /**
+   * This is a DLL.
+   */
+  struct Pending *prev;
+
+  /**
+   * The file (we hold a reference).
+   */
+  struct GNUNET_FUSE_PathInfo *pi;
+
+  /**
+   * Offset of the range we requested.
+   */
+  uint64_t offset;
+
+  /**
+   * Length of the range we requested.
+   */
+  uint64_t length;
+
+};
+
+
+/**
+ * Entries of the manifest, sorted by priority.
+ */
+static struct Entry *entries;
+
+/**
+ * Number of entries in 'entries'.
+ */
+static unsigned int num_entries;
+
+/**
+ * Head of the files whose downloads are pending.
+ */
+static struct Pending *pending_head;
+
+/**
+ * Tail of the files whose downloads are pending.
+ */
+static struct Pending *pending_tail;
+
+/**
+ * Number of files whose downloads are pending.
+ */
+static unsigned int num_pending;
+
+/**
+ * The thread fetching the entries.
+ */
+static pthread_t warmer;
+
+/**
+ * GNUNET_YES if 'warmer' was started.
+ */
+static int warmer_started;
+
+/**
+ * Number of bytes requested so far.
+ */
+static uint64_t bytes_requested;
+
+/**
+ * Number of requested bytes that arrived.
+ */
+static uint64_t bytes_done;
+
+
+/**
+ * Compare manifest entries by priority (and by their order in the
+ * manifest for equal priorities).
+ *
+ * @param a first entry
+ * @param b second entry
+ * @return negative if 'a' should be fetched first
+ */
+static int
+compare_entries (const void *a,
+		 const void *b)
+{
+  const struct Entry *ea = a;
+  const struct Entry *eb = b;
+
+  if (ea->priority != eb->priority)
+    return (ea->priority > eb->priority) ? -1 : 1;
+  return (ea->line < eb->line) ? -1 : 1;
+}
+
+
+/**
+ * Parse a line of the manifest.
+ *
+ * @param line the line (modified)
+ * @param e where to store the entry
+ * @return GNUNET_OK on success, GNUNET_NO if the line is empty,
+ *         GNUNET_SYSERR if it is malformed
+ */
+static int
+parse_line (char *line,
+	    struct Entry *e)
+{
+  unsigned long long offset;
+  unsigned long long length;
+  char *tok[4];
+  char *save;
+  char *end;
+  unsigned int n;
+
+  for (n = 0; n < 4; n++)
+    if (NULL == (tok[n] = strtok_r ((0 == n) ? line : NULL,
+				    " \t\r\n",
+				    &save)))
+      break;
+  if ( (0 == n) ||
+       ('#' == tok[0][0]) )
+    return GNUNET_NO;
+  if ( (n < 2) ||
+       (n > 3) ||
+       ('/' != tok[1][0]) )
+    return GNUNET_SYSERR;
+  e->priority = strtoll (tok[0], &end, 10);
+  if ('\0' != *end)
+    return GNUNET_SYSERR;
+  e->offset = 0;
+  e->length = UINT64_MAX;
+  if (3 == n)
+  {
+    if (2 == sscanf (tok[2], "%llu:%llu", &offset, &length))
+      e->length = length;
+    else if ( (1 != sscanf (tok[2], "%llu:", &offset)) ||
+	      (':' != tok[2][strlen (tok[2]) - 1]) )
+      return GNUNET_SYSERR;
+    e->offset = offset;
+  }
+  e->pattern = GNUNET_strdup (tok[1]);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Read the warmup manifest.
+ *
+ * @param filename name of the manifest, NULL for none
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the manifest
+ *         could not be read or is malformed
+ */
+int
+GNUNET_FUSE_warmup_init (const char *filename)
+{
+  struct Entry e;
+  char line[MAX_LINE];
+  FILE *f;
+  unsigned int lno;
+  int ret;
+
+  if (NULL == filename)
+    return GNUNET_OK;
+  if (NULL == (f = fopen (filename, "r")))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+			      "fopen",
+			      filename);
+    return GNUNET_SYSERR;
+  }
+  lno = 0;
+  while (NULL != fgets (line, sizeof (line), f))
+  {
+    lno++;
+    memset (&e, 0, sizeof (e));
+    e.line = lno;
+    if (GNUNET_SYSERR == (ret = parse_line (line, &e)))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		  _("Malformed line %u in warmup manifest `%s'\n"),
+		  lno,
+		  filename);
+      GNUNET_break (0 == fclose (f));
+      GNUNET_FUSE_warmup_done ();
+      return GNUNET_SYSERR;
+    }
+    if (GNUNET_OK == ret)
+      GNUNET_array_append (entries, num_entries, e);
+  }
+  GNUNET_break (0 == fclose (f));
+  qsort (entries,
+	 num_entries,
+	 sizeof (struct Entry),
+	 &compare_entries);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Wait for pending downloads until at most 'keep' are left.
+ *
+ * @param keep number of downloads that may remain pending
+ */
+static void
+drain (unsigned int keep)
+{
+  struct Pending *p;
+  int eno;
+
+  while (num_pending > keep)
+  {
+    p = pending_head;
+    GNUNET_CONTAINER_DLL_remove (pending_head,
+				 pending_tail,
+				 p);
+    num_pending--;
+    if (GNUNET_OK == GNUNET_FUSE_download_file (p->pi,
+						p->offset,
+						p->length,
+						GNUNET_FUSE_DOWNLOAD_BACKGROUND,
+						&eno))
+    {
+      bytes_done += p->length;
+      GNUNET_FUSE_stats_update (gettext_noop ("# warmup bytes done"),
+				p->length);
+    }
+    else
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Failed to warm up `%s': %s\n",
+		  p->pi->filename,
+		  strerror (eno));
+      GNUNET_FUSE_stats_update (gettext_noop ("# warmup files failed"),
+				1);
+    }
+    GNUNET_FUSE_path_info_done (p->pi);
+    GNUNET_free (p);
+  }
+}
+
+
+/**
+ * Fetch a range of a file.
+ *
+ * @param pi the file
+ * @param offset offset of the range
+ * @param length length of the range
+ */
+static void
+fetch_file (struct GNUNET_FUSE_PathInfo *pi,
+	    uint64_t offset,
+	    uint64_t length)
+{
+  struct Pending *p;
+  uint64_t fsize;
+
+  fsize = GNUNET_FS_uri_chk_get_file_size (pi->uri);
+  if (offset >= fsize)
+    return;
+  length = GNUNET_MIN (length, fsize - offset);
+  GNUNET_mutex_lock (pi->lock);
+  GNUNET_mutex_lock (pi->content->lock);
+  if (GNUNET_OK != GNUNET_FUSE_download_prepare (pi))
+  {
+    GNUNET_mutex_unlock (pi->content->lock);
+    GNUNET_mutex_unlock (pi->lock);
+    return;
+  }
+  ++pi->rc;
+  GNUNET_FUSE_download_start (pi,
+			      offset,
+			      length,
+			      GNUNET_FUSE_DOWNLOAD_BACKGROUND);
+  GNUNET_mutex_unlock (pi->content->lock);
+  GNUNET_mutex_unlock (pi->lock);
+  bytes_requested += length;
+  GNUNET_FUSE_stats_update (gettext_noop ("# warmup bytes requested"),
+			    length);
+  p = GNUNET_new (struct Pending);
+  p->pi = pi;
+  p->offset = offset;
+  p->length = length;
+  GNUNET_CONTAINER_DLL_insert_tail (pending_head,
+				    pending_tail,
+				    p);
+  num_pending++;
+  drain (WARMUP_WINDOW - 1);
+}
+
+
+/**
+ * Get the entries of a directory that match a pattern, loading the
+ * directory if needed.
+ *
+ * @param dir the directory
+ * @param pattern pattern for the names of the entries, NULL for all
+ * @param children set to the matching entries (with incremented
+ *        reference counters)
+ * @return number of entries in 'children'
+ */
+static unsigned int
+get_children (struct GNUNET_FUSE_PathInfo *dir,
+	      const char *pattern,
+	      struct GNUNET_FUSE_PathInfo ***children)
+{
+  struct GNUNET_FUSE_PathInfo *child;
+  struct stat stbuf;
+  const char *name;
+  unsigned int num;
+  unsigned int pos;
+  int eno;
+
+  *children = NULL;
+  num = 0;
+  GNUNET_mutex_lock (dir->lock);
+  while (NULL == dir->index)
+  {
+    /* do not make foreground operations on the directory wait for
+       our background download on its lock */
+    GNUNET_mutex_unlock (dir->lock);
+    if (GNUNET_OK != GNUNET_FUSE_load_directory_unlocked (dir,
+							  GNUNET_FUSE_DOWNLOAD_BACKGROUND,
+							  &eno))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		  "Failed to warm up directory `%s': %s\n",
+		  dir->filename,
+		  strerror (eno));
+      GNUNET_FUSE_stats_update (gettext_noop ("# warmup files failed"),
+				1);
+      return 0;
+    }
+    /* the index may have been trimmed again meanwhile */
+    GNUNET_mutex_lock (dir->lock);
+  }
+  for (pos = 0;
+       NULL != (name = GNUNET_FUSE_path_info_get_entry (dir, pos, &stbuf));
+       pos++)
+  {
+    if ( (NULL != pattern) &&
+	 (0 != fnmatch (pattern, name, FNM_PERIOD)) )
+      continue;
+    if (NULL != (child = GNUNET_FUSE_path_info_get_child (dir, pos)))
+      GNUNET_array_append (*children, num, child);
+  }
+  GNUNET_mutex_unlock (dir->lock);
+  return num;
+}
+
+
+/**
+ * Fetch a file or a directory with everything below it.
+ *
+ * @param pi the file or directory
+ * @param offset offset of the range to fetch from files
+ * @param length length of the range to fetch from files
+ */
+static void
+fetch_path (struct GNUNET_FUSE_PathInfo *pi,
+	    uint64_t offset,
+	    uint64_t length)
+{
+  struct GNUNET_FUSE_PathInfo **children;
+  unsigned int num;
+  unsigned int i;
+
+  if (! S_ISDIR (pi->stbuf.st_mode))
+  {
+    fetch_file (pi, offset, length);
+    return;
+  }
+  num = get_children (pi, NULL, &children);
+  for (i = 0; i < num; i++)
+  {
+    if (GNUNET_NO == GNUNET_FUSE_scheduler_stopped (GNUNET_FUSE_DOWNLOAD_BACKGROUND))
+      fetch_path (children[i], 0, UINT64_MAX);
+    GNUNET_FUSE_path_info_done (children[i]);
+  }
+  GNUNET_free_non_null (children);
+}
+
+
+/**
+ * Fetch the paths below a directory that match a pattern.
+ *
+ * @param dir the directory
+ * @param pattern remaining components of the pattern, relative
+ *        to 'dir'
+ * @param e the manifest entry
+ */
+static void
+walk (struct GNUNET_FUSE_PathInfo *dir,
+      const char *pattern,
+      const struct Entry *e)
+{
+  struct GNUNET_FUSE_PathInfo **children;
+  const char *rest;
+  char *component;
+  unsigned int num;
+  unsigned int i;
+
+  while ('/' == *pattern)
+    pattern++;
+  if ('\0' == *pattern)
+  {
+    fetch_path (dir, e->offset, e->length);
+    return;
+  }
+  if (! S_ISDIR (dir->stbuf.st_mode))
+    return;
+  if (NULL == (rest = strchr (pattern, '/')))
+    rest = pattern + strlen (pattern);
+  component = GNUNET_strndup (pattern, rest - pattern);
+  num = get_children (dir, component, &children);
+  GNUNET_free (component);
+  for (i = 0; i < num; i++)
+  {
+    if (GNUNET_NO == GNUNET_FUSE_scheduler_stopped (GNUNET_FUSE_DOWNLOAD_BACKGROUND))
+      walk (children[i], rest, e);
+    GNUNET_FUSE_path_info_done (children[i]);
+  }
+  GNUNET_free_non_null (children);
+}
+
+
+/**
+ * Main function of the thread fetching the entries.
+ *
+ * @param cls NULL
+ * @return NULL
+ */
+static void *
+warmup (void *cls)
+{
+  struct GNUNET_FUSE_PathInfo *root;
+  struct GNUNET_TIME_Absolute start;
+  unsigned int i;
+  int eno;
+
+  /* the root may be switched to a new version meanwhile, we keep
+     warming up the version we started with */
+  if ( (GNUNET_OK != GNUNET_FUSE_root_wait (&eno)) ||
+       (NULL == (root = GNUNET_FUSE_path_info_get ("/", &eno))) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("Not warming up, the root is not available: %s\n"),
+		strerror (eno));
+    return NULL;
+  }
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < num_entries; i++)
+  {
+    if (GNUNET_YES == GNUNET_FUSE_scheduler_stopped (GNUNET_FUSE_DOWNLOAD_BACKGROUND))
+      break;
+    walk (root, entries[i].pattern, &entries[i]);
+    drain (0);
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+		_("Warmup of `%s' done (%u/%u entries, %llu/%llu bytes)\n"),
+		entries[i].pattern,
+		i + 1,
+		num_entries,
+		(unsigned long long) bytes_done,
+		(unsigned long long) bytes_requested);
+  }
+  drain (0);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+	      _("Warmup finished after %s, %llu of %llu bytes are local\n"),
+	      GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
+						      GNUNET_YES),
+	      (unsigned long long) bytes_done,
+	      (unsigned long long) bytes_requested);
+  GNUNET_FUSE_path_info_done (root);
+  return NULL;
+}
+
+
+/**
+ * Start the thread that fetches the entries of the manifest.  Must
+ * be called after FUSE daemonized the process.
+ */
+void
+GNUNET_FUSE_warmup_start ()
+{
+  if (0 == num_entries)
+    return;
+  if (0 != (errno = pthread_create (&warmer,
+				    NULL,
+				    &warmup,
+				    NULL)))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+			 "pthread_create");
+    return;
+  }
+  warmer_started = GNUNET_YES;
+}
+
+
+/**
+ * Stop fetching the entries of the manifest.  Background downloads
+ * should be stopped first.
+ */
+void
+GNUNET_FUSE_warmup_done ()
+{
+  unsigned int i;
+
+  if (GNUNET_YES == warmer_started)
+  {
+    /* the thread stops once background downloads were stopped */
+    GNUNET_break (0 == pthread_join (warmer, NULL));
+    warmer_started = GNUNET_NO;
+  }
+  for (i = 0; i < num_entries; i++)
+    GNUNET_free (entries[i].pattern);
+  GNUNET_array_grow (entries,
+		     num_entries,
+		     0);
+}
+
+/* end of gfs_warmup.c */
@@ -0,0 +1,55 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/gfs_warmup.h
+ * @brief fetching the paths listed in a manifest after mounting
+ */
+#ifndef GFS_WARMUP_H
+#define GFS_WARMUP_H
+
+#include "gnunet-fuse.h"
+
+/**
+ * Read the warmup manifest.
+ *
+ * @param filename name of the manifest, NULL for none
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the manifest
+ *         could not be read or is malformed
+ */
+int
+GNUNET_FUSE_warmup_init (const char *filename);
+
+
+/**
+ * Start the thread that fetches the entries of the manifest.  Must
+ * be called after FUSE daemonized the process.
+ */
+void
+GNUNET_FUSE_warmup_start (void);
+
+
+/**
+ * Stop fetching the entries of the manifest.  Background downloads
+ * should be stopped first.
+ */
+void
+GNUNET_FUSE_warmup_done (void);
+
+#endif
@@ -26,6 +26,33 @@
  */
 #include "gnunet-fuse.h"
 #include "gfs_download.h"
+#include "gfs_attr_cache.h"
+#include "gfs_cache.h"
+#include "gfs_content.h"
+#include "gfs_hot_cache.h"
+#include "gfs_index.h"
+#include "gfs_prefetch.h"
+#include "gfs_preload.h"
+#include "gfs_scan.h"
+#include "gfs_warmup.h"
+#include "gfs_scheduler.h"
+#include "gfs_stats.h"
+#include <pthread.h>
+#include <sys/xattr.h>
+
+/**
+ * When the tree uses too much memory, collapse directories until
+ * it uses at most this percentage of its budget (so that we do not
+ * have to walk the tree again after the next few lookups).
+ */
+#define TRIM_TARGET 90
+
+/**
+ * Minimum time between two walks of the tree to collapse
+ * directories (in seconds), so that lookups do not keep walking
+ * the tree while little can be collapsed.
+ */
+#define TRIM_INTERVAL 1
 
 /**
  * Anonymity level to use.
@@ -37,6 +64,28 @@ unsigned int anonymity_level;
  */
 const struct GNUNET_CONFIGURATION_Handle *cfg;
 
+/**
+ * Number of bytes to read ahead of sequential reads (0 for none).
+ */
+unsigned long long readahead_size;
+
+/**
+ * Files up to this size are downloaded whole when they are opened
+ * (0 to disable).
+ */
+unsigned long long small_file_threshold;
+
+/**
+ * GNUNET_YES to only serve data that is available without
+ * downloading.
+ */
+int offline;
+
+/**
+ * How long file system operations wait for downloads.
+ */
+struct GNUNET_TIME_Relative operation_deadline;
+
 /**
  * Return code from 'main' (0 on success).
  */
@@ -57,96 +106,616 @@ static char *source;
  */
 static char *directory;
 
+/**
+ * File listing the URIs to mount as top-level entries of the mount
+ * (NULL to mount 'source').
+ */
+static char *mounts_file;
+
+/**
+ * Directory for the persistent cache (NULL for none).
+ */
+static char *cache_directory;
+
+/**
+ * Manifest of the paths to fetch after mounting (NULL for none).
+ */
+static char *warmup_manifest;
+
+/**
+ * Flag to determine if we should mount at once and load the
+ * root directory in the background.
+ */
+static int background;
+
+/**
+ * How long operations wait for the background loading of the
+ * root directory before failing with EAGAIN.
+ */
+static struct GNUNET_TIME_Relative root_timeout;
+
 /**
  * Root of the file tree.
  */
 static struct GNUNET_FUSE_PathInfo *root;
 
+/**
+ * Lock for 'root' (which changes when switching to another version
+ * of the root directory).  Lock order: before all path info entries.
+ */
+static struct GNUNET_Mutex *root_lock;
+
+/**
+ * Held while switching to another version of the root directory
+ * (or of a mounted directory, or adding or removing one).
+ */
+static struct GNUNET_Mutex *switch_lock;
+
+/**
+ * Thread loading the root directory in the background.
+ */
+static pthread_t root_loader;
+
+/**
+ * GNUNET_YES if 'root_loader' was started.
+ */
+static int root_loader_started;
+
+/**
+ * GNUNET_YES while the root directory is being loaded in the background.
+ */
+static int root_loading;
+
+/**
+ * Lock for 'root_loading'.
+ */
+static struct GNUNET_Mutex *root_loading_lock;
+
+/**
+ * Signalled once 'root_loading' is reset.
+ */
+static struct GNUNET_Cond *root_loaded_cond;
+
+/**
+ * Number of bytes the path info entries may use before directories
+ * that are not in use are collapsed (0 for no limit).
+ */
+static unsigned long long tree_budget;
+
+/**
+ * Lock for the accounting of the memory used by the tree (the
+ * variables below).  Lock order: after all path info entries.
+ */
+static struct GNUNET_Mutex *tree_lock;
+
+/**
+ * Number of bytes used by the path info entries (without their
+ * URIs and indices).
+ */
+static uint64_t tree_memory;
+
+/**
+ * Number of path info entries.
+ */
+static uint64_t tree_entries;
+
+/**
+ * GNUNET_YES if 'tree_memory' or 'tree_entries' changed since they
+ * were last reported in the statistics.
+ */
+static int tree_changed;
+
+/**
+ * Collapse directories once 'tree_memory' is above this value
+ * ('tree_budget', or more if not enough directories could be
+ * collapsed the last time).
+ */
+static uint64_t trim_threshold;
+
+/**
+ * GNUNET_YES while a thread collapses directories.
+ */
+static int trimming;
+
+/**
+ * When the tree was last walked to collapse directories.
+ */
+static struct GNUNET_TIME_Absolute last_trim;
+
 
 /**
- * Function used to process entries in a directory; adds the
- * respective entry to the parent directory.
+ * Initialize the attributes of an entry.
  *
- * @param cls closure with the 'struct GNUNET_FUSE_PathInfo' of the parent
- * @param filename name of the file in the directory
- * @param uri URI of the file
- * @param metadata metadata for the file; metadata for
- *        the directory if everything else is NULL/zero
- * @param length length of the available data for the file
- *           (of type size_t since data must certainly fit
- *            into memory; if files are larger than size_t
- *            permits, then they will certainly not be
- *            embedded with the directory itself).
- * @param data data available for the file (length bytes)
+ * @param stbuf attributes to initialize
+ * @param is_directory GNUNET_YES if the entry is a directory
+ * @param size size of the file
+ */
+static void
+init_stat (struct stat *stbuf,
+	   int is_directory,
+	   uint64_t size)
+{
+  memset (stbuf, 0, sizeof (struct stat));
+  stbuf->st_mode = (S_IRUSR | S_IRGRP | S_IROTH); /* read-only */
+  if (GNUNET_YES == is_directory)
+  {
+    stbuf->st_mode |= S_IFDIR | (S_IXUSR | S_IXGRP | S_IXOTH); /* allow traversal */
+  }
+  else
+  {
+    stbuf->st_mode |= S_IFREG; /* regular file */
+    stbuf->st_size = (off_t) size;
+  }
+}
+
+
+/**
+ * Get the number of bytes used by a path info entry (without its
+ * 'children' array).
+ *
+ * @param pi the entry
+ * @return number of bytes
+ */
+static size_t
+entry_size (const struct GNUNET_FUSE_PathInfo *pi)
+{
+  return sizeof (struct GNUNET_FUSE_PathInfo) + strlen (pi->filename) + 1;
+}
+
+
+/**
+ * Account for a change of the memory used by the tree.
+ *
+ * @param bytes change of the number of bytes used
+ * @param entries change of the number of entries
+ */
+static void
+tree_update (int64_t bytes,
+	     int entries)
+{
+  GNUNET_mutex_lock (tree_lock);
+  tree_memory += bytes;
+  tree_entries += entries;
+  tree_changed = GNUNET_YES;
+  GNUNET_mutex_unlock (tree_lock);
+}
+
+
+/**
+ * Change the size of the 'children' array of a directory.  Caller
+ * must hold the lock of 'pi'.
+ *
+ * @param pi the directory
+ * @param size new number of entries in the array
  */
 static void
-process_directory_entry (void *cls,
-			 const char *filename,
-			 const struct GNUNET_FS_Uri *
-			 uri,
-			 const struct
-			 GNUNET_CONTAINER_MetaData *
-			 meta, size_t length,
-			 const void *data)
-{
-  struct GNUNET_FUSE_PathInfo *parent = cls;
+resize_children (struct GNUNET_FUSE_PathInfo *pi,
+		 unsigned int size)
+{
+  tree_update (((int64_t) size - (int64_t) pi->children_size)
+	       * (int64_t) sizeof (struct GNUNET_FUSE_PathInfo *),
+	       0);
+  GNUNET_array_grow (pi->children,
+		     pi->children_size,
+		     size);
+}
+
+
+/**
+ * Allocate a new path info entry (without adding it to the tree).
+ *
+ * @param parent parent directory (can be NULL)
+ * @param filename name of the file to create
+ * @param uri URI to use for the path, NULL for a directory that
+ *        only exists in memory (the root when mounting several URIs)
+ * @param is_directory GNUNET_YES if this entry is for a directory
+ * @return new path entry with a reference counter of 1
+ */
+static struct GNUNET_FUSE_PathInfo *
+path_info_new (struct GNUNET_FUSE_PathInfo *parent,
+	       const char *filename,
+	       const struct GNUNET_FS_Uri *uri,
+	       int is_directory)
+{
   struct GNUNET_FUSE_PathInfo *pi;
-  int is_directory;
+  size_t len;
 
-  if (NULL == filename)
-    return; /* info about the directory itself */
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Adding file `%s' to directory `%s'\n",
-	      filename,
-	      parent->filename);
-  is_directory = GNUNET_FS_meta_data_test_for_directory (meta);
-  if (GNUNET_SYSERR == is_directory)
-    is_directory = GNUNET_NO; /* if in doubt, say no */
-  pi = GNUNET_FUSE_path_info_create (parent, filename, uri, is_directory);
-  GNUNET_FUSE_path_info_done (pi);
+  pi = GNUNET_new (struct GNUNET_FUSE_PathInfo);
+  pi->parent = parent;
+  pi->filename = GNUNET_strdup (filename);
+  len = strlen (pi->filename);
+  if ('/' == pi->filename[len - 1])
+    pi->filename[len - 1] = '\0';
+  if (NULL != uri)
+  {
+    pi->uri = GNUNET_FS_uri_dup (uri);
+    pi->content = GNUNET_FUSE_content_get (uri);
+  }
+  pi->lock = GNUNET_mutex_create (GNUNET_YES);
+  pi->rc = 1;
+  pi->last_used = GNUNET_TIME_absolute_get ();
+  tree_update ((int64_t) entry_size (pi),
+	       1);
+  init_stat (&pi->stbuf,
+	     is_directory,
+	     (NULL == uri) ? 0 : GNUNET_FS_uri_chk_get_file_size (uri));
+  return pi;
+}
+
+
+/**
+ * Get the entry at the given position in a loaded directory,
+ * creating it from the directory index if it was not used so far.
+ * Caller must hold the lock of 'parent'.
+ *
+ * @param parent the directory
+ * @param pos position of the entry in the index of 'parent'
+ * @return NULL on error
+ */
+static struct GNUNET_FUSE_PathInfo *
+get_child (struct GNUNET_FUSE_PathInfo *parent,
+	   unsigned int pos)
+{
+  struct GNUNET_FUSE_PathInfo *pi;
+  struct GNUNET_FS_Uri *uri;
+  char *emsg;
+
+  if (NULL != (pi = parent->children[pos]))
+    return pi;
+  uri = GNUNET_FS_uri_parse (GNUNET_FUSE_index_get_uri (parent->index,
+							pos),
+			     &emsg);
+  if (NULL == uri)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("Invalid URI in index of directory `%s': %s\n"),
+		parent->filename,
+		emsg);
+    GNUNET_free (emsg);
+    return NULL;
+  }
+  pi = path_info_new (parent,
+		      GNUNET_FUSE_index_get_name (parent->index,
+						  pos),
+		      uri,
+		      GNUNET_FUSE_index_is_directory (parent->index,
+						      pos));
+  GNUNET_FS_uri_destroy (uri);
+  pi->rc = 0; /* only referenced by the tree */
+  pi->child_offset = pos;
+  parent->children[pos] = pi;
+  GNUNET_CONTAINER_DLL_insert_tail (parent->child_head,
+				    parent->child_tail,
+				    pi);
+  return pi;
+}
+
+
+/**
+ * Get the entry at the given position in a loaded directory.
+ *
+ * @param pi the directory
+ * @param pos position of the entry in the directory
+ * @return NULL on error, otherwise the entry with
+ *         incremented reference counter (!)
+ */
+struct GNUNET_FUSE_PathInfo *
+GNUNET_FUSE_path_info_get_child (struct GNUNET_FUSE_PathInfo *pi,
+				 unsigned int pos)
+{
+  struct GNUNET_FUSE_PathInfo *child;
+
+  GNUNET_mutex_lock (pi->lock);
+  if ( (NULL == pi->index) ||
+       (pos >= pi->children_length) ||
+       (NULL == (child = get_child (pi, pos))) )
+  {
+    GNUNET_mutex_unlock (pi->lock);
+    return NULL;
+  }
+  GNUNET_mutex_lock (child->lock);
+  ++child->rc;
+  GNUNET_mutex_unlock (child->lock);
+  GNUNET_mutex_unlock (pi->lock);
+  return child;
+}
+
+
+/**
+ * Keep the metadata of the entry decoded from a directory (we only
+ * decode one entry at a time).
+ *
+ * @param cls where to store the metadata
+ * @param filename name of the file in the directory
+ * @param uri URI of the file, NULL for the directory itself
+ * @param meta metadata of the file
+ * @param length number of bytes of data available for the file
+ * @param data data available for the file
+ */
+static void
+copy_meta (void *cls,
+	   const char *filename,
+	   const struct GNUNET_FS_Uri *uri,
+	   const struct GNUNET_CONTAINER_MetaData *meta,
+	   size_t length,
+	   const void *data)
+{
+  struct GNUNET_CONTAINER_MetaData **ret = cls;
+
+  if ( (NULL == uri) ||
+       (NULL != *ret) )
+    return;
+  *ret = GNUNET_CONTAINER_meta_data_duplicate (meta);
+}
+
+
+/**
+ * Get the serialized form of a directory up to a given offset, to
+ * decode metadata from.  Without a complete copy in the persistent
+ * cache, the range is downloaded into the 'tmpfile' of the directory
+ * (which then stays until the directory is freed, so decoding more
+ * metadata from it is cheap).  Caller must hold a reference to 'dir'
+ * but not its lock.
+ *
+ * @param dir the directory
+ * @param size number of bytes needed from the start of the directory
+ * @return name of the file with the data (to be freed by the caller),
+ *         NULL on error
+ */
+static char *
+get_serialized (struct GNUNET_FUSE_PathInfo *dir,
+		uint64_t size)
+{
+  struct GNUNET_FUSE_Content *content = dir->content;
+  char *fn;
+  int eno;
+
+  if (GNUNET_YES == GNUNET_FUSE_cache_test (dir->uri))
+    return GNUNET_FUSE_cache_get_filename (dir->uri, NULL);
+  GNUNET_mutex_lock (content->lock);
+  if (GNUNET_OK != GNUNET_FUSE_download_prepare (dir))
+  {
+    GNUNET_mutex_unlock (content->lock);
+    return NULL;
+  }
+  GNUNET_mutex_unlock (content->lock);
+  if (GNUNET_OK != GNUNET_FUSE_download_file (dir,
+					      0,
+					      size,
+					      GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+					      &eno))
+    return NULL;
+  GNUNET_mutex_lock (content->lock);
+  fn = (NULL != content->tmpfile) ? GNUNET_strdup (content->tmpfile) : NULL;
+  GNUNET_mutex_unlock (content->lock);
+  return fn;
+}
+
+
+/**
+ * Decode the metadata of an entry from the serialized directory it
+ * is in.  Metadata is not kept in memory (it can be large, i.e.
+ * thumbnails), so this reads the directory from the persistent
+ * cache each time, or (without one) downloads the part of the
+ * directory up to the entry again.  Caller must hold a reference to
+ * 'pi' but no locks of path info entries.
+ *
+ * @param pi the entry
+ * @return NULL if the entry has no metadata or the directory could
+ *         not be read, otherwise the metadata (to be destroyed by
+ *         the caller)
+ */
+struct GNUNET_CONTAINER_MetaData *
+GNUNET_FUSE_path_info_get_meta (struct GNUNET_FUSE_PathInfo *pi)
+{
+  struct GNUNET_FUSE_PathInfo *dir = pi->parent;
+  struct GNUNET_CONTAINER_MetaData *meta;
+  struct GNUNET_DISK_FileHandle *fh;
+  struct GNUNET_DISK_MapHandle *mh;
+  uint64_t offset;
+  uint32_t len;
+  char *fn;
+  void *data;
+
+  if (NULL == dir)
+    return NULL;
+  GNUNET_mutex_lock (dir->lock);
+  if ( (NULL == dir->uri) ||
+       (NULL == dir->index) ||
+       (pi->child_offset >= dir->children_length) ||
+       (pi != dir->children[pi->child_offset]) )
+  {
+    GNUNET_mutex_unlock (dir->lock);
+    return NULL;
+  }
+  len = GNUNET_FUSE_index_get_location (dir->index,
+					pi->child_offset,
+					&offset);
+  ++dir->rc;
+  GNUNET_mutex_unlock (dir->lock);
+  fn = NULL;
+  if ( (0 != len) &&
+       (0 != offset) &&
+       (offset + len <= GNUNET_FS_uri_chk_get_file_size (dir->uri)) )
+    fn = get_serialized (dir, offset + len);
+  GNUNET_FUSE_path_info_done (dir);
+  if (NULL == fn)
+    return NULL;
+  fh = GNUNET_DISK_file_open (fn,
+			      GNUNET_DISK_OPEN_READ,
+			      GNUNET_DISK_PERM_NONE);
+  GNUNET_free (fn);
+  if (NULL == fh)
+    return NULL;
+  meta = NULL;
+  data = GNUNET_DISK_file_map (fh,
+			       &mh,
+			       GNUNET_DISK_MAP_TYPE_READ,
+			       (size_t) (offset + len));
+  if (NULL != data)
+  {
+    /* decode only this entry */
+    (void) GNUNET_FS_directory_list_contents ((size_t) (offset + len),
+					      data,
+					      offset,
+					      &copy_meta,
+					      &meta);
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_unmap (mh));
+  }
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fh));
+  return meta;
+}
+
+
+/**
+ * Get the name and attributes of the entry at the given position
+ * in a loaded directory, without creating a path info entry for it.
+ * Caller must hold the lock of 'pi'.
+ *
+ * @param pi the directory
+ * @param pos position of the entry
+ * @param stbuf where to store the attributes of the entry
+ * @return name of the entry (valid while 'pi' is locked),
+ *         NULL if 'pos' is past the last entry
+ */
+const char *
+GNUNET_FUSE_path_info_get_entry (struct GNUNET_FUSE_PathInfo *pi,
+				 unsigned int pos,
+				 struct stat *stbuf)
+{
+  if (pos >= pi->children_length)
+    return NULL;
+  if (NULL != pi->children[pos])
+  {
+    *stbuf = pi->children[pos]->stbuf;
+    return pi->children[pos]->filename;
+  }
+  init_stat (stbuf,
+	     GNUNET_FUSE_index_is_directory (pi->index, pos),
+	     GNUNET_FUSE_index_get_file_size (pi->index, pos));
+  return GNUNET_FUSE_index_get_name (pi->index, pos);
 }
 
 
 /**
- * Load and parse a directory.
+ * Get the index of a directory.  Uses the index of the directory
+ * from the persistent cache if we have one, otherwise downloads the
+ * directory and builds the index.  Only takes the lock of the
+ * content of 'pi' (entries with the same URI may be loaded at the
+ * same time); caller must hold a reference to 'pi'.
  *
  * @param pi path to the directory
+ * @param priority priority for downloading the directory
  * @param eno where to store 'errno' on errors
- * @return GNUNET_OK on success
+ * @return NULL on error, otherwise the index (not installed in 'pi')
  */
-int
-GNUNET_FUSE_load_directory (struct GNUNET_FUSE_PathInfo *pi,
-			    int * eno)
+static struct GNUNET_FUSE_DirectoryIndex *
+get_index (struct GNUNET_FUSE_PathInfo *pi,
+	   enum GNUNET_FUSE_DownloadPriority priority,
+	   int * eno)
 {
+  struct GNUNET_FUSE_DirectoryIndex *index;
+  struct GNUNET_FUSE_Content *content;
   size_t size;
   void *data;
   struct GNUNET_DISK_MapHandle *mh;
   struct GNUNET_DISK_FileHandle *fh;
+  char *fn;
+  int ret;
 
-  /* Need to download directory; store to temporary file */
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Downloading directory `%s'\n",
-	      pi->filename);
-  pi->tmpfile = GNUNET_DISK_mktemp ("gnunet-fuse-tempfile");
-  if (GNUNET_OK != GNUNET_FUSE_download_file (pi,
-					      0,
-					      GNUNET_FS_uri_chk_get_file_size (pi->uri)))
+ again:
+  if (NULL != (index = GNUNET_FUSE_index_load (pi->uri)))
   {
-    unlink (pi->tmpfile);
-    GNUNET_free (pi->tmpfile);
-    pi->tmpfile = NULL;
-    *eno = EIO; /* low level IO error */
-    return GNUNET_SYSERR;
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Using cached index for directory `%s'\n",
+		pi->filename);
+    return index;
+  }
+  content = pi->content;
+  GNUNET_mutex_lock (content->lock);
+  if ( (NULL == content->tmpfile) &&
+       (GNUNET_YES == GNUNET_FUSE_cache_test (pi->uri)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Loading directory `%s' from cache\n",
+		pi->filename);
+    content->tmpfile = GNUNET_FUSE_cache_get_filename (pi->uri, NULL);
+    content->tmpfile_cached = GNUNET_YES;
+  }
+  else
+  {
+    /* Need to download directory; store to temporary file */
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Downloading directory `%s'\n",
+		pi->filename);
+    if ( (GNUNET_YES == offline) &&
+	 (NULL == content->tmpfile) )
+    {
+      GNUNET_mutex_unlock (content->lock);
+      *eno = ENODATA;
+      return NULL;
+    }
+    /* an interrupted attempt (or other processes sharing the
+       persistent cache) may have left us some blocks */
+    if (GNUNET_OK != GNUNET_FUSE_download_prepare (pi))
+    {
+      GNUNET_mutex_unlock (content->lock);
+      *eno = EIO;
+      return NULL;
+    }
+    /* like reads, wait for the data without holding the lock, so
+       that loading the directory in the foreground meanwhile gets
+       to raise the priority of a speculative download */
+    GNUNET_mutex_unlock (content->lock);
+    ret = GNUNET_FUSE_download_file (pi,
+				     0,
+				     GNUNET_FS_uri_chk_get_file_size (pi->uri),
+				     priority,
+				     eno);
+    GNUNET_mutex_lock (content->lock);
+    if (GNUNET_OK != ret)
+    {
+      /* if we were interrupted or passed our deadline, downloads
+	 into 'tmpfile' may still be running; keep it for the next
+	 attempt then */
+      if ( (NULL != content->tmpfile) &&
+	   (GNUNET_OK == GNUNET_FUSE_download_forget (pi)) )
+      {
+	if (GNUNET_YES != content->tmpfile_cached)
+	  unlink (content->tmpfile);
+	GNUNET_free (content->tmpfile);
+	content->tmpfile = NULL;
+	content->tmpfile_cached = GNUNET_NO;
+      }
+      GNUNET_mutex_unlock (content->lock);
+      return NULL;
+    }
+    if (NULL == content->tmpfile)
+    {
+      /* another thread built the index and removed the file */
+      GNUNET_mutex_unlock (content->lock);
+      goto again;
+    }
+    if ( (GNUNET_YES != content->tmpfile_cached) &&
+	 (NULL != (fn = GNUNET_FUSE_cache_publish (pi->uri,
+						   NULL,
+						   content->tmpfile))) )
+    {
+      GNUNET_free (content->tmpfile);
+      content->tmpfile = fn;
+      content->tmpfile_cached = GNUNET_YES;
+    }
   }
 
   size = (size_t) GNUNET_FS_uri_chk_get_file_size (pi->uri);
-  fh = GNUNET_DISK_file_open (pi->tmpfile,
+  fh = GNUNET_DISK_file_open (content->tmpfile,
 			      GNUNET_DISK_OPEN_READ,
 			      GNUNET_DISK_PERM_NONE);
   if (NULL == fh)
   {
+    GNUNET_mutex_unlock (content->lock);
     *eno = EIO;
-    return GNUNET_SYSERR;
+    return NULL;
   }
   data = GNUNET_DISK_file_map (fh,
 			       &mh,
@@ -155,27 +724,122 @@ GNUNET_FUSE_load_directory (struct GNUNET_FUSE_PathInfo *pi,
   if (NULL == data)
   {
     GNUNET_assert (GNUNET_OK == GNUNET_DISK_file_close (fh));
-    return - ENOMEM;
+    GNUNET_mutex_unlock (content->lock);
+    *eno = ENOMEM;
+    return NULL;
   }
-  *eno = 0;
-  if (GNUNET_OK !=
-      GNUNET_FS_directory_list_contents (size,
-					 data, 0LL,
-					 &process_directory_entry,
-					 pi))
-    *eno = ENOTDIR;
+  index = GNUNET_FUSE_index_create (pi->uri,
+				    size,
+				    data);
   GNUNET_assert (GNUNET_OK == GNUNET_DISK_file_unmap (mh));
   GNUNET_DISK_file_close (fh);
-  if (0 != *eno)
-    return GNUNET_SYSERR;
-  return GNUNET_OK;
+  /* the index has everything we need from the directory */
+  if (GNUNET_OK == GNUNET_FUSE_download_forget (pi))
+  {
+    if (GNUNET_YES != content->tmpfile_cached)
+      GNUNET_break (0 == unlink (content->tmpfile));
+    GNUNET_free (content->tmpfile);
+    content->tmpfile = NULL;
+    content->tmpfile_cached = GNUNET_NO;
+  }
+  GNUNET_mutex_unlock (content->lock);
+  if (NULL == index)
+    *eno = ENOTDIR;
+  return index;
 }
 
 
 /**
- * Obtain an existing path info entry from the global map.
+ * Install the index of a directory.  Caller must hold the lock of
+ * 'pi'.
  *
- * @param path path the entry represents
+ * @param pi path to the directory, must not have an index yet
+ * @param index the index of the directory
+ * @param priority priority the directory was loaded with; loading
+ *        a directory in the foreground also starts prefetching
+ *        its subdirectories
+ */
+static void
+install_index (struct GNUNET_FUSE_PathInfo *pi,
+	       struct GNUNET_FUSE_DirectoryIndex *index,
+	       enum GNUNET_FUSE_DownloadPriority priority)
+{
+  pi->index = index;
+  resize_children (pi,
+		   GNUNET_FUSE_index_get_size (pi->index));
+  pi->children_length = pi->children_size;
+  pi->last_used = GNUNET_TIME_absolute_get ();
+  if (GNUNET_FUSE_DOWNLOAD_FOREGROUND == priority)
+    GNUNET_FUSE_prefetch_directory (pi);
+}
+
+
+/**
+ * Load and parse a directory.  Uses the index of the directory from
+ * the persistent cache if we have one, otherwise downloads the
+ * directory and builds the index.  The entries of the directory are
+ * only created once they are accessed.  Caller must hold the lock
+ * of 'pi'.
+ *
+ * @param pi path to the directory
+ * @param priority priority for downloading the directory; loading
+ *        a directory in the foreground also starts prefetching
+ *        its subdirectories
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_load_directory (struct GNUNET_FUSE_PathInfo *pi,
+			    enum GNUNET_FUSE_DownloadPriority priority,
+			    int * eno)
+{
+  struct GNUNET_FUSE_DirectoryIndex *index;
+
+  if (NULL == (index = get_index (pi, priority, eno)))
+    return GNUNET_SYSERR;
+  install_index (pi, index, priority);
+  *eno = 0;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Load and parse a directory without holding its lock while we
+ * download it, so that operations on the directory do not wait for
+ * speculative work (they can then raise the priority of the download
+ * instead).  The lock of 'pi' is only taken to install the index;
+ * if another thread loaded the directory in the meantime, its index
+ * is kept.  Caller must hold a reference to 'pi', but not its lock.
+ *
+ * @param pi path to the directory
+ * @param priority priority for downloading the directory
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_load_directory_unlocked (struct GNUNET_FUSE_PathInfo *pi,
+				     enum GNUNET_FUSE_DownloadPriority priority,
+				     int * eno)
+{
+  struct GNUNET_FUSE_DirectoryIndex *index;
+
+  if (NULL == (index = get_index (pi, priority, eno)))
+    return GNUNET_SYSERR;
+  GNUNET_mutex_lock (pi->lock);
+  if (NULL == pi->index)
+    install_index (pi, index, priority);
+  else
+    GNUNET_FUSE_index_destroy (index);
+  GNUNET_mutex_unlock (pi->lock);
+  *eno = 0;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Obtain an existing path info entry from the global map.
+ *
+ * @param path path the entry represents
  * @param eno where to store 'errno' on errors
  * @return NULL if no such path entry exists
  */
@@ -187,34 +851,43 @@ GNUNET_FUSE_path_info_get (const char *path,
   char buf[slen];
   struct GNUNET_FUSE_PathInfo *pi;
   struct GNUNET_FUSE_PathInfo *pos;
+  struct GNUNET_TIME_Absolute now;
+  unsigned int off;
   char *tok;
 
+  if ( ('\0' != path[strspn (path, "/")]) &&
+       (GNUNET_OK != GNUNET_FUSE_root_wait (eno)) )
+    return NULL;
   memcpy (buf, path, slen);
-  pi = root;
+  now = GNUNET_TIME_absolute_get ();
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Looking up path `%s'\n",
 	      path);
+  GNUNET_mutex_lock (root_lock);
+  pi = root;
   GNUNET_mutex_lock (pi->lock);
+  GNUNET_mutex_unlock (root_lock);
   for (tok = strtok (buf, "/"); NULL != tok; tok = strtok (NULL, "/"))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 		"Searching for token `%s'\n",
 		tok);
-    if (NULL == pi->tmpfile)
+    pi->last_used = now;
+    if (NULL == pi->index)
     {
-      if (GNUNET_OK != GNUNET_FUSE_load_directory (pi, eno))
+      if (GNUNET_OK != GNUNET_FUSE_load_directory (pi,
+						   GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+						   eno))
       {
 	GNUNET_mutex_unlock (pi->lock);
 	return NULL;
       }
     }
 
-    pos = pi->child_head;
-    while ( (NULL != pos) &&
-	    (0 != strcmp (tok,
-			  pos->filename)) )
-      pos = pos->next;
-    if (NULL == pos)
+    if ( (GNUNET_YES != GNUNET_FUSE_index_lookup (pi->index,
+						  tok,
+						  &off)) ||
+	 (NULL == (pos = get_child (pi, off))) )
     {
       GNUNET_mutex_unlock (pi->lock);
       *eno = ENOENT;
@@ -231,154 +904,1522 @@ GNUNET_FUSE_path_info_get (const char *path,
     GNUNET_mutex_unlock (pi->lock);
     pi = pos;
   }
-  ++pi->rc;
-  GNUNET_mutex_unlock (pi->lock);
-  return pi;
+  pi->last_used = now;
+  ++pi->rc;
+  GNUNET_mutex_unlock (pi->lock);
+  /* the lookup may have loaded directories */
+  GNUNET_FUSE_path_info_trim ();
+  return pi;
+}
+
+
+/**
+ * Create a new path info entry in the global map.
+ *
+ * @param parent parent directory (can be NULL)
+ * @param filename name of the file to create
+ * @param uri URI to use for the path
+ * @param is_directory GNUNET_YES if this entry is for a directory
+ * @return existing path entry if one already exists, otherwise
+ *         new path entry with the desired URI; in both cases
+ *         the reference counter has been incremented by 1
+ */
+struct GNUNET_FUSE_PathInfo *
+GNUNET_FUSE_path_info_create (struct GNUNET_FUSE_PathInfo *parent,
+			      const char *filename,
+			      const struct GNUNET_FS_Uri *uri,
+			      int is_directory)
+{
+  struct GNUNET_FUSE_PathInfo *pi;
+
+  if (NULL != parent)
+  {
+    GNUNET_mutex_lock (parent->lock);
+  }
+
+  pi = path_info_new (parent, filename, uri, is_directory);
+
+  if (NULL != parent)
+  {
+    GNUNET_CONTAINER_DLL_insert_tail (parent->child_head,
+				      parent->child_tail,
+				      pi);
+    if (parent->children_length == parent->children_size)
+      resize_children (parent,
+		       GNUNET_MAX (16, 2 * parent->children_size));
+    pi->child_offset = parent->children_length;
+    parent->children[parent->children_length++] = pi;
+    GNUNET_mutex_unlock (parent->lock);
+  }
+  return pi;
+}
+
+
+/**
+ * Reduce the reference counter of a path info entry.
+ *
+ * @param pi entry to decrement the RC of
+ */
+void
+GNUNET_FUSE_path_info_done (struct GNUNET_FUSE_PathInfo *pi)
+{
+  if (GNUNET_YES == pi->delete_later)
+  {
+    (void) GNUNET_FUSE_path_info_delete (pi);
+    return;
+  }
+  GNUNET_mutex_lock (pi->lock);
+  --pi->rc;
+  GNUNET_mutex_unlock (pi->lock);
+}
+
+
+/**
+ * Free a path info entry that is no longer in the tree and has no
+ * entries below it.  Caller must hold the lock of 'pi' (which is
+ * destroyed with it).
+ *
+ * @param pi entry to free
+ */
+static void
+path_info_free (struct GNUNET_FUSE_PathInfo *pi)
+{
+  if (NULL != pi->content)
+    GNUNET_FUSE_content_release (pi->content);
+  resize_children (pi, 0);
+  if (NULL != pi->index)
+    GNUNET_FUSE_index_destroy (pi->index);
+  tree_update (- (int64_t) entry_size (pi),
+	       -1);
+  GNUNET_free (pi->filename);
+  if (NULL != pi->uri)
+    GNUNET_FS_uri_destroy (pi->uri);
+  GNUNET_mutex_unlock (pi->lock);
+  GNUNET_mutex_destroy (pi->lock);
+  GNUNET_free (pi);
+}
+
+
+/**
+ * Remove all entries below a directory from the tree.  Entries that
+ * are still referenced are freed once they are released.  Caller
+ * must hold the lock of 'pi'.
+ *
+ * @param pi the directory
+ */
+static void
+remove_children (struct GNUNET_FUSE_PathInfo *pi)
+{
+  struct GNUNET_FUSE_PathInfo *pos;
+
+  while (NULL != (pos = pi->child_head))
+  {
+    GNUNET_mutex_lock (pos->lock);
+    ++pos->rc;
+    GNUNET_mutex_unlock (pos->lock);
+    (void) GNUNET_FUSE_path_info_delete (pos);
+  }
+}
+
+
+/**
+ * Delete a path info entry from the tree (does not actually
+ * remove anything from the file system).  Also decrements the RC.
+ *
+ * @param pi entry to remove
+ * @return - ENOENT if the file was already deleted, 0 on success
+ */
+int
+GNUNET_FUSE_path_info_delete (struct GNUNET_FUSE_PathInfo *pi)
+{
+  struct GNUNET_FUSE_PathInfo *parent = pi->parent;
+  int rc;
+  int ret;
+
+  if (NULL != parent)
+  {
+    ret = 0;
+    GNUNET_mutex_lock (parent->lock);
+    GNUNET_mutex_lock (pi->lock);
+    GNUNET_CONTAINER_DLL_remove (parent->child_head,
+				 parent->child_tail,
+				 pi);
+    parent->children[pi->child_offset] = NULL;
+    pi->parent = NULL;
+    GNUNET_mutex_unlock (parent->lock);
+    /* cached attributes may refer to the removed path */
+    GNUNET_FUSE_attr_cache_clear ();
+  }
+  else
+  {
+    ret = - ENOENT;
+    GNUNET_mutex_lock (pi->lock);
+  }
+  rc = --pi->rc;
+  if (0 != rc)
+  {
+    pi->delete_later = GNUNET_YES;
+    GNUNET_mutex_unlock (pi->lock);
+  }
+  else
+  {
+    /* entries below a deleted directory go with it */
+    remove_children (pi);
+    path_info_free (pi);
+  }
+  return ret;
+}
+
+
+/**
+ * A directory that could be collapsed.
+ */
+struct TrimCandidate
+{
+
+  /**
+   * Last use of the directory or of an entry below it.
+   */
+  struct GNUNET_TIME_Absolute last_used;
+
+  /**
+   * Number of bytes collapsing the directory would free.
+   */
+  uint64_t bytes;
+
+  /**
+   * Position of the directory among the candidates in the order
+   * they were found (below the directories below it).
+   */
+  unsigned int pos;
+
+  /**
+   * Position of the first candidate below the directory; the
+   * candidates below it are those from 'first' up to 'pos'.
+   */
+  unsigned int first;
+
+};
+
+
+/**
+ * Closure for 'trim_directory'.
+ */
+struct TrimContext
+{
+
+  /**
+   * Directories that could be collapsed (only collected if
+   * 'collapse' is GNUNET_NO).
+   */
+  struct TrimCandidate *candidates;
+
+  /**
+   * Number of entries in 'candidates'.
+   */
+  unsigned int num_candidates;
+
+  /**
+   * GNUNET_YES to collapse the directories that were last used at
+   * or before 'cutoff'.
+   */
+  int collapse;
+
+  /**
+   * See 'collapse'.
+   */
+  struct GNUNET_TIME_Absolute cutoff;
+
+  /**
+   * Number of entries that were freed by collapsing directories.
+   */
+  unsigned int entries;
+
+};
+
+
+/**
+ * Check if freeing an entry would lose data that was downloaded for
+ * it (because it is only in a temporary file).  Caller must hold
+ * the lock of 'pi'.
+ *
+ * @param pi the entry
+ * @return GNUNET_YES if the entry has data outside of the cache
+ */
+static int
+keeps_data (struct GNUNET_FUSE_PathInfo *pi)
+{
+  struct GNUNET_FUSE_Content *content = pi->content;
+  int ret;
+
+  if (NULL == content)
+    return GNUNET_NO;
+  GNUNET_mutex_lock (content->lock);
+  ret = ( (NULL != content->tmpfile) &&
+	  (GNUNET_YES != content->tmpfile_cached) ) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_mutex_unlock (content->lock);
+  return ret;
+}
+
+
+/**
+ * Collapse a directory back to "not loaded", freeing all entries
+ * below it (none of which may be in use).  Caller must hold the
+ * lock of 'pi'.
+ *
+ * @param pi the directory
+ * @param entries incremented for each entry that was freed
+ */
+static void
+collapse (struct GNUNET_FUSE_PathInfo *pi,
+	  unsigned int *entries)
+{
+  struct GNUNET_FUSE_PathInfo *pos;
+
+  while (NULL != (pos = pi->child_head))
+  {
+    GNUNET_mutex_lock (pos->lock);
+    GNUNET_CONTAINER_DLL_remove (pi->child_head,
+				 pi->child_tail,
+				 pos);
+    pos->parent = NULL;
+    collapse (pos, entries);
+    path_info_free (pos);
+    (*entries)++;
+  }
+  resize_children (pi, 0);
+  pi->children_length = 0;
+  if (NULL != pi->index)
+  {
+    GNUNET_FUSE_index_destroy (pi->index);
+    pi->index = NULL;
+  }
+  /* prefetch the subdirectories again once it is loaded again */
+  pi->prefetched = GNUNET_NO;
+}
+
+
+/**
+ * Find the directories below a directory that could be collapsed,
+ * or collapse them.  A directory can be collapsed if its index is
+ * in the persistent cache and no entry below it is referenced (or
+ * has data that is not in the persistent cache).  Caller must hold
+ * the lock of 'pi'.
+ *
+ * @param pi a directory
+ * @param tc what to do
+ * @param bytes set to the number of bytes collapsing 'pi' would free
+ * @param last_used set to the last use of 'pi' or of an entry below it
+ * @param evicted incremented for each directory that was collapsed
+ *        (not counting directories below another collapsed one)
+ * @return GNUNET_YES if no entry below 'pi' is in use
+ */
+static int
+trim_directory (struct GNUNET_FUSE_PathInfo *pi,
+		struct TrimContext *tc,
+		uint64_t *bytes,
+		struct GNUNET_TIME_Absolute *last_used,
+		unsigned int *evicted)
+{
+  struct GNUNET_FUSE_PathInfo *pos;
+  struct TrimCandidate candidate;
+  struct GNUNET_TIME_Absolute child_used;
+  uint64_t child_bytes;
+  unsigned int below;
+  unsigned int first;
+  int unused;
+
+  unused = GNUNET_YES;
+  below = 0;
+  first = tc->num_candidates;
+  *bytes = pi->children_size * sizeof (struct GNUNET_FUSE_PathInfo *);
+  *last_used = pi->last_used;
+  for (pos = pi->child_head; NULL != pos; pos = pos->next)
+  {
+    GNUNET_mutex_lock (pos->lock);
+    child_bytes = 0;
+    child_used = pos->last_used;
+    if ( ( (NULL != pos->index) ||
+	   (NULL != pos->child_head) ) &&
+	 (GNUNET_YES != trim_directory (pos,
+					tc,
+					&child_bytes,
+					&child_used,
+					&below)) )
+      unused = GNUNET_NO;
+    if ( (0 != pos->rc) ||
+	 ( (NULL != pos->index) &&
+	   (GNUNET_YES != GNUNET_FUSE_index_is_cached (pos->index)) ) ||
+	 (GNUNET_YES == keeps_data (pos)) )
+      unused = GNUNET_NO;
+    *bytes += entry_size (pos) + child_bytes;
+    *last_used = GNUNET_TIME_absolute_max (*last_used,
+					   child_used);
+    GNUNET_mutex_unlock (pos->lock);
+  }
+  if ( (GNUNET_YES == unused) &&
+       (NULL != pi->parent) &&
+       (0 == pi->rc) &&
+       (NULL != pi->index) &&
+       (GNUNET_YES == GNUNET_FUSE_index_is_cached (pi->index)) )
+  {
+    if (GNUNET_YES != tc->collapse)
+    {
+      candidate.last_used = *last_used;
+      candidate.bytes = *bytes;
+      candidate.pos = tc->num_candidates;
+      candidate.first = first;
+      GNUNET_array_append (tc->candidates,
+			   tc->num_candidates,
+			   candidate);
+    }
+    else if (last_used->abs_value_us <= tc->cutoff.abs_value_us)
+    {
+      collapse (pi, &tc->entries);
+      *bytes = 0;
+      below = 1;
+    }
+  }
+  *evicted += below;
+  return unused;
+}
+
+
+/**
+ * Compare two directories that could be collapsed by their last
+ * use (for sorting).
+ *
+ * @param a first directory
+ * @param b second directory
+ * @return -1 if 'a' was used before 'b'
+ */
+static int
+compare_candidates (const void *a,
+		    const void *b)
+{
+  const struct TrimCandidate *ca = a;
+  const struct TrimCandidate *cb = b;
+
+  if (ca->last_used.abs_value_us < cb->last_used.abs_value_us)
+    return -1;
+  if (ca->last_used.abs_value_us > cb->last_used.abs_value_us)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Run 'trim_directory' on the whole tree.  Every lookup starts at
+ * the root, so we only hold its lock to find its entries and then
+ * walk them one after another.
+ *
+ * @param tc what to do
+ * @return number of directories that were collapsed
+ */
+static unsigned int
+trim_tree (struct TrimContext *tc)
+{
+  struct GNUNET_FUSE_PathInfo **entries;
+  struct GNUNET_FUSE_PathInfo *pi;
+  struct GNUNET_FUSE_PathInfo *pos;
+  struct GNUNET_TIME_Absolute last_used;
+  uint64_t bytes;
+  unsigned int evicted;
+  unsigned int num;
+  unsigned int i;
+
+  entries = NULL;
+  num = 0;
+  GNUNET_mutex_lock (root_lock);
+  pi = root;
+  GNUNET_mutex_lock (pi->lock);
+  GNUNET_mutex_unlock (root_lock);
+  for (pos = pi->child_head; NULL != pos; pos = pos->next)
+  {
+    GNUNET_mutex_lock (pos->lock);
+    ++pos->rc;
+    GNUNET_mutex_unlock (pos->lock);
+    GNUNET_array_append (entries, num, pos);
+  }
+  GNUNET_mutex_unlock (pi->lock);
+  evicted = 0;
+  for (i = 0; i < num; i++)
+  {
+    pos = entries[i];
+    GNUNET_mutex_lock (pos->lock);
+    /* our own reference must not keep it from being collapsed;
+       nobody sees it go while we hold the lock */
+    --pos->rc;
+    if ( (NULL != pos->index) ||
+	 (NULL != pos->child_head) )
+      (void) trim_directory (pos, tc, &bytes, &last_used, &evicted);
+    ++pos->rc;
+    GNUNET_mutex_unlock (pos->lock);
+    GNUNET_FUSE_path_info_done (pos);
+  }
+  GNUNET_free_non_null (entries);
+  return evicted;
+}
+
+
+/**
+ * Report the memory used by the tree in the statistics.
+ *
+ * @param memory number of bytes used by the path info entries
+ * @param entries number of path info entries
+ */
+static void
+report_tree (uint64_t memory,
+	     uint64_t entries)
+{
+  GNUNET_FUSE_stats_set (gettext_noop ("# path info entries"),
+			 entries);
+  GNUNET_FUSE_stats_set (gettext_noop ("# bytes used by path info entries"),
+			 memory);
+  GNUNET_FUSE_stats_set (gettext_noop ("# bytes per path info entry"),
+			 (0 == entries) ? 0 : memory / entries);
+}
+
+
+/**
+ * Collapse directories that were not used for a while back to "not
+ * loaded" if the tree uses more memory than allowed.  Only
+ * directories whose index is in the persistent cache and below
+ * which no entry is in use are collapsed.  Cheap unless the tree
+ * is over its budget, and then walks the tree at most once every
+ * TRIM_INTERVAL seconds.  Must be called without holding the lock
+ * of any path info entry.
+ */
+void
+GNUNET_FUSE_path_info_trim ()
+{
+  struct TrimContext tc;
+  struct GNUNET_TIME_Absolute now;
+  uint64_t *counted;
+  int *covered;
+  uint64_t memory;
+  uint64_t entries;
+  uint64_t excess;
+  uint64_t freed;
+  unsigned int evicted;
+  unsigned int i;
+  unsigned int j;
+  int changed;
+  int trim;
+
+  now = GNUNET_TIME_absolute_get ();
+  GNUNET_mutex_lock (tree_lock);
+  memory = tree_memory;
+  entries = tree_entries;
+  changed = tree_changed;
+  tree_changed = GNUNET_NO;
+  if (memory <= tree_budget)
+    trim_threshold = tree_budget;
+  trim = ( (0 != tree_budget) &&
+	   (memory > trim_threshold) &&
+	   (GNUNET_YES != trimming) &&
+	   (now.abs_value_us >= last_trim.abs_value_us
+	    + TRIM_INTERVAL * 1000LL * 1000LL) ) ? GNUNET_YES : GNUNET_NO;
+  if (GNUNET_YES == trim)
+  {
+    trimming = GNUNET_YES;
+    last_trim = now;
+  }
+  GNUNET_mutex_unlock (tree_lock);
+  if (GNUNET_YES == changed)
+    report_tree (memory, entries);
+  if (GNUNET_YES != trim)
+    return;
+  /* find the directories that could be collapsed, then collapse
+     the ones used least recently until we are below our target */
+  memset (&tc, 0, sizeof (tc));
+  (void) trim_tree (&tc);
+  qsort (tc.candidates,
+	 tc.num_candidates,
+	 sizeof (struct TrimCandidate),
+	 &compare_candidates);
+  /* candidates can be below each other; the bytes of a directory
+     include those of the candidates below it, so only count what
+     they did not already free ('counted' and 'covered' are by
+     'pos') */
+  counted = GNUNET_new_array (tc.num_candidates + 1, uint64_t);
+  covered = GNUNET_new_array (tc.num_candidates + 1, int);
+  excess = memory - tree_budget / 100 * TRIM_TARGET;
+  freed = 0;
+  for (i = 0; (i < tc.num_candidates) && (freed < excess); i++)
+  {
+    tc.cutoff = tc.candidates[i].last_used;
+    if (GNUNET_YES == covered[tc.candidates[i].pos])
+      continue;
+    freed += tc.candidates[i].bytes;
+    for (j = tc.candidates[i].first; j < tc.candidates[i].pos; j++)
+    {
+      freed -= counted[j];
+      counted[j] = 0;
+      covered[j] = GNUNET_YES;
+    }
+    counted[tc.candidates[i].pos] = tc.candidates[i].bytes;
+  }
+  GNUNET_free (counted);
+  GNUNET_free (covered);
+  GNUNET_array_grow (tc.candidates,
+		     tc.num_candidates,
+		     0);
+  evicted = 0;
+  if (0 != i)
+  {
+    tc.collapse = GNUNET_YES;
+    evicted = trim_tree (&tc);
+  }
+  GNUNET_mutex_lock (tree_lock);
+  trimming = GNUNET_NO;
+  memory = tree_memory;
+  entries = tree_entries;
+  tree_changed = GNUNET_NO;
+  /* if too much is in use, do not walk the tree again before it
+     grew some more */
+  if (memory > tree_budget)
+    trim_threshold = memory + tree_budget / 100 * (100 - TRIM_TARGET);
+  GNUNET_mutex_unlock (tree_lock);
+  report_tree (memory, entries);
+  GNUNET_FUSE_stats_update (gettext_noop ("# directory subtrees evicted"),
+			    evicted);
+  GNUNET_FUSE_stats_update (gettext_noop ("# path info entries evicted"),
+			    tc.entries);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+	      _("Collapsed %u directories (%u entries), tree uses %llu bytes for %llu entries\n"),
+	      evicted,
+	      tc.entries,
+	      (unsigned long long) memory,
+	      (unsigned long long) entries);
+}
+
+
+/**
+ * Called on each node in the path info tree to clean it up.
+ *
+ * @param pi path info to clean up
+ */
+static void
+cleanup_path_info (struct GNUNET_FUSE_PathInfo *pi)
+{
+  struct GNUNET_FUSE_PathInfo *pos;
+
+  while (NULL != (pos = pi->child_head))
+    cleanup_path_info (pos);
+  ++pi->rc;
+  (void) GNUNET_FUSE_path_info_delete (pi);
+}
+
+
+/**
+ * Wait for the background loading of the root directory (if any)
+ * to finish.  Must not be called while holding the lock of the root.
+ *
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK once the root can be accessed, GNUNET_SYSERR if
+ *         we gave up waiting
+ */
+int
+GNUNET_FUSE_root_wait (int *eno)
+{
+  struct GNUNET_TIME_Absolute deadline;
+
+  if (NULL == root_loading_lock)
+    return GNUNET_OK;
+  deadline = GNUNET_TIME_relative_to_absolute (root_timeout);
+  GNUNET_mutex_lock (root_loading_lock);
+  while (GNUNET_YES == root_loading)
+  {
+    if (GNUNET_OK != GNUNET_cond_timedwait (root_loaded_cond,
+					    root_loading_lock,
+					    deadline))
+      break;
+  }
+  if (GNUNET_YES == root_loading)
+  {
+    GNUNET_mutex_unlock (root_loading_lock);
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Root directory not yet available\n");
+    *eno = EAGAIN;
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_unlock (root_loading_lock);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Move the entries of an old version of a directory that did not
+ * change in the new version (by name and CHK) into the new version,
+ * with everything below them.  Changed subdirectories that were
+ * loaded are loaded in their new version as well and handled the
+ * same way, so that unchanged files deep down keep their data.
+ *
+ * @param old_dir old version of the directory (in the live tree)
+ * @param new_dir new version of the directory (loaded, not yet in
+ *        the live tree)
+ * @param kept incremented for each entry that was moved
+ * @param loaded incremented for each directory that was loaded
+ */
+static void
+graft (struct GNUNET_FUSE_PathInfo *old_dir,
+       struct GNUNET_FUSE_PathInfo *new_dir,
+       unsigned int *kept,
+       unsigned int *loaded)
+{
+  struct GNUNET_FUSE_PathInfo **changed;
+  struct GNUNET_FUSE_PathInfo *pos;
+  struct GNUNET_FUSE_PathInfo *next;
+  struct GNUNET_FUSE_PathInfo *child;
+  struct GNUNET_FS_Uri *uri;
+  unsigned int *offsets;
+  unsigned int num_changed;
+  unsigned int num_offsets;
+  unsigned int off;
+  unsigned int i;
+  char *emsg;
+  int eno;
+
+  changed = NULL;
+  offsets = NULL;
+  num_changed = 0;
+  num_offsets = 0;
+  GNUNET_mutex_lock (old_dir->lock);
+  GNUNET_mutex_lock (new_dir->lock);
+  for (pos = old_dir->child_head; NULL != pos; pos = next)
+  {
+    next = pos->next;
+    if ( (GNUNET_YES != GNUNET_FUSE_index_lookup (new_dir->index,
+						  pos->filename,
+						  &off)) ||
+	 (NULL != new_dir->children[off]) )
+      continue; /* removed */
+    uri = GNUNET_FS_uri_parse (GNUNET_FUSE_index_get_uri (new_dir->index,
+							  off),
+			       &emsg);
+    if (NULL == uri)
+    {
+      GNUNET_free (emsg);
+      continue;
+    }
+    GNUNET_mutex_lock (pos->lock);
+    if (GNUNET_YES == GNUNET_FS_uri_test_equal (uri, pos->uri))
+    {
+      /* unchanged, keep it with everything below it */
+      GNUNET_CONTAINER_DLL_remove (old_dir->child_head,
+				   old_dir->child_tail,
+				   pos);
+      old_dir->children[pos->child_offset] = NULL;
+      pos->parent = new_dir;
+      pos->child_offset = off;
+      new_dir->children[off] = pos;
+      GNUNET_CONTAINER_DLL_insert_tail (new_dir->child_head,
+					new_dir->child_tail,
+					pos);
+      (*kept)++;
+    }
+    else if ( (NULL != pos->index) &&
+	      (GNUNET_YES == GNUNET_FUSE_index_is_directory (new_dir->index,
+							     off)) )
+    {
+      ++pos->rc;
+      GNUNET_array_append (changed, num_changed, pos);
+      GNUNET_array_append (offsets, num_offsets, off);
+    }
+    GNUNET_mutex_unlock (pos->lock);
+    GNUNET_FS_uri_destroy (uri);
+  }
+  GNUNET_mutex_unlock (new_dir->lock);
+  GNUNET_mutex_unlock (old_dir->lock);
+  /* do not block the live tree while loading */
+  for (i = 0; i < num_changed; i++)
+  {
+    if (NULL != (child = GNUNET_FUSE_path_info_get_child (new_dir,
+							  offsets[i])))
+    {
+      GNUNET_mutex_lock (child->lock);
+      if ( (NULL != child->index) ||
+	   (GNUNET_OK == GNUNET_FUSE_load_directory (child,
+						     GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+						     &eno)) )
+      {
+	GNUNET_mutex_unlock (child->lock);
+	(*loaded)++;
+	graft (changed[i], child, kept, loaded);
+      }
+      else
+      {
+	GNUNET_mutex_unlock (child->lock);
+      }
+      GNUNET_FUSE_path_info_done (child);
+    }
+    GNUNET_FUSE_path_info_done (changed[i]);
+  }
+  GNUNET_free_non_null (changed);
+  GNUNET_free_non_null (offsets);
+}
+
+
+/**
+ * Load another version of a directory and move the entries of the
+ * current version that did not change into it (see 'graft').
+ *
+ * @param old_dir current version of the directory
+ * @param uri URI of the new version
+ * @param eno where to store 'errno' on errors
+ * @return NULL on error, otherwise the new version (not in the
+ *         tree) with a reference counter of 1
+ */
+static struct GNUNET_FUSE_PathInfo *
+load_version (struct GNUNET_FUSE_PathInfo *old_dir,
+	      const struct GNUNET_FS_Uri *uri,
+	      int *eno)
+{
+  struct GNUNET_FUSE_PathInfo *new_dir;
+  struct GNUNET_TIME_Absolute start;
+  unsigned int kept;
+  unsigned int loaded;
+
+  start = GNUNET_TIME_absolute_get ();
+  new_dir = path_info_new (NULL, old_dir->filename, uri, GNUNET_YES);
+  GNUNET_mutex_lock (new_dir->lock);
+  if (GNUNET_OK != GNUNET_FUSE_load_directory (new_dir,
+					       GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+					       eno))
+  {
+    GNUNET_mutex_unlock (new_dir->lock);
+    (void) GNUNET_FUSE_path_info_delete (new_dir);
+    return NULL;
+  }
+  GNUNET_mutex_unlock (new_dir->lock);
+  kept = 0;
+  loaded = 1;
+  graft (old_dir, new_dir, &kept, &loaded);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+	      _("Switched `/%s' to new version after %s, kept %u entries, loaded %u directories\n"),
+	      old_dir->filename,
+	      GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
+						      GNUNET_YES),
+	      kept,
+	      loaded);
+  GNUNET_FUSE_stats_update (gettext_noop ("# root switches"),
+			    1);
+  GNUNET_FUSE_stats_update (gettext_noop ("# entries kept by root switches"),
+			    kept);
+  return new_dir;
+}
+
+
+/**
+ * Switch to another version of the root directory.  Entries that
+ * did not change are moved to the new version with their data (and
+ * everything below them); only directories that changed are loaded.
+ * Not possible when mounting several URIs (switch the mounted
+ * directories with 'GNUNET_FUSE_mount_add' instead).
+ *
+ * @param uri URI of the new version of the root directory
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_root_switch (const struct GNUNET_FS_Uri *uri,
+			 int *eno)
+{
+  struct GNUNET_FUSE_PathInfo *old_root;
+  struct GNUNET_FUSE_PathInfo *new_root;
+
+  if (NULL != mounts_file)
+  {
+    *eno = ENOTSUP;
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_YES != GNUNET_FS_uri_test_chk (uri))
+  {
+    *eno = EINVAL;
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != GNUNET_FUSE_root_wait (eno))
+    return GNUNET_SYSERR;
+  GNUNET_mutex_lock (switch_lock);
+  if (NULL == (old_root = GNUNET_FUSE_path_info_get ("/", eno)))
+  {
+    GNUNET_mutex_unlock (switch_lock);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_YES == GNUNET_FS_uri_test_equal (uri, old_root->uri))
+  {
+    GNUNET_FUSE_path_info_done (old_root);
+    GNUNET_mutex_unlock (switch_lock);
+    return GNUNET_OK;
+  }
+  if (NULL == (new_root = load_version (old_root, uri, eno)))
+  {
+    GNUNET_FUSE_path_info_done (old_root);
+    GNUNET_mutex_unlock (switch_lock);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_lock (root_lock);
+  root = new_root;
+  GNUNET_mutex_unlock (root_lock);
+  /* cached attributes refer to the old version */
+  GNUNET_FUSE_attr_cache_clear ();
+  /* entries of the old version that are still in use go away
+     once they are released */
+  (void) GNUNET_FUSE_path_info_delete (old_root);
+  GNUNET_FUSE_path_info_done (old_root);
+  GNUNET_mutex_unlock (switch_lock);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Compare two mounted directories by name (for sorting).
+ *
+ * @param a first directory
+ * @param b second directory
+ * @return result of comparing the names
+ */
+static int
+compare_mounts (const void *a,
+		const void *b)
+{
+  const struct GNUNET_FUSE_PathInfo *const *pa = a;
+  const struct GNUNET_FUSE_PathInfo *const *pb = b;
+
+  return strcmp ((*pa)->filename,
+		 (*pb)->filename);
+}
+
+
+/**
+ * Rebuild the index of the root from the mounted directories (the
+ * children of the root) after adding or removing one.  Caller must
+ * hold the lock of the root.
+ */
+static void
+rebuild_mounts ()
+{
+  struct GNUNET_FUSE_PathInfo **mounts;
+  struct GNUNET_FUSE_PathInfo *pos;
+  const char **names;
+  const struct GNUNET_FS_Uri **uris;
+  unsigned int num;
+  unsigned int i;
+
+  num = 0;
+  for (pos = root->child_head; NULL != pos; pos = pos->next)
+    num++;
+  mounts = GNUNET_new_array (num + 1, struct GNUNET_FUSE_PathInfo *);
+  names = GNUNET_new_array (num + 1, const char *);
+  uris = GNUNET_new_array (num + 1, const struct GNUNET_FS_Uri *);
+  i = 0;
+  for (pos = root->child_head; NULL != pos; pos = pos->next)
+    mounts[i++] = pos;
+  qsort (mounts,
+	 num,
+	 sizeof (struct GNUNET_FUSE_PathInfo *),
+	 &compare_mounts);
+  for (i = 0; i < num; i++)
+  {
+    names[i] = mounts[i]->filename;
+    uris[i] = mounts[i]->uri;
+  }
+  if (NULL != root->index)
+    GNUNET_FUSE_index_destroy (root->index);
+  root->index = GNUNET_FUSE_index_create_virtual (num,
+						  names,
+						  uris);
+  /* the root has no entries that were not instantiated */
+  resize_children (root, num);
+  root->children_length = num;
+  for (i = 0; i < num; i++)
+  {
+    mounts[i]->child_offset = i;
+    root->children[i] = mounts[i];
+  }
+  GNUNET_free (mounts);
+  GNUNET_free (names);
+  GNUNET_free (uris);
+  /* cached attributes may refer to entries that moved */
+  GNUNET_FUSE_attr_cache_clear ();
+}
+
+
+/**
+ * Add a directory to the root as a mounted directory.  Caller must
+ * hold the lock of the root.
+ *
+ * @param pi the directory (not in the tree), the tree takes over
+ *        its reference
+ */
+static void
+insert_mount (struct GNUNET_FUSE_PathInfo *pi)
+{
+  GNUNET_mutex_lock (pi->lock);
+  pi->parent = root;
+  pi->rc--; /* only referenced by the tree */
+  GNUNET_mutex_unlock (pi->lock);
+  GNUNET_CONTAINER_DLL_insert_tail (root->child_head,
+				    root->child_tail,
+				    pi);
+}
+
+
+/**
+ * Remove a mounted directory from the root (without freeing it).
+ * Caller must hold the lock of the root and a reference to the
+ * directory, and must delete it afterwards.
+ *
+ * @param pi the directory
+ */
+static void
+detach_mount (struct GNUNET_FUSE_PathInfo *pi)
+{
+  GNUNET_mutex_lock (pi->lock);
+  GNUNET_CONTAINER_DLL_remove (root->child_head,
+			       root->child_tail,
+			       pi);
+  root->children[pi->child_offset] = NULL;
+  pi->parent = NULL;
+  GNUNET_mutex_unlock (pi->lock);
+}
+
+
+/**
+ * Check if a name can be used for a mounted directory.
+ *
+ * @param name name to check
+ * @return GNUNET_OK if the name is valid
+ */
+static int
+check_mount_name (const char *name)
+{
+  if ( ('\0' == name[0]) ||
+       (NULL != strchr (name, '/')) ||
+       (0 == strcmp (name, ".")) ||
+       (0 == strcmp (name, "..")) )
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Mount a directory as a top-level entry of the mount, or switch an
+ * entry that was mounted under the same name to another version
+ * (like 'GNUNET_FUSE_root_switch').  Only possible when mounting
+ * several URIs.
+ *
+ * @param name name of the entry
+ * @param uri URI of the directory
+ * @param flags XATTR_CREATE to fail (with EEXIST) if an entry is
+ *        mounted under the name, XATTR_REPLACE to fail (with
+ *        ENODATA) if none is, or 0
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_mount_add (const char *name,
+		       const struct GNUNET_FS_Uri *uri,
+		       int flags,
+		       int *eno)
+{
+  struct GNUNET_FUSE_PathInfo *old_dir;
+  struct GNUNET_FUSE_PathInfo *new_dir;
+  unsigned int off;
+
+  if (NULL == mounts_file)
+  {
+    *eno = ENOTSUP;
+    return GNUNET_SYSERR;
+  }
+  if ( (GNUNET_OK != check_mount_name (name)) ||
+       ( (GNUNET_YES != GNUNET_FS_uri_test_chk (uri)) &&
+	 (GNUNET_YES != GNUNET_FS_uri_test_loc (uri)) ) )
+  {
+    *eno = EINVAL;
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_lock (switch_lock);
+  GNUNET_mutex_lock (root->lock);
+  old_dir = NULL;
+  if (GNUNET_YES == GNUNET_FUSE_index_lookup (root->index,
+					      name,
+					      &off))
+  {
+    old_dir = root->children[off];
+    GNUNET_mutex_lock (old_dir->lock);
+    ++old_dir->rc;
+    GNUNET_mutex_unlock (old_dir->lock);
+  }
+  GNUNET_mutex_unlock (root->lock);
+  if ( ( (NULL != old_dir) &&
+	 (0 != (flags & XATTR_CREATE)) ) ||
+       ( (NULL == old_dir) &&
+	 (0 != (flags & XATTR_REPLACE)) ) )
+  {
+    *eno = (NULL != old_dir) ? EEXIST : ENODATA;
+    if (NULL != old_dir)
+      GNUNET_FUSE_path_info_done (old_dir);
+    GNUNET_mutex_unlock (switch_lock);
+    return GNUNET_SYSERR;
+  }
+  if (NULL == old_dir)
+  {
+    /* load it now, so that we fail if it is not a directory */
+    new_dir = path_info_new (NULL, name, uri, GNUNET_YES);
+    GNUNET_mutex_lock (new_dir->lock);
+    if (GNUNET_OK != GNUNET_FUSE_load_directory (new_dir,
+						 GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+						 eno))
+    {
+      GNUNET_mutex_unlock (new_dir->lock);
+      (void) GNUNET_FUSE_path_info_delete (new_dir);
+      GNUNET_mutex_unlock (switch_lock);
+      return GNUNET_SYSERR;
+    }
+    GNUNET_mutex_unlock (new_dir->lock);
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+		_("Mounted `/%s'\n"),
+		name);
+  }
+  else if (GNUNET_YES == GNUNET_FS_uri_test_equal (uri, old_dir->uri))
+  {
+    GNUNET_FUSE_path_info_done (old_dir);
+    GNUNET_mutex_unlock (switch_lock);
+    return GNUNET_OK;
+  }
+  else if (NULL == (new_dir = load_version (old_dir, uri, eno)))
+  {
+    GNUNET_FUSE_path_info_done (old_dir);
+    GNUNET_mutex_unlock (switch_lock);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_mutex_lock (root->lock);
+  if (NULL != old_dir)
+    detach_mount (old_dir);
+  insert_mount (new_dir);
+  rebuild_mounts ();
+  GNUNET_mutex_unlock (root->lock);
+  if (NULL != old_dir)
+  {
+    /* entries of the old version that are still in use go away
+       once they are released */
+    (void) GNUNET_FUSE_path_info_delete (old_dir);
+  }
+  if (NULL == old_dir)
+    GNUNET_FUSE_stats_update (gettext_noop ("# mounted directories"),
+			      1);
+  GNUNET_mutex_unlock (switch_lock);
+  return GNUNET_OK;
 }
 
 
 /**
- * Create a new path info entry in the global map.
+ * Remove a top-level entry that was mounted with
+ * 'GNUNET_FUSE_mount_add' (or from the mounts file).  Files of the
+ * entry that are open can still be read.
  *
- * @param parent parent directory (can be NULL)
- * @param filename name of the file to create
- * @param uri URI to use for the path
- * @param is_directory GNUNET_YES if this entry is for a directory
- * @return existing path entry if one already exists, otherwise
- *         new path entry with the desired URI; in both cases
- *         the reference counter has been incremented by 1
+ * @param name name of the entry
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
  */
-struct GNUNET_FUSE_PathInfo *
-GNUNET_FUSE_path_info_create (struct GNUNET_FUSE_PathInfo *parent,
-			      const char *filename,
-			      const struct GNUNET_FS_Uri *uri,
-			      int is_directory)
+int
+GNUNET_FUSE_mount_remove (const char *name,
+			  int *eno)
 {
   struct GNUNET_FUSE_PathInfo *pi;
-  size_t len;
-
-  if (NULL != parent)
-  {
-    GNUNET_mutex_lock (parent->lock);
-  }
+  unsigned int off;
 
-  pi = GNUNET_new (struct GNUNET_FUSE_PathInfo);
-  pi->parent = parent;
-  pi->filename = GNUNET_strdup (filename);
-  len = strlen (pi->filename);
-  if ('/' == pi->filename[len - 1])
-    pi->filename[len - 1] = '\0';
-  pi->uri = GNUNET_FS_uri_dup (uri);
-  pi->lock = GNUNET_mutex_create (GNUNET_YES);
-  pi->rc = 1;
-  pi->stbuf.st_mode = (S_IRUSR | S_IRGRP | S_IROTH); /* read-only */
-  if (GNUNET_YES == is_directory)
+  if (NULL == mounts_file)
   {
-    pi->stbuf.st_mode |= S_IFDIR | (S_IXUSR | S_IXGRP | S_IXOTH); /* allow traversal */
-  }
-  else
-  {
-    pi->stbuf.st_mode |= S_IFREG; /* regular file */
-    pi->stbuf.st_size = (off_t) GNUNET_FS_uri_chk_get_file_size (uri);
+    *eno = ENOTSUP;
+    return GNUNET_SYSERR;
   }
-
-  if (NULL != parent)
+  GNUNET_mutex_lock (switch_lock);
+  GNUNET_mutex_lock (root->lock);
+  if (GNUNET_YES != GNUNET_FUSE_index_lookup (root->index,
+					      name,
+					      &off))
   {
-    GNUNET_CONTAINER_DLL_insert_tail (parent->child_head,
-				      parent->child_tail,
-				      pi);
-    GNUNET_mutex_unlock (parent->lock);
+    GNUNET_mutex_unlock (root->lock);
+    GNUNET_mutex_unlock (switch_lock);
+    *eno = ENOENT;
+    return GNUNET_SYSERR;
   }
-  return pi;
+  pi = root->children[off];
+  GNUNET_mutex_lock (pi->lock);
+  ++pi->rc;
+  GNUNET_mutex_unlock (pi->lock);
+  detach_mount (pi);
+  rebuild_mounts ();
+  GNUNET_mutex_unlock (root->lock);
+  (void) GNUNET_FUSE_path_info_delete (pi);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+	      _("Unmounted `/%s'\n"),
+	      name);
+  GNUNET_FUSE_stats_update (gettext_noop ("# mounted directories"),
+			    -1);
+  GNUNET_mutex_unlock (switch_lock);
+  return GNUNET_OK;
 }
 
 
 /**
- * Reduce the reference counter of a path info entry.
+ * List the top-level entries when mounting several URIs.
  *
- * @param pi entry to decrement the RC of
+ * @return one line with the name and URI of each entry (caller must
+ *         free), NULL if we mount a single URI
  */
-void
-GNUNET_FUSE_path_info_done (struct GNUNET_FUSE_PathInfo *pi)
+char *
+GNUNET_FUSE_mount_list ()
 {
-  if (GNUNET_YES == pi->delete_later)
+  char *list;
+  char *tmp;
+  char *us;
+  unsigned int i;
+
+  if (NULL == mounts_file)
+    return NULL;
+  list = GNUNET_strdup ("");
+  GNUNET_mutex_lock (root->lock);
+  for (i = 0; i < root->children_length; i++)
   {
-    (void) GNUNET_FUSE_path_info_delete (pi);
-    return;
+    us = GNUNET_FS_uri_to_string (root->children[i]->uri);
+    GNUNET_asprintf (&tmp,
+		     "%s%s %s\n",
+		     list,
+		     root->children[i]->filename,
+		     us);
+    GNUNET_free (us);
+    GNUNET_free (list);
+    list = tmp;
   }
-  GNUNET_mutex_lock (pi->lock);
-  --pi->rc;
-  GNUNET_mutex_unlock (pi->lock);
+  GNUNET_mutex_unlock (root->lock);
+  return list;
 }
 
 
 /**
- * Delete a path info entry from the tree (does not actually
- * remove anything from the file system).  Also decrements the RC.
+ * Read the mounts file and add its directories to the (empty) root.
+ * Each line has the name of a top-level entry and the URI to mount
+ * there; empty lines and lines starting with '#' are ignored.  The
+ * directories are only loaded once they are accessed.
  *
- * @param pi entry to remove
- * @return - ENOENT if the file was already deleted, 0 on success
+ * @param filename name of the mounts file
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the file could not
+ *         be read or is malformed
  */
-int
-GNUNET_FUSE_path_info_delete (struct GNUNET_FUSE_PathInfo *pi)
+static int
+read_mounts (const char *filename)
 {
-  struct GNUNET_FUSE_PathInfo *parent = pi->parent;
-  int rc;
+  struct GNUNET_FUSE_PathInfo *pi;
+  struct GNUNET_FS_Uri *uri;
+  char line[4096];
+  char *tok[3];
+  char *save;
+  char *emsg;
+  FILE *f;
+  unsigned int lno;
+  unsigned int n;
+  unsigned int i;
   int ret;
 
-  if (NULL != parent)
+  if (NULL == (f = fopen (filename, "r")))
   {
-    ret = 0;
-    GNUNET_mutex_lock (parent->lock);
-    GNUNET_mutex_lock (pi->lock);
-    GNUNET_CONTAINER_DLL_remove (parent->child_head,
-				 parent->child_tail,
-				 pi);
-    pi->parent = NULL;
-    GNUNET_mutex_unlock (parent->lock);
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+			      "fopen",
+			      filename);
+    return GNUNET_SYSERR;
   }
-  else
+  ret = GNUNET_OK;
+  lno = 0;
+  GNUNET_mutex_lock (root->lock);
+  while ( (GNUNET_OK == ret) &&
+	  (NULL != fgets (line, sizeof (line), f)) )
   {
-    ret = - ENOENT;
-    GNUNET_mutex_lock (pi->lock);
+    lno++;
+    for (n = 0; n < 3; n++)
+      if (NULL == (tok[n] = strtok_r ((0 == n) ? line : NULL,
+				      " \t\r\n",
+				      &save)))
+	break;
+    if ( (0 == n) ||
+	 ('#' == tok[0][0]) )
+      continue;
+    emsg = NULL;
+    uri = NULL;
+    if ( (2 != n) ||
+	 (GNUNET_OK != check_mount_name (tok[0])) ||
+	 (NULL == (uri = GNUNET_FS_uri_parse (tok[1], &emsg))) ||
+	 ( (GNUNET_YES != GNUNET_FS_uri_test_chk (uri)) &&
+	   (GNUNET_YES != GNUNET_FS_uri_test_loc (uri)) ) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		  _("Malformed line %u in mounts file `%s'\n"),
+		  lno,
+		  filename);
+      GNUNET_free_non_null (emsg);
+      if (NULL != uri)
+	GNUNET_FS_uri_destroy (uri);
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    pi = path_info_new (NULL, tok[0], uri, GNUNET_YES);
+    GNUNET_FS_uri_destroy (uri);
+    insert_mount (pi);
   }
-  rc = --pi->rc;
-  if (0 != rc)
+  rebuild_mounts ();
+  for (i = 1; i < root->children_length; i++)
+    if (0 == strcmp (root->children[i - 1]->filename,
+		     root->children[i]->filename))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		  _("Name `%s' used twice in mounts file `%s'\n"),
+		  root->children[i]->filename,
+		  filename);
+      ret = GNUNET_SYSERR;
+    }
+  GNUNET_FUSE_stats_update (gettext_noop ("# mounted directories"),
+			    root->children_length);
+  GNUNET_mutex_unlock (root->lock);
+  GNUNET_break (0 == fclose (f));
+  return ret;
+}
+
+
+/**
+ * Thread that loads the root directory in the background.  If loading
+ * fails, the root is left unloaded and will be loaded on demand by
+ * the next operation that needs it.
+ *
+ * @param cls NULL
+ * @return NULL
+ */
+static void *
+load_root (void *cls)
+{
+  struct GNUNET_FUSE_PathInfo *pi;
+  int loaded;
+  int eno;
+
+  /* looking up "/" does not wait for us */
+  if (NULL != (pi = GNUNET_FUSE_path_info_get ("/", &eno)))
   {
-    pi->delete_later = GNUNET_YES;
+    GNUNET_mutex_lock (pi->lock);
+    loaded = (NULL != pi->index) ? GNUNET_YES : GNUNET_NO;
     GNUNET_mutex_unlock (pi->lock);
+    /* operations on the root that do not need its listing (i.e.
+       stat of the mountpoint) must not wait for the download on
+       its lock */
+    if ( (GNUNET_YES != loaded) &&
+	 (GNUNET_OK != GNUNET_FUSE_load_directory_unlocked (pi,
+							    GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+							    &eno)) )
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		  _("Failed to load `%s' in the background: %s\n"),
+		  source,
+		  strerror (eno));
+    GNUNET_FUSE_path_info_done (pi);
   }
-  else
+  GNUNET_mutex_lock (root_loading_lock);
+  root_loading = GNUNET_NO;
+  GNUNET_cond_broadcast (root_loaded_cond);
+  GNUNET_mutex_unlock (root_loading_lock);
+  return NULL;
+}
+
+
+/**
+ * Called by FUSE once the file system is mounted (and after FUSE
+ * daemonized the process, so threads started here survive).
+ *
+ * @param conn connection information
+ * @return NULL (no private data)
+ */
+static void *
+gn_init (struct fuse_conn_info *conn)
+{
+  GNUNET_FUSE_prefetch_start ();
+  GNUNET_FUSE_warmup_start ();
+  if (NULL == root_loading_lock)
+    return NULL;
+  if (0 != (errno = pthread_create (&root_loader,
+				    NULL,
+				    &load_root,
+				    NULL)))
   {
-    if (NULL != pi->tmpfile)
-    {
-      GNUNET_break (0 == unlink (pi->tmpfile));
-      GNUNET_free (pi->tmpfile);
-    }
-    GNUNET_free (pi->filename);
-    GNUNET_FS_uri_destroy (pi->uri);
-    GNUNET_mutex_unlock (pi->lock);
-    GNUNET_mutex_destroy (pi->lock);
-    GNUNET_free (pi);
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+			 "pthread_create");
+    /* load on demand instead */
+    GNUNET_mutex_lock (root_loading_lock);
+    root_loading = GNUNET_NO;
+    GNUNET_cond_broadcast (root_loaded_cond);
+    GNUNET_mutex_unlock (root_loading_lock);
+    return NULL;
   }
-  return ret;
+  root_loader_started = GNUNET_YES;
+  return NULL;
 }
 
 
 /**
- * Called on each node in the path info tree to clean it up.
+ * Key of the marker of threads that serve a FUSE operation.
+ */
+static pthread_key_t operation_key;
+
+/**
+ * Makes sure 'operation_key' is created once.
+ */
+static pthread_once_t operation_key_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Create 'operation_key'.
+ */
+static void
+create_operation_key ()
+{
+  GNUNET_assert (0 == pthread_key_create (&operation_key, NULL));
+}
+
+
+/**
+ * Mark the calling thread as serving a FUSE operation, or not.
  *
- * @param pi path info to clean up
+ * @param in_operation GNUNET_YES while the thread serves an operation
  */
 static void
-cleanup_path_info (struct GNUNET_FUSE_PathInfo *pi)
+set_in_operation (int in_operation)
 {
-  struct GNUNET_FUSE_PathInfo *pos;
+  (void) pthread_once (&operation_key_once, &create_operation_key);
+  GNUNET_break (0 == pthread_setspecific (operation_key,
+					  (GNUNET_YES == in_operation)
+					  ? &operation_key
+					  : NULL));
+}
 
-  while (NULL != (pos = pi->child_head))
-    cleanup_path_info (pos);
-  ++pi->rc;
-  (void) GNUNET_FUSE_path_info_delete (pi);
+
+/**
+ * Check if the calling thread serves a FUSE operation (and can thus
+ * be interrupted by FUSE and has a deadline).  Threads loading the
+ * root before mounting or in the background, the crawler and the
+ * like do not.
+ *
+ * @return GNUNET_YES if the thread serves a FUSE operation
+ */
+int
+GNUNET_FUSE_in_operation ()
+{
+  (void) pthread_once (&operation_key_once, &create_operation_key);
+  return (NULL != pthread_getspecific (operation_key)) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * FUSE 'getattr' (marks the thread as serving an operation).
+ */
+static int
+op_getattr (const char *path,
+	    struct stat *stbuf)
+{
+  int ret;
+
+  set_in_operation (GNUNET_YES);
+  ret = gn_getattr (path, stbuf);
+  set_in_operation (GNUNET_NO);
+  return ret;
+}
+
+
+/**
+ * FUSE 'readdir' (marks the thread as serving an operation).
+ */
+static int
+op_readdir (const char *path,
+	    void *buf,
+	    fuse_fill_dir_t filler,
+	    off_t offset,
+	    struct fuse_file_info *fi)
+{
+  int ret;
+
+  set_in_operation (GNUNET_YES);
+  ret = gn_readdir (path, buf, filler, offset, fi);
+  set_in_operation (GNUNET_NO);
+  return ret;
+}
+
+
+/**
+ * FUSE 'open' (marks the thread as serving an operation).
+ */
+static int
+op_open (const char *path,
+	 struct fuse_file_info *fi)
+{
+  int ret;
+
+  set_in_operation (GNUNET_YES);
+  ret = gn_open (path, fi);
+  set_in_operation (GNUNET_NO);
+  return ret;
+}
+
+
+/**
+ * FUSE 'read' (marks the thread as serving an operation).
+ */
+static int
+op_read (const char *path,
+	 char *buf,
+	 size_t size,
+	 off_t offset,
+	 struct fuse_file_info *fi)
+{
+  int ret;
+
+  set_in_operation (GNUNET_YES);
+  ret = gn_read (path, buf, size, offset, fi);
+  set_in_operation (GNUNET_NO);
+  return ret;
+}
+
+
+/**
+ * FUSE 'getxattr' (marks the thread as serving an operation).
+ */
+static int
+op_getxattr (const char *path,
+	     const char *name,
+	     char *value,
+	     size_t size)
+{
+  int ret;
+
+  set_in_operation (GNUNET_YES);
+  ret = gn_getxattr (path, name, value, size);
+  set_in_operation (GNUNET_NO);
+  return ret;
+}
+
+
+/**
+ * FUSE 'setxattr' (marks the thread as serving an operation).
+ */
+static int
+op_setxattr (const char *path,
+	     const char *name,
+	     const char *value,
+	     size_t size,
+	     int flags)
+{
+  int ret;
+
+  set_in_operation (GNUNET_YES);
+  ret = gn_setxattr (path, name, value, size, flags);
+  set_in_operation (GNUNET_NO);
+  return ret;
 }
 
 
@@ -398,32 +2439,56 @@ run (void *cls,
   static struct fuse_operations fops = {
     //  .mkdir = gn_mkdir,
     //  .mknod = gn_mknod,
-    //  .release = gn_release,
     //  .rename = gn_rename,
     //  .rmdir = gn_rmdir,
     //  .truncate = gn_truncate,
     //  .unlink = gn_unlink,
     //  .utimens = gn_utimens,
     //  .write = gn_write,
-    .getattr = gn_getattr,
-    .readdir = gn_readdir,
-    .open = gn_open,
-    .read = gn_read
+    .init = gn_init,
+    .getattr = op_getattr,
+    .readdir = op_readdir,
+    .open = op_open,
+    .read = op_read,
+    .release = gn_release,
+    .getxattr = op_getxattr,
+    .setxattr = op_setxattr,
+    .removexattr = gn_removexattr
   };
 
   int argc;
   struct GNUNET_FS_Uri *uri;
   char *emsg;
   int eno;
+  unsigned long long attr_cache_size;
+  unsigned long long hot_cache_size;
+  unsigned long long compressed_cache_size;
+  unsigned long long prefetch_depth;
+  unsigned long long prefetch_budget;
+  unsigned long long scan_budget;
+  unsigned long long download_slots;
+  unsigned long long hedge_percentile;
+  struct GNUNET_TIME_Relative kernel_timeout;
+  struct GNUNET_TIME_Relative local_timeout;
+  struct GNUNET_TIME_Relative retry_deadline;
+  char *timeouts;
 
   cfg = c;
   ret = 0;
-  if (NULL == source)
+  if ( (NULL == source) &&
+       (NULL == mounts_file) )
     {
       fprintf (stderr, _("`%s' option for URI missing\n"), "-s");
       ret = 1;
       return;
     }
+  if ( (NULL != source) &&
+       (NULL != mounts_file) )
+    {
+      fprintf (stderr, _("`%s' and `%s' options cannot be used together\n"), "-s", "-M");
+      ret = 1;
+      return;
+    }
   if (NULL == directory)
     {
       fprintf (stderr, _("`%s' option for mountpoint missing\n"), "-d");
@@ -432,14 +2497,17 @@ run (void *cls,
     }
 
   /* parse source string to uri */
-  if (NULL == (uri = GNUNET_FS_uri_parse (source, &emsg)))
+  uri = NULL;
+  if ( (NULL != source) &&
+       (NULL == (uri = GNUNET_FS_uri_parse (source, &emsg))) )
     {
       fprintf (stderr, "%s\n", emsg);
       GNUNET_free (emsg);
       ret = 3;
       return;
     }
-  if ( (GNUNET_YES != GNUNET_FS_uri_test_chk (uri)) &&
+  if ( (NULL != uri) &&
+       (GNUNET_YES != GNUNET_FS_uri_test_chk (uri)) &&
        (GNUNET_YES != GNUNET_FS_uri_test_loc (uri)) )
   {
     fprintf (stderr,
@@ -449,40 +2517,249 @@ run (void *cls,
     return;
   }
 
-  root = GNUNET_FUSE_path_info_create (NULL, "/", uri, GNUNET_YES);
   if (GNUNET_OK !=
-      GNUNET_FUSE_load_directory (root, &eno))
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+					     GNUNET_FUSE_CONFIG_SECTION,
+					     "ATTR_CACHE_SIZE",
+					     &attr_cache_size))
+    attr_cache_size = 65536;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "HOT_CACHE_SIZE",
+					   &hot_cache_size))
+    hot_cache_size = 0;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "HOT_CACHE_COMPRESSED_SIZE",
+					   &compressed_cache_size))
+    compressed_cache_size = 0;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "TREE_MEMORY",
+					   &tree_budget))
+    tree_budget = 0;
+  /* collapsed directories are loaded again from the cache */
+  if ( (0 != tree_budget) &&
+       (NULL == cache_directory) )
+  {
+    fprintf (stderr,
+	     _("`%s' has no effect without the `%s' option\n"),
+	     "TREE_MEMORY",
+	     "-C");
+    tree_budget = 0;
+  }
+  /* published content never changes, but the mount can switch to
+     another version (or lose a mount) at any time and the high-level
+     FUSE API cannot invalidate what the kernel cached, so keep this
+     short unless the user knows the mount never switches */
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "KERNEL_CACHE_TIMEOUT",
+					   &kernel_timeout))
+    kernel_timeout = GNUNET_TIME_UNIT_SECONDS;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+					     GNUNET_FUSE_CONFIG_SECTION,
+					     "PREFETCH_DEPTH",
+					     &prefetch_depth))
+    prefetch_depth = 0;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "PREFETCH_BUDGET",
+					   &prefetch_budget))
+    prefetch_budget = 16 * 1024 * 1024;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+					     GNUNET_FUSE_CONFIG_SECTION,
+					     "DOWNLOAD_SLOTS",
+					     &download_slots))
+    download_slots = 4;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "READAHEAD",
+					   &readahead_size))
+    readahead_size = 512 * 1024;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "SMALL_FILE_THRESHOLD",
+					   &small_file_threshold))
+    small_file_threshold = 256 * 1024;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "SCAN_BUDGET",
+					   &scan_budget))
+    scan_budget = 4 * 1024 * 1024;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "LOCAL_TIMEOUT",
+					   &local_timeout))
+    local_timeout = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+						   250);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+					   GNUNET_FUSE_CONFIG_SECTION,
+					   "RETRY_DEADLINE",
+					   &retry_deadline))
+    retry_deadline = GNUNET_TIME_UNIT_MINUTES;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+					     GNUNET_FUSE_CONFIG_SECTION,
+					     "HEDGE_PERCENTILE",
+					     &hedge_percentile))
+    hedge_percentile = 95;
+  GNUNET_asprintf (&timeouts,
+		   "attr_timeout=%llu,entry_timeout=%llu",
+		   (unsigned long long) (kernel_timeout.rel_value_us / 1000LL / 1000LL),
+		   (unsigned long long) (kernel_timeout.rel_value_us / 1000LL / 1000LL));
+  if (GNUNET_OK != GNUNET_FUSE_cache_init (cache_directory))
+  {
+    fprintf (stderr,
+	     _("Failed to use `%s' as cache directory\n"),
+	     cache_directory);
+    ret = 6;
+    if (NULL != uri)
+      GNUNET_FS_uri_destroy (uri);
+    GNUNET_free (timeouts);
+    return;
+  }
+  if (GNUNET_OK != GNUNET_FUSE_warmup_init (warmup_manifest))
+  {
+    fprintf (stderr,
+	     _("Failed to read warmup manifest `%s'\n"),
+	     warmup_manifest);
+    ret = 7;
+    GNUNET_FUSE_cache_done ();
+    if (NULL != uri)
+      GNUNET_FS_uri_destroy (uri);
+    GNUNET_free (timeouts);
+    return;
+  }
+  GNUNET_FUSE_attr_cache_init (attr_cache_size);
+  GNUNET_FUSE_hot_cache_init (hot_cache_size,
+			      compressed_cache_size);
+  GNUNET_FUSE_scheduler_init ((unsigned int) GNUNET_MIN (download_slots, UINT_MAX));
+  GNUNET_FUSE_stats_init ();
+  GNUNET_FUSE_content_init ();
+  GNUNET_FUSE_download_init (local_timeout,
+			     retry_deadline,
+			     (unsigned int) GNUNET_MIN (hedge_percentile, 100));
+  GNUNET_FUSE_prefetch_init (prefetch_depth,
+			     prefetch_budget);
+  GNUNET_FUSE_scan_init (scan_budget);
+  GNUNET_FUSE_preload_init ();
+
+  root_lock = GNUNET_mutex_create (GNUNET_NO);
+  switch_lock = GNUNET_mutex_create (GNUNET_NO);
+  tree_lock = GNUNET_mutex_create (GNUNET_NO);
+  trim_threshold = tree_budget;
+  root = GNUNET_FUSE_path_info_create (NULL, "/", uri, GNUNET_YES);
+  if (NULL != mounts_file)
+  {
+    /* the root only exists in memory and lists the mounted
+       directories, so there is nothing to load */
+    if (GNUNET_OK != read_mounts (mounts_file))
+    {
+      fprintf (stderr,
+	       _("Failed to read mounts file `%s'\n"),
+	       mounts_file);
+      ret = 8;
+    }
+  }
+  else if (GNUNET_YES == background)
+  {
+    /* mount at once, 'gn_init' will start loading the root */
+    root_loading_lock = GNUNET_mutex_create (GNUNET_NO);
+    root_loaded_cond = GNUNET_cond_create ();
+    root_loading = GNUNET_YES;
+  }
+  else if (GNUNET_OK !=
+	   GNUNET_FUSE_load_directory (root,
+				       GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+				       &eno))
   {
     fprintf (stderr,
 	     _("Failed to mount `%s': %s\n"),
 	     source,
 	     strerror (eno));
     ret = 5;
+  }
+  if (0 != ret)
+  {
+    GNUNET_FUSE_prefetch_done ();
+    GNUNET_FUSE_warmup_done ();
+    GNUNET_FUSE_preload_done ();
+    GNUNET_FUSE_download_done ();
+    GNUNET_FUSE_hot_cache_done ();
+    GNUNET_FUSE_stats_done ();
+    GNUNET_FUSE_scheduler_done ();
+    GNUNET_FUSE_attr_cache_done ();
+    GNUNET_FUSE_cache_done ();
     cleanup_path_info (root);
-    GNUNET_FS_uri_destroy (uri);
+    GNUNET_FUSE_content_done ();
+    GNUNET_mutex_destroy (tree_lock);
+    GNUNET_mutex_destroy (switch_lock);
+    GNUNET_mutex_destroy (root_lock);
+    if (NULL != uri)
+      GNUNET_FS_uri_destroy (uri);
+    GNUNET_free (timeouts);
     return;
   }
 
   if (GNUNET_YES == single_threaded)
-    argc = 5;
+    argc = 7;
   else
-    argc = 2;
+    argc = 4;
 
   {
     char *a[argc + 1];
     a[0] = "gnunet-fuse";
     a[1] = directory;
+    a[2] = "-o";
+    a[3] = timeouts;
     if (GNUNET_YES == single_threaded)
       {
-	a[2] = "-s";
-	a[3] = "-f";
-	a[4] = "-d";
+	a[4] = "-s";
+	a[5] = "-f";
+	a[6] = "-d";
       }
     a[argc] = NULL;
     fuse_main (argc, a, &fops, NULL);
   }
+  if (NULL != root_loading_lock)
+  {
+    if (GNUNET_YES == root_loader_started)
+      GNUNET_break (0 == pthread_join (root_loader, NULL));
+    GNUNET_cond_destroy (root_loaded_cond);
+    GNUNET_mutex_destroy (root_loading_lock);
+    root_loading_lock = NULL;
+  }
+  GNUNET_FUSE_scheduler_stop_background ();
+  GNUNET_FUSE_prefetch_done ();
+  GNUNET_FUSE_warmup_done ();
+  GNUNET_FUSE_preload_done ();
+  GNUNET_FUSE_download_done ();
+  GNUNET_FUSE_hot_cache_done ();
+  GNUNET_FUSE_stats_done ();
+  GNUNET_FUSE_scheduler_done ();
+  GNUNET_FUSE_attr_cache_done ();
+  GNUNET_FUSE_cache_done ();
   cleanup_path_info (root);
-  GNUNET_FS_uri_destroy (uri);
+  GNUNET_FUSE_content_done ();
+  GNUNET_mutex_destroy (tree_lock);
+  GNUNET_mutex_destroy (switch_lock);
+  GNUNET_mutex_destroy (root_lock);
+  if (NULL != uri)
+    GNUNET_FS_uri_destroy (uri);
+  GNUNET_free (timeouts);
 }
 
 
@@ -497,6 +2774,20 @@ int
 main (int argc, char *const *argv)
 {
   struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_option_flag ('b',
+                               "background",
+                               gettext_noop ("mount at once and load the root directory in the background"),
+                               &background),
+    GNUNET_GETOPT_option_filename ('C',
+                                   "cache-directory",
+                                   "PATH",
+                                   gettext_noop ("keep downloaded directories in PATH across mounts"),
+                                   &cache_directory),
+    GNUNET_GETOPT_option_filename ('M',
+                                   "mounts",
+                                   "FILE",
+                                   gettext_noop ("mount the URIs listed in FILE (one NAME URI pair per line) as top-level entries, instead of a single URI"),
+                                   &mounts_file),
     GNUNET_GETOPT_option_string ('s',
                                  "source",
                                  "URI",
@@ -507,20 +2798,41 @@ main (int argc, char *const *argv)
                                  "PATH",
                                  gettext_noop ("path to your mountpoint"),
                                  &directory),
+    GNUNET_GETOPT_option_filename ('w',
+                                   "warmup",
+                                   "FILE",
+                                   gettext_noop ("fetch the paths listed in FILE in the background after mounting"),
+                                   &warmup_manifest),
+    GNUNET_GETOPT_option_relative_time ('D',
+                                        "deadline",
+                                        "DELAY",
+                                        gettext_noop ("fail operations that wait longer than DELAY for a download with EAGAIN, the download goes on (default: forever)"),
+                                        &operation_deadline),
+    GNUNET_GETOPT_option_flag ('O',
+                               "offline",
+                               gettext_noop ("only serve data that does not need to be downloaded, fail other operations with ENODATA"),
+                               &offline),
     GNUNET_GETOPT_option_flag ('t',
                                "single-threaded",
                                gettext_noop ("run in single-threaded mode"),
                                &single_threaded),
+    GNUNET_GETOPT_option_relative_time ('T',
+                                        "root-timeout",
+                                        "DELAY",
+                                        gettext_noop ("how long operations wait for the root directory to be loaded in the background (default: forever)"),
+                                        &root_timeout),
     GNUNET_GETOPT_OPTION_END
   };
 
+  root_timeout = GNUNET_TIME_UNIT_FOREVER_REL;
+  operation_deadline = GNUNET_TIME_UNIT_FOREVER_REL;
   GNUNET_log_setup ("gnunet-fuse",
 		    "DEBUG",
 		    NULL);
   return (GNUNET_OK ==
 	  GNUNET_PROGRAM_run2 (argc,
 			       argv,
-			       "gnunet-fuse -s URI [-- FUSE-OPTIONS] DIRECTORYNAME",
+			       "gnunet-fuse {-s URI | -M FILE} [-- FUSE-OPTIONS] DIRECTORYNAME",
 			       gettext_noop
 			       ("fuse"),
 			       options,
@@ -35,6 +35,63 @@
 #include "mutex.h"
 
 
+/**
+ * Section of the configuration with the options for gnunet-fuse.
+ */
+#define GNUNET_FUSE_CONFIG_SECTION "gnunet-fuse"
+
+/**
+ * Extended attribute of the root (or of the top-level entries when
+ * mounting several URIs) with the URI of the mounted directory;
+ * setting it switches to another version.
+ */
+#define GNUNET_FUSE_URI_XATTR "user.gnunet-fuse.uri"
+
+/**
+ * Prefix of the extended attributes of the root to add (by setting
+ * them to a URI) and remove top-level entries when mounting several
+ * URIs; the rest of the name is the name of the entry.
+ */
+#define GNUNET_FUSE_MOUNT_XATTR_PREFIX "user.gnunet-fuse.mount."
+
+/**
+ * Extended attribute of the root listing the top-level entries when
+ * mounting several URIs.
+ */
+#define GNUNET_FUSE_MOUNTS_XATTR "user.gnunet-fuse.mounts"
+
+/**
+ * Extended attribute of files and directories with their metadata
+ * from the directory they are in.
+ */
+#define GNUNET_FUSE_META_XATTR "user.gnunet-fuse.meta"
+
+
+/**
+ * Priorities of downloads.
+ */
+enum GNUNET_FUSE_DownloadPriority
+{
+
+  /**
+   * A file system operation is waiting for the download.
+   */
+  GNUNET_FUSE_DOWNLOAD_FOREGROUND = 0,
+
+  /**
+   * Data that is likely to be read soon.
+   */
+  GNUNET_FUSE_DOWNLOAD_READAHEAD = 1,
+
+  /**
+   * Speculative download (i.e. prefetching), only done while
+   * no foreground download needs the slot.
+   */
+  GNUNET_FUSE_DOWNLOAD_BACKGROUND = 2
+
+};
+
+
 /**
  * Anonymity level to use.
  */
@@ -45,6 +102,130 @@ extern unsigned int anonymity_level;
  */
 extern const struct GNUNET_CONFIGURATION_Handle *cfg;
 
+/**
+ * Number of bytes to read ahead of sequential reads (0 for none).
+ */
+extern unsigned long long readahead_size;
+
+/**
+ * Files up to this size are downloaded whole when they are opened
+ * (0 to disable).
+ */
+extern unsigned long long small_file_threshold;
+
+/**
+ * GNUNET_YES to only serve data that is available without
+ * downloading (option -O).
+ */
+extern int offline;
+
+/**
+ * How long file system operations wait for downloads before they
+ * fail with EAGAIN (option -D).
+ */
+extern struct GNUNET_TIME_Relative operation_deadline;
+
+
+/**
+ * Index of the entries of a directory (see gfs_index.h).
+ */
+struct GNUNET_FUSE_DirectoryIndex;
+
+/**
+ * A running download (see gfs_download.h).
+ */
+struct GNUNET_FUSE_Download;
+
+/**
+ * A partial download in the persistent cache (see gfs_cache.h).
+ */
+struct GNUNET_FUSE_CachePartial;
+
+
+/**
+ * Downloaded content of a file or directory.  All path info entries
+ * with the same CHK (i.e. the same file in several directories)
+ * share one content (see gfs_content.h), so that it is downloaded
+ * and stored only once.
+ */
+struct GNUNET_FUSE_Content
+{
+
+  /**
+   * Key of the content in the map of all contents (derived from
+   * the CHK).
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Lock for 'tmpfile', 'tmpfile_cached' and 'open_count'.
+   * Lock order: lock path info entries first.
+   */
+  struct GNUNET_Mutex *lock;
+
+  /**
+   * Name of temporary file, NULL if we never accessed the content.
+   */
+  char *tmpfile;
+
+  /**
+   * GNUNET_YES if 'tmpfile' is in the persistent cache and must
+   * thus not be removed with the content.
+   */
+  int tmpfile_cached;
+
+  /**
+   * Partial download in the persistent cache that 'tmpfile' refers
+   * to (shared with other processes), NULL if none.  Only set once
+   * (before downloads start) and kept until the content is released.
+   */
+  struct GNUNET_FUSE_CachePartial *partial;
+
+  /**
+   * Bitmap of the blocks (of GNUNET_FUSE_BLOCK_SIZE bytes) of the
+   * content that are available in 'tmpfile', NULL if none.
+   * Protected by the lock of the download subsystem (see
+   * gfs_download.c).
+   */
+  uint8_t *blocks;
+
+  /**
+   * Number of blocks that are not available in 'tmpfile' (while
+   * 'blocks' is allocated).  Protected by the lock of the download
+   * subsystem.
+   */
+  uint64_t blocks_missing;
+
+  /**
+   * Head of the downloads into 'tmpfile' that are running.
+   */
+  struct GNUNET_FUSE_Download *download_head;
+
+  /**
+   * Tail of the downloads into 'tmpfile' that are running.
+   */
+  struct GNUNET_FUSE_Download *download_tail;
+
+  /**
+   * Number of operations waiting for blocks of the content.
+   * Protected by the lock of the download subsystem (see
+   * gfs_download.c).
+   */
+  unsigned int waiters;
+
+  /**
+   * Number of open handles of all entries with this content.
+   */
+  unsigned int open_count;
+
+  /**
+   * Number of path info entries with this content.  Protected by
+   * the lock of the map of all contents (see gfs_content.c).
+   */
+  unsigned int rc;
+
+};
+
 
 /**
  * struct containing mapped Path, with URI and other Information like Attributes etc.
@@ -68,26 +249,35 @@ struct GNUNET_FUSE_PathInfo
   struct GNUNET_FUSE_PathInfo *parent;
 
   /**
-   * Head of linked list of entries in this directory
-   * (NULL if this is a file).
+   * Head of linked list of entries in this directory that
+   * have been accessed so far (NULL if this is a file).
    */
   struct GNUNET_FUSE_PathInfo *child_head;
 
   /**
-   * Head of linked list of entries in this directory
-   * (NULL if this is a file).
+   * Tail of linked list of entries in this directory that
+   * have been accessed so far (NULL if this is a file).
    */
   struct GNUNET_FUSE_PathInfo *child_tail;
 
   /**
-   * URI of the file or directory.
+   * Entries in this directory by their position in 'index';
+   * 'readdir' offsets refer to positions in this array.  NULL
+   * for entries that have not been accessed so far (and for
+   * deleted entries).  NULL if this is a file.
    */
-  struct GNUNET_FS_Uri *uri;
+  struct GNUNET_FUSE_PathInfo **children;
 
   /**
-   * meta data to corresponding path (can be NULL)
+   * Index of the entries of this directory, NULL if this is a file
+   * or if the directory has not been loaded yet.
    */
-  struct GNUNET_CONTAINER_MetaData *meta;
+  struct GNUNET_FUSE_DirectoryIndex *index;
+
+  /**
+   * URI of the file or directory.
+   */
+  struct GNUNET_FS_Uri *uri;
 
   /**
    * Name of the file for this path (i.e. "home").  '/' for the root (all other
@@ -96,9 +286,10 @@ struct GNUNET_FUSE_PathInfo
   char *filename;
 
   /**
-   * Name of temporary file, NULL if we never accessed this file or directory.
+   * Downloaded content of the file or directory (shared with all
+   * entries with the same URI).
    */
-  char *tmpfile;
+  struct GNUNET_FUSE_Content *content;
 
   /**
    * file attributes
@@ -112,26 +303,85 @@ struct GNUNET_FUSE_PathInfo
   struct GNUNET_Mutex *lock;
 
   /**
-   * Beginning of a contiguous range of blocks of the file what we
-   * have downloaded already to 'tmpfile'.
+   * End of the last read from the file, to detect sequential reads.
+   */
+  uint64_t read_end;
+
+  /**
+   * End of the range requested by readahead so far.
+   */
+  uint64_t readahead_end;
+
+  /**
+   * Number of entries used in 'children'.
+   */
+  unsigned int children_length;
+
+  /**
+   * Number of entries allocated in 'children'.
    */
-  uint64_t download_start;
+  unsigned int children_size;
 
   /**
-   * End of a contiguous range of blocks of the file what we
-   * have downloaded already to 'tmpfile'.
+   * Position of this entry in the 'children' index of its parent.
    */
-  uint64_t download_end;
+  unsigned int child_offset;
 
   /**
    * Reference counter (used if the file is deleted while being opened, etc.)
    */
   unsigned int rc;
 
+  /**
+   * Number of open handles of the file.
+   */
+  unsigned int open_count;
+
   /**
    * Should the file be deleted after the RC hits zero?
    */
   int delete_later;
+
+  /**
+   * When was an entry of this directory last opened (to detect
+   * scans, see gfs_scan.h).
+   */
+  struct GNUNET_TIME_Absolute scan_last_open;
+
+  /**
+   * Number of different entries of this directory opened in quick
+   * succession.
+   */
+  unsigned int scan_opens;
+
+  /**
+   * Position of the entry of this directory that was opened last.
+   */
+  unsigned int scan_last_child;
+
+  /**
+   * Position of the next entry of this directory to fetch for a scan.
+   */
+  unsigned int scan_next;
+
+  /**
+   * Fetch more entries for a scan once it opens the entry at this
+   * position.
+   */
+  unsigned int scan_refill;
+
+  /**
+   * GNUNET_YES once the subdirectories of this directory were
+   * handed to the crawler (see gfs_prefetch.h).
+   */
+  int prefetched;
+
+  /**
+   * When was this entry last looked up (or loaded, for a directory).
+   * Directories that were not used for the longest time are the
+   * first to be collapsed when the tree uses too much memory.
+   */
+  struct GNUNET_TIME_Absolute last_used;
 };
 
 
@@ -187,17 +437,185 @@ GNUNET_FUSE_path_info_delete (struct GNUNET_FUSE_PathInfo *pi);
 
 
 /**
- * Load and parse a directory.
+ * Decode the metadata of an entry from the serialized directory it
+ * is in.  Metadata is not kept in memory (it can be large, i.e.
+ * thumbnails), so this reads the directory from the persistent
+ * cache each time.  Caller must hold a reference to 'pi' but no
+ * locks of path info entries.
+ *
+ * @param pi the entry
+ * @return NULL if the entry has no metadata or the directory is not
+ *         in the persistent cache, otherwise the metadata (to be
+ *         destroyed by the caller)
+ */
+struct GNUNET_CONTAINER_MetaData *
+GNUNET_FUSE_path_info_get_meta (struct GNUNET_FUSE_PathInfo *pi);
+
+
+/**
+ * Collapse directories that were not used for a while back to "not
+ * loaded" if the tree uses more memory than allowed.  Only
+ * directories whose index is in the persistent cache and below
+ * which no entry is in use are collapsed.  Cheap unless the tree
+ * is over its budget, and then walks the tree at most once every
+ * TRIM_INTERVAL seconds.  Must be called without holding the lock
+ * of any path info entry.
+ */
+void
+GNUNET_FUSE_path_info_trim (void);
+
+
+/**
+ * Load and parse a directory (entries of the directory are only
+ * created once they are accessed).  Caller must hold the lock
+ * of 'pi'.
  *
  * @param pi path to the directory
+ * @param priority priority for downloading the directory; loading
+ *        a directory in the foreground also starts prefetching
+ *        its subdirectories
  * @param eno where to store 'errno' on errors
  * @return GNUNET_OK on success
  */
 int
 GNUNET_FUSE_load_directory (struct GNUNET_FUSE_PathInfo *pi,
+                            enum GNUNET_FUSE_DownloadPriority priority,
                             int *eno);
 
 
+/**
+ * Load and parse a directory without holding its lock while we
+ * download it, so that operations on the directory do not wait
+ * for speculative work.  The lock is only taken to install the
+ * index (unless another thread loaded the directory meanwhile).
+ * Caller must hold a reference to 'pi', but not its lock.
+ *
+ * @param pi path to the directory
+ * @param priority priority for downloading the directory
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_load_directory_unlocked (struct GNUNET_FUSE_PathInfo *pi,
+                                     enum GNUNET_FUSE_DownloadPriority priority,
+                                     int *eno);
+
+
+/**
+ * Get the entry at the given position in a loaded directory.
+ *
+ * @param pi the directory
+ * @param pos position of the entry in the directory
+ * @return NULL on error, otherwise the entry with
+ *         incremented reference counter (!)
+ */
+struct GNUNET_FUSE_PathInfo *
+GNUNET_FUSE_path_info_get_child (struct GNUNET_FUSE_PathInfo *pi,
+                                 unsigned int pos);
+
+
+/**
+ * Get the name and attributes of the entry at the given position
+ * in a loaded directory, without creating a path info entry for it.
+ * Caller must hold the lock of 'pi'.
+ *
+ * @param pi the directory
+ * @param pos position of the entry
+ * @param stbuf where to store the attributes of the entry
+ * @return name of the entry (valid while 'pi' is locked),
+ *         NULL if 'pos' is past the last entry
+ */
+const char *
+GNUNET_FUSE_path_info_get_entry (struct GNUNET_FUSE_PathInfo *pi,
+                                 unsigned int pos,
+                                 struct stat *stbuf);
+
+
+/**
+ * Wait for the background loading of the root directory (if any)
+ * to finish.  Must not be called while holding the lock of the root.
+ *
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK once the root can be accessed, GNUNET_SYSERR if
+ *         we gave up waiting
+ */
+int
+GNUNET_FUSE_root_wait (int *eno);
+
+
+/**
+ * Switch to another version of the root directory.  Entries that
+ * did not change are moved to the new version with their data (and
+ * everything below them); only directories that changed are loaded.
+ * Not possible when mounting several URIs (switch the mounted
+ * directories with 'GNUNET_FUSE_mount_add' instead).
+ *
+ * @param uri URI of the new version of the root directory
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_root_switch (const struct GNUNET_FS_Uri *uri,
+                         int *eno);
+
+
+/**
+ * Mount a directory as a top-level entry of the mount, or switch an
+ * entry that was mounted under the same name to another version
+ * (like 'GNUNET_FUSE_root_switch').  Only possible when mounting
+ * several URIs.
+ *
+ * @param name name of the entry
+ * @param uri URI of the directory
+ * @param flags XATTR_CREATE to fail (with EEXIST) if an entry is
+ *        mounted under the name, XATTR_REPLACE to fail (with
+ *        ENODATA) if none is, or 0
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_mount_add (const char *name,
+                       const struct GNUNET_FS_Uri *uri,
+                       int flags,
+                       int *eno);
+
+
+/**
+ * Remove a top-level entry that was mounted with
+ * 'GNUNET_FUSE_mount_add' (or from the mounts file).  Files of the
+ * entry that are open can still be read.
+ *
+ * @param name name of the entry
+ * @param eno where to store 'errno' on errors
+ * @return GNUNET_OK on success
+ */
+int
+GNUNET_FUSE_mount_remove (const char *name,
+                          int *eno);
+
+
+/**
+ * List the top-level entries when mounting several URIs.
+ *
+ * @return one line with the name and URI of each entry (caller must
+ *         free), NULL if we mount a single URI
+ */
+char *
+GNUNET_FUSE_mount_list (void);
+
+
+/**
+ * Check if the calling thread serves a FUSE operation (and can thus
+ * be interrupted by FUSE and has a deadline).  Threads loading the
+ * root before mounting or in the background, the crawler and the
+ * like do not.
+ *
+ * @return GNUNET_YES if the thread serves a FUSE operation
+ */
+int
+GNUNET_FUSE_in_operation (void);
+
+
 /* FUSE function files */
 int gn_getattr (const char *path, struct stat *stbuf);
 
@@ -209,6 +627,16 @@ int gn_read (const char *path, char *buf, size_t size, off_t offset,
 int gn_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
                 off_t offset, struct fuse_file_info *fi);
 
+int gn_getxattr (const char *path, const char *name, char *value,
+                 size_t size);
+
+int gn_setxattr (const char *path, const char *name, const char *value,
+                 size_t size, int flags);
+
+int gn_removexattr (const char *path, const char *name);
+
+int gn_release (const char *path, struct fuse_file_info *fi);
+
 
 int gn_mknod (const char *path, mode_t mode, dev_t rdev);
 
@@ -225,8 +653,6 @@ int gn_truncate (const char *path, off_t size);
 int gn_write (const char *path, const char *buf, size_t size, off_t offset,
               struct fuse_file_info *fi);
 
-int gn_release (const char *path, struct fuse_file_info *fi);
-
 int gn_utimens (const char *path, const struct timespec ts[2]);
 
 
@@ -121,4 +121,86 @@ GNUNET_mutex_unlock (struct GNUNET_Mutex * mutex)
 }
 
 
+/**
+ * @brief Condition variable.
+ */
+struct GNUNET_Cond
+{
+  pthread_cond_t pt;
+};
+
+
+struct GNUNET_Cond *
+GNUNET_cond_create ()
+{
+  struct GNUNET_Cond *cond;
+
+  cond = GNUNET_new (struct GNUNET_Cond);
+  GNUNET_assert (0 == pthread_cond_init (&cond->pt, NULL));
+  return cond;
+}
+
+
+void
+GNUNET_cond_destroy (struct GNUNET_Cond *cond)
+{
+  GNUNET_assert (0 == pthread_cond_destroy (&cond->pt));
+  GNUNET_free (cond);
+}
+
+
+void
+GNUNET_cond_wait (struct GNUNET_Cond *cond,
+		  struct GNUNET_Mutex *mutex)
+{
+  if (0 != (errno = pthread_cond_wait (&cond->pt, &mutex->pt)))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "pthread_cond_wait");
+    GNUNET_assert (0);
+  }
+}
+
+
+int
+GNUNET_cond_timedwait (struct GNUNET_Cond *cond,
+		       struct GNUNET_Mutex *mutex,
+		       struct GNUNET_TIME_Absolute deadline)
+{
+  struct timespec ts;
+  int ret;
+
+  if (deadline.abs_value_us == GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us)
+  {
+    GNUNET_cond_wait (cond, mutex);
+    return GNUNET_OK;
+  }
+  /* GNUnet time is based on the realtime clock, as is pthread_cond_timedwait */
+  ts.tv_sec = deadline.abs_value_us / 1000LL / 1000LL;
+  ts.tv_nsec = (deadline.abs_value_us % (1000LL * 1000LL)) * 1000LL;
+  ret = pthread_cond_timedwait (&cond->pt, &mutex->pt, &ts);
+  if (ETIMEDOUT == ret)
+    return GNUNET_NO;
+  if (0 != (errno = ret))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "pthread_cond_timedwait");
+    GNUNET_assert (0);
+  }
+  return GNUNET_OK;
+}
+
+
+void
+GNUNET_cond_signal (struct GNUNET_Cond *cond)
+{
+  GNUNET_assert (0 == pthread_cond_signal (&cond->pt));
+}
+
+
+void
+GNUNET_cond_broadcast (struct GNUNET_Cond *cond)
+{
+  GNUNET_assert (0 == pthread_cond_broadcast (&cond->pt));
+}
+
+
 /* end of mutex.c */
@@ -63,6 +63,45 @@ void
 GNUNET_mutex_unlock (struct GNUNET_Mutex *mutex);
 
 
+/**
+ * @brief Condition variable, used together with a non-recursive mutex.
+ */
+struct GNUNET_Cond;
+
+
+struct GNUNET_Cond *
+GNUNET_cond_create (void);
+
+
+void
+GNUNET_cond_destroy (struct GNUNET_Cond *cond);
+
+
+void
+GNUNET_cond_wait (struct GNUNET_Cond *cond,
+                  struct GNUNET_Mutex *mutex);
+
+
+/**
+ * Wait for the condition to be signalled or for the deadline
+ * to pass, whichever comes first.
+ *
+ * @return GNUNET_OK if signalled, GNUNET_NO on timeout
+ */
+int
+GNUNET_cond_timedwait (struct GNUNET_Cond *cond,
+                       struct GNUNET_Mutex *mutex,
+                       struct GNUNET_TIME_Absolute deadline);
+
+
+void
+GNUNET_cond_signal (struct GNUNET_Cond *cond);
+
+
+void
+GNUNET_cond_broadcast (struct GNUNET_Cond *cond);
+
+
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
 #endif
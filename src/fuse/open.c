@@ -48,22 +48,51 @@
  */
 #include "gnunet-fuse.h"
 #include "gfs_download.h"
+#include "gfs_scan.h"
 
 
 int
 gn_open (const char *path, struct fuse_file_info *fi)
 {
   struct GNUNET_FUSE_PathInfo *pi;
+  uint64_t fsize;
   int eno;
 
   pi = GNUNET_FUSE_path_info_get (path, &eno);
   if (NULL == pi)
     return - eno;
-  /* NOTE: once we allow writes, we need to keep the RC
-     incremented until close... */
-  GNUNET_FUSE_path_info_done (pi);
   if (O_RDONLY != (fi->flags & 3))
+  {
+    GNUNET_FUSE_path_info_done (pi);
     return - EACCES;
+  }
+  /* keep the RC incremented until 'gn_release' */
+  GNUNET_mutex_lock (pi->lock);
+  pi->open_count++;
+  GNUNET_mutex_lock (pi->content->lock);
+  pi->content->open_count++;
+  fsize = GNUNET_FS_uri_chk_get_file_size (pi->uri);
+  if ( (GNUNET_YES != offline) &&
+       (0 != fsize) &&
+       (fsize <= small_file_threshold) &&
+       (pi->readahead_end < fsize) )
+  {
+    /* small files are usually read whole; fetch them with a single
+       download (that may share a process with other small files)
+       instead of one per read */
+    if (GNUNET_OK == GNUNET_FUSE_download_prepare (pi))
+    {
+      pi->readahead_end = fsize;
+      GNUNET_FUSE_download_start (pi,
+				  0,
+				  fsize,
+				  GNUNET_FUSE_DOWNLOAD_READAHEAD);
+    }
+  }
+  GNUNET_mutex_unlock (pi->content->lock);
+  GNUNET_mutex_unlock (pi->lock);
+  GNUNET_FUSE_scan_open (pi);
+  fi->fh = (uint64_t) (uintptr_t) pi;
   return 0;
 }
 
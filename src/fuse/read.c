@@ -42,6 +42,7 @@
  */
 #include "gnunet-fuse.h"
 #include "gfs_download.h"
+#include "gfs_hot_cache.h"
 
 
 
@@ -51,12 +52,17 @@ gn_read (const char *path, char *buf, size_t size, off_t offset,
 {
   struct GNUNET_FUSE_PathInfo *path_info;
   uint64_t fsize;
+  uint64_t start;
   struct GNUNET_DISK_FileHandle *fh;
   int eno;
+  int hot;
 
-  path_info = GNUNET_FUSE_path_info_get (path, &eno);
-  if (NULL == path_info)
-    return - eno;
+  /* read the file that was opened, even if the root was switched
+     to a new version since */
+  path_info = (struct GNUNET_FUSE_PathInfo *) (uintptr_t) fi->fh;
+  GNUNET_mutex_lock (path_info->lock);
+  ++path_info->rc;
+  GNUNET_mutex_unlock (path_info->lock);
   fsize = GNUNET_FS_uri_chk_get_file_size (path_info->uri);
   if (offset > fsize)
   {
@@ -64,66 +70,81 @@ gn_read (const char *path, char *buf, size_t size, off_t offset,
 		"No data available at offset %llu of file `%s'\n",
 		(unsigned long long) offset,
 		path);
+    GNUNET_FUSE_path_info_done (path_info);
     return 0; 
   }
   if (offset + size > fsize)
     size = fsize - offset;
-  if (NULL == path_info->tmpfile)
+  if (GNUNET_YES == GNUNET_FUSE_hot_cache_get (path_info->content,
+					       offset,
+					       size,
+					       buf))
+  {
+    GNUNET_mutex_lock (path_info->lock);
+    path_info->read_end = offset + size;
+    GNUNET_mutex_unlock (path_info->lock);
+    GNUNET_FUSE_path_info_done (path_info);
+    return size;
+  }
+  GNUNET_mutex_lock (path_info->lock);
+  GNUNET_mutex_lock (path_info->content->lock);
+  /* store to temporary file, or to the persistent cache where other
+     processes may have downloaded parts of the file (when offline,
+     we fail with ENODATA below if none of them did) */
+  if (GNUNET_OK != GNUNET_FUSE_download_prepare (path_info))
   {
-    /* store to temporary file */
-    path_info->tmpfile = GNUNET_DISK_mktemp ("gnunet-fuse-tempfile");
-    if (GNUNET_OK != GNUNET_FUSE_download_file (path_info, 
-						offset,
-						size))
-    {
-      unlink (path_info->tmpfile);
-      GNUNET_free (path_info->tmpfile);
-      path_info->tmpfile = NULL;
-      GNUNET_FUSE_path_info_done (path_info);
-      return - EIO; /* low level IO error */
-    }
-  } 
-  else
+    GNUNET_mutex_unlock (path_info->content->lock);
+    GNUNET_mutex_unlock (path_info->lock);
+    GNUNET_FUSE_path_info_done (path_info);
+    return - EIO;
+  }
+  GNUNET_mutex_unlock (path_info->content->lock);
+  if ( (fsize <= small_file_threshold) &&
+       (path_info->readahead_end < fsize) )
   {
-    if ( (offset < path_info->download_start) ||
-	 (size + offset > path_info->download_end) )
-    {
-      /* need to download some more... */
-      if (GNUNET_OK != GNUNET_FUSE_download_file (path_info, 
-						  offset,
-						  size))
-      {
-	unlink (path_info->tmpfile);
-	GNUNET_free (path_info->tmpfile);
-	path_info->tmpfile = NULL;
-	GNUNET_FUSE_path_info_done (path_info);
-	return - EIO; /* low level IO error */
-      }
-    }
+    /* 'gn_open' did not fetch the small file, fetch all of it
+       with the first read */
+    path_info->readahead_end = fsize;
+    GNUNET_FUSE_download_start (path_info,
+				0,
+				fsize,
+				GNUNET_FUSE_DOWNLOAD_FOREGROUND);
   }
-  /* combine ranges */
-  if (path_info->download_start == path_info->download_end)
+  /* on sequential reads, keep the next window coming while
+     the reader is busy with this one */
+  else if ( (0 != readahead_size) &&
+	    (offset == path_info->read_end) &&
+	    (offset + size < fsize) &&
+	    (path_info->readahead_end < offset + size + readahead_size / 2) )
   {
-    /* first range */
-    path_info->download_start = offset;
-    path_info->download_end = offset + size;
+    start = GNUNET_MAX (path_info->readahead_end, offset + size);
+    path_info->readahead_end = GNUNET_MIN (fsize, offset + size + readahead_size);
+    GNUNET_FUSE_download_start (path_info,
+				start,
+				path_info->readahead_end - start,
+				GNUNET_FUSE_DOWNLOAD_READAHEAD);
   }
-  else
+  /* blocks of large files that are read sequentially are read
+     once, keep them out of the hot cache */
+  hot = ( (fsize <= small_file_threshold) ||
+	  (0 == offset) ||
+	  (offset != path_info->read_end) ) ? GNUNET_YES : GNUNET_NO;
+  path_info->read_end = offset + size;
+  GNUNET_mutex_unlock (path_info->lock);
+  /* returns as soon as our blocks are there, even if a larger
+     download that provides them is still running */
+  if (GNUNET_OK != GNUNET_FUSE_download_file (path_info,
+					      offset,
+					      size,
+					      GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+					      &eno))
   {
-    /* only combine ranges if the resulting range would
-       be contiguous... */
-    if ( (offset >= path_info->download_start) &&
-	 (offset <= path_info->download_end) &&
-	 (offset + size > path_info->download_end) )
-      path_info->download_end = offset + size;
-    if ( (offset + size >= path_info->download_start) &&
-	 (offset + size <= path_info->download_end) &&
-	 (offset < path_info->download_start) )
-      path_info->download_start = offset;
+    /* keep the blocks we have, the next read may need them */
+    GNUNET_FUSE_path_info_done (path_info);
+    return - eno;
   }
 
-
-  fh = GNUNET_DISK_file_open (path_info->tmpfile,
+  fh = GNUNET_DISK_file_open (path_info->content->tmpfile,
 			      GNUNET_DISK_OPEN_READ,
 			      GNUNET_DISK_PERM_NONE);			      
   if (NULL == fh)
@@ -159,6 +180,12 @@ gn_read (const char *path, char *buf, size_t size, off_t offset,
     GNUNET_FUSE_path_info_done (path_info);
     return - eno; 
   }
+  if (GNUNET_YES == hot)
+    GNUNET_FUSE_hot_cache_put (path_info->content,
+			       fh,
+			       fsize,
+			       offset,
+			       size);
   GNUNET_DISK_file_close (fh);
   GNUNET_FUSE_path_info_done (path_info);
   return size;
@@ -52,6 +52,17 @@
  */
 #include "gnunet-fuse.h"
 #include "gfs_download.h"
+#include "gfs_attr_cache.h"
+#include "gfs_prefetch.h"
+
+
+/**
+ * Offset of the first directory entry; offsets 0 and 1 are used
+ * for "." and "..".  The entry at position 'i' in the directory
+ * index is reported with offset 'i + FIRST_CHILD_OFFSET + 1', which
+ * is the offset at which the next 'readdir' call resumes.
+ */
+#define FIRST_CHILD_OFFSET 2
 
 
 int
@@ -59,21 +70,56 @@ gn_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
 	    off_t offset, struct fuse_file_info *fi)
 {
   struct GNUNET_FUSE_PathInfo *path_info;
-  struct GNUNET_FUSE_PathInfo *pos;
+  struct stat stbuf;
+  const char *name;
+  unsigned int i;
   int eno;
 
+  /* the lookup does not wait for the root of "/", but we need its
+     listing; wait before we take any lock of the root */
+  if ( ('\0' == path[strspn (path, "/")]) &&
+       (GNUNET_OK != GNUNET_FUSE_root_wait (&eno)) )
+    return - eno;
   path_info = GNUNET_FUSE_path_info_get (path, &eno);
   if (NULL == path_info)
     return - eno;
-  if ( (NULL == path_info->tmpfile) &&
-       (GNUNET_OK != GNUNET_FUSE_load_directory (path_info, &eno)) )
+  GNUNET_mutex_lock (path_info->lock);
+  if ( (NULL == path_info->index) &&
+       (GNUNET_OK != GNUNET_FUSE_load_directory (path_info,
+						GNUNET_FUSE_DOWNLOAD_FOREGROUND,
+						&eno)) )
+  {
+    GNUNET_mutex_unlock (path_info->lock);
+    GNUNET_FUSE_path_info_done (path_info);
     return - eno;
-  filler (buf, ".", NULL, 0);
-  filler (buf, "..", NULL, 0);
-  for (pos = path_info->child_head; NULL != pos; pos = pos->next)
-    filler (buf, pos->filename, 
-	    &pos->stbuf,
-	    0);
+  }
+  /* the directory may have been loaded by the crawler; continue
+     prefetching from here as the user is browsing it now */
+  GNUNET_FUSE_prefetch_directory (path_info);
+  if ( (offset < 1) &&
+       (0 != filler (buf, ".", NULL, 1)) )
+    goto full;
+  if ( (offset < 2) &&
+       (0 != filler (buf, "..", NULL, 2)) )
+    goto full;
+  /* resume directly at the position in the index */
+  for (i = (offset > FIRST_CHILD_OFFSET) ? offset - FIRST_CHILD_OFFSET : 0;
+       NULL != (name = GNUNET_FUSE_path_info_get_entry (path_info,
+							i,
+							&stbuf));
+       i++)
+  {
+    /* the kernel will ask for the attributes next; have them ready */
+    GNUNET_FUSE_attr_cache_put (path,
+				name,
+				&stbuf);
+    if (0 != filler (buf, name,
+		     &stbuf,
+		     i + FIRST_CHILD_OFFSET + 1))
+      break;
+  }
+ full:
+  GNUNET_mutex_unlock (path_info->lock);
   GNUNET_FUSE_path_info_done (path_info);
   return 0;
 }
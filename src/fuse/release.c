@@ -0,0 +1,72 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+  
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/*
+ * release.c - FUSE release function
+ *
+ * Release an open file
+ *
+ * Release is called when there are no more references to an open
+ * file: all file descriptors are closed and all memory mappings
+ * are unmapped.
+ *
+ * For every open() call there will be exactly one release() call
+ * with the same flags and file descriptor.  It is possible to
+ * have a file opened more than once, in which case only the last
+ * release will mean, that no more reads/writes will happen on the
+ * file.  The return value of release is ignored.
+ *
+ * Changed in version 2.2
+ */
+
+/**
+ * @file fuse/release.c
+ * @brief closing files
+ */
+#include "gnunet-fuse.h"
+#include "gfs_download.h"
+
+
+int
+gn_release (const char *path, struct fuse_file_info *fi)
+{
+  struct GNUNET_FUSE_PathInfo *pi;
+  int unused;
+
+  pi = (struct GNUNET_FUSE_PathInfo *) (uintptr_t) fi->fh;
+  GNUNET_mutex_lock (pi->lock);
+  if (0 == --pi->open_count)
+  {
+    /* the next reader starts over */
+    pi->read_end = 0;
+    pi->readahead_end = 0;
+  }
+  GNUNET_mutex_lock (pi->content->lock);
+  unused = (0 == --pi->content->open_count) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_mutex_unlock (pi->content->lock);
+  GNUNET_mutex_unlock (pi->lock);
+  /* nobody will read what we are reading ahead (through any
+     entry with the same content) */
+  if (GNUNET_YES == unused)
+    GNUNET_FUSE_download_cancel (pi);
+  GNUNET_FUSE_path_info_done (pi);
+  return 0;
+}
+
+/* end of release.c */
@@ -0,0 +1,52 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/*
+ * removexattr.c - FUSE removexattr function
+ *
+ *	 Remove extended attributes.
+ *
+ * Removing the attribute that mounted a top-level entry (when
+ * mounting several URIs) removes the entry.
+ */
+/**
+ * @file fuse/removexattr.c
+ * @brief extended attributes to remove mounted directories
+ */
+#include "gnunet-fuse.h"
+
+
+int
+gn_removexattr (const char *path, const char *name)
+{
+  int eno;
+
+  if ( (0 != strcmp (path, "/")) ||
+       (0 != strncmp (name,
+		      GNUNET_FUSE_MOUNT_XATTR_PREFIX,
+		      strlen (GNUNET_FUSE_MOUNT_XATTR_PREFIX))) )
+    return - ENOTSUP;
+  if (GNUNET_OK !=
+      GNUNET_FUSE_mount_remove (&name[strlen (GNUNET_FUSE_MOUNT_XATTR_PREFIX)],
+				&eno))
+    return - eno;
+  return 0;
+}
+
+/* end of removexattr.c */
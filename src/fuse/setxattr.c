@@ -0,0 +1,150 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/*
+ * setxattr.c - FUSE setxattr function
+ *
+ *	 Set extended attributes.
+ *
+ * We have no extended attributes that can be stored; setting one
+ * of ours is a way to trigger an action on a file or directory
+ * (i.e. switching the root to a new version or mounting another
+ * directory).
+ */
+/**
+ * @file fuse/setxattr.c
+ * @brief extended attributes to control the mount
+ */
+#include "gnunet-fuse.h"
+#include "gfs_preload.h"
+#include <sys/xattr.h>
+
+
+/**
+ * Largest value we accept for an attribute (URIs are much smaller,
+ * even with a location).
+ */
+#define MAX_VALUE_SIZE 4096
+
+/**
+ * Parse the value of an attribute as a URI.
+ *
+ * @param value the value (not 0-terminated)
+ * @param size number of bytes in 'value', at most MAX_VALUE_SIZE
+ * @return NULL if the value is not a valid URI
+ */
+static struct GNUNET_FS_Uri *
+parse_uri (const char *value,
+	   size_t size)
+{
+  struct GNUNET_FS_Uri *uri;
+  char *buf;
+  char *emsg;
+
+  buf = GNUNET_malloc (size + 1);
+  memcpy (buf, value, size);
+  buf[size] = '\0';
+  if (NULL == (uri = GNUNET_FS_uri_parse (buf, &emsg)))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("Invalid URI `%s': %s\n"),
+		buf,
+		emsg);
+    GNUNET_free (emsg);
+  }
+  GNUNET_free (buf);
+  return uri;
+}
+
+
+int
+gn_setxattr (const char *path, const char *name, const char *value,
+	     size_t size, int flags)
+{
+  struct GNUNET_FUSE_PathInfo *pi;
+  struct GNUNET_FS_Uri *uri;
+  char *status;
+  const char *mount;
+  int eno;
+  int ret;
+
+  if (0 != (flags & ~(XATTR_CREATE | XATTR_REPLACE)))
+    return - EINVAL;
+  if (size > MAX_VALUE_SIZE)
+    return - E2BIG;
+  mount = NULL;
+  if (0 == strcmp (name, GNUNET_FUSE_URI_XATTR))
+  {
+    /* the root, or a top-level entry when mounting several URIs */
+    if ( (0 != strcmp (path, "/")) &&
+	 ( ('/' != path[0]) ||
+	   (NULL != strchr (&path[1], '/')) ) )
+      return - ENOTSUP;
+    if (0 != strcmp (path, "/"))
+      mount = &path[1];
+    else if (0 != (flags & XATTR_CREATE))
+      return - EEXIST; /* the root always has a URI */
+  }
+  else if (0 == strncmp (name,
+			 GNUNET_FUSE_MOUNT_XATTR_PREFIX,
+			 strlen (GNUNET_FUSE_MOUNT_XATTR_PREFIX)))
+  {
+    if (0 != strcmp (path, "/"))
+      return - ENOTSUP;
+    mount = &name[strlen (GNUNET_FUSE_MOUNT_XATTR_PREFIX)];
+  }
+  else if (0 == strcmp (name, GNUNET_FUSE_PRELOAD_XATTR))
+  {
+    if (NULL == (pi = GNUNET_FUSE_path_info_get (path, &eno)))
+      return - eno;
+    /* the attribute exists once the directory was preloaded */
+    status = GNUNET_FUSE_preload_status (pi);
+    if (! S_ISDIR (pi->stbuf.st_mode))
+      ret = - ENOTDIR;
+    else if (NULL == pi->uri)
+      ret = - ENOTSUP; /* root when mounting several URIs */
+    else if ( (NULL != status) &&
+	      (0 != (flags & XATTR_CREATE)) )
+      ret = - EEXIST;
+    else if ( (NULL == status) &&
+	      (0 != (flags & XATTR_REPLACE)) )
+      ret = - ENODATA;
+    else if (GNUNET_OK != GNUNET_FUSE_preload_start (pi, &eno))
+      ret = - eno;
+    else
+      ret = 0;
+    GNUNET_free_non_null (status);
+    GNUNET_FUSE_path_info_done (pi);
+    return ret;
+  }
+  else
+  {
+    return - ENOTSUP;
+  }
+  if (NULL == (uri = parse_uri (value, size)))
+    return - EINVAL;
+  if (NULL == mount)
+    ret = GNUNET_FUSE_root_switch (uri, &eno);
+  else
+    ret = GNUNET_FUSE_mount_add (mount, uri, flags, &eno);
+  GNUNET_FS_uri_destroy (uri);
+  return (GNUNET_OK == ret) ? 0 : - eno;
+}
+
+/* end of setxattr.c */
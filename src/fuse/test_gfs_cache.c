@@ -0,0 +1,258 @@
+/*
+  This file is part of gnunet-fuse.
+  Copyright (C) 2026 GNUnet e.V.
+
+  gnunet-fuse is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3, or (at your
+  option) any later version.
+
+  gnunet-fuse is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+
+*/
+/**
+ * @file fuse/test_gfs_cache.c
+ * @brief testcase for partial downloads shared through the
+ *        persistent cache
+ *
+ * A second process (forked, so that 'flock' sees two users) and we
+ * download into the same "part" file: blocks one of us records in
+ * the map must show up in the map of the other, and the file must
+ * only get its cache name once and only lose its "part" name once
+ * nobody uses it anymore.
+ */
+#include "gfs_cache.h"
+#include "gfs_download.h"
+
+
+/**
+ * Number of blocks of the file we download.
+ */
+#define NUM_BLOCKS 20
+
+/**
+ * Size of the map of the file we download.
+ */
+#define MAP_SIZE ((NUM_BLOCKS + 7) / 8)
+
+
+/**
+ * Build the URI of a file with NUM_BLOCKS blocks.
+ *
+ * @return the URI
+ */
+static struct GNUNET_FS_Uri *
+make_uri ()
+{
+  struct GNUNET_HashCode key;
+  struct GNUNET_HashCode query;
+  struct GNUNET_CRYPTO_HashAsciiEncoded ke;
+  struct GNUNET_CRYPTO_HashAsciiEncoded qe;
+  struct GNUNET_FS_Uri *uri;
+  char *us;
+  char *emsg;
+
+  GNUNET_CRYPTO_hash ("key", 3, &key);
+  GNUNET_CRYPTO_hash ("query", 5, &query);
+  GNUNET_CRYPTO_hash_to_enc (&key, &ke);
+  GNUNET_CRYPTO_hash_to_enc (&query, &qe);
+  GNUNET_asprintf (&us,
+		   "%s%s%s.%s.%llu",
+		   GNUNET_FS_URI_PREFIX,
+		   GNUNET_FS_URI_CHK_INFIX,
+		   (const char *) &ke,
+		   (const char *) &qe,
+		   (unsigned long long) NUM_BLOCKS * GNUNET_FUSE_BLOCK_SIZE);
+  emsg = NULL;
+  uri = GNUNET_FS_uri_parse (us, &emsg);
+  GNUNET_free_non_null (emsg);
+  GNUNET_free (us);
+  return uri;
+}
+
+
+/**
+ * Write a block of the file, like a download process would.
+ *
+ * @param cp the partial download
+ * @param block number of the block
+ * @return GNUNET_OK on success
+ */
+static int
+write_block (struct GNUNET_FUSE_CachePartial *cp,
+	     uint64_t block)
+{
+  char buf[GNUNET_FUSE_BLOCK_SIZE];
+  int fd;
+  int ret;
+
+  memset (buf, (int) block, sizeof (buf));
+  if (-1 == (fd = open (GNUNET_FUSE_cache_partial_get_filename (cp), O_WRONLY)))
+    return GNUNET_SYSERR;
+  ret = (sizeof (buf) == pwrite (fd, buf, sizeof (buf), block * GNUNET_FUSE_BLOCK_SIZE))
+    ? GNUNET_OK : GNUNET_SYSERR;
+  GNUNET_break (0 == close (fd));
+  return ret;
+}
+
+
+/**
+ * Test if a block is set in a map.
+ *
+ * @param map the map
+ * @param block number of the block
+ * @return GNUNET_YES if the block is set
+ */
+static int
+test_bit (const uint8_t *map,
+	  uint64_t block)
+{
+  return (0 != (map[block / 8] & (1 << (block % 8)))) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * The second user of the partial download: records blocks 10-12.
+ *
+ * @param uri URI of the file
+ * @return exit status
+ */
+static int
+child (const struct GNUNET_FS_Uri *uri)
+{
+  struct GNUNET_FUSE_CachePartial *cp;
+  uint64_t block;
+
+  if (NULL == (cp = GNUNET_FUSE_cache_partial_open (uri)))
+    return 1;
+  for (block = 10; block <= 12; block++)
+    if (GNUNET_OK != write_block (cp, block))
+      return 2;
+  GNUNET_FUSE_cache_partial_add_blocks (cp, 10, 12);
+  GNUNET_FUSE_cache_partial_flush (cp);
+  GNUNET_FUSE_cache_partial_close (cp);
+  return 0;
+}
+
+
+/**
+ * Run the test in a cache directory.
+ *
+ * @param uri URI of the file
+ * @return 0 on success
+ */
+static int
+check (const struct GNUNET_FS_Uri *uri)
+{
+  struct GNUNET_FUSE_CachePartial *cp;
+  struct GNUNET_FUSE_CachePartial *cp2;
+  uint8_t map[MAP_SIZE];
+  uint64_t block;
+  char *part;
+  int expected;
+  int status;
+  pid_t pid;
+
+  if (NULL == (cp = GNUNET_FUSE_cache_partial_open (uri)))
+    return 1;
+  part = GNUNET_strdup (GNUNET_FUSE_cache_partial_get_filename (cp));
+  GNUNET_FUSE_cache_partial_read_map (cp, map, sizeof (map));
+  for (block = 0; block < NUM_BLOCKS; block++)
+    if (GNUNET_NO != test_bit (map, block))
+      return 2;
+  /* our blocks */
+  for (block = 0; block <= 2; block++)
+    if (GNUNET_OK != write_block (cp, block))
+      return 3;
+  GNUNET_FUSE_cache_partial_add_blocks (cp, 0, 2);
+  GNUNET_FUSE_cache_partial_flush (cp);
+  /* blocks of another process */
+  pid = fork ();
+  if (-1 == pid)
+    return 4;
+  if (0 == pid)
+    _exit (child (uri));
+  if ( (pid != waitpid (pid, &status, 0)) ||
+       (! WIFEXITED (status)) ||
+       (0 != WEXITSTATUS (status)) )
+    return 5;
+  GNUNET_FUSE_cache_partial_read_map (cp, map, sizeof (map));
+  for (block = 0; block < NUM_BLOCKS; block++)
+  {
+    expected = ( (block <= 2) ||
+		 ( (block >= 10) && (block <= 12) ) ) ? GNUNET_YES : GNUNET_NO;
+    if (expected != test_bit (map, block))
+      return 6;
+  }
+  /* the other process left, but we still use the partial download */
+  if (GNUNET_YES != GNUNET_DISK_file_test (part))
+    return 7;
+  for (block = 0; block < NUM_BLOCKS; block++)
+  {
+    if (GNUNET_YES == test_bit (map, block))
+      continue;
+    if (GNUNET_OK != write_block (cp, block))
+      return 8;
+    GNUNET_FUSE_cache_partial_add_blocks (cp, block, block);
+  }
+  /* a second user publishing the same file must not replace it */
+  if (NULL == (cp2 = GNUNET_FUSE_cache_partial_open (uri)))
+    return 9;
+  if ( (GNUNET_OK != GNUNET_FUSE_cache_partial_publish (cp)) ||
+       (GNUNET_YES != GNUNET_FUSE_cache_test (uri)) ||
+       (GNUNET_NO != GNUNET_FUSE_cache_partial_publish (cp2)) )
+    return 10;
+  /* publishing wrote the pending blocks to the map */
+  GNUNET_FUSE_cache_partial_read_map (cp2, map, sizeof (map));
+  for (block = 0; block < NUM_BLOCKS; block++)
+    if (GNUNET_YES != test_bit (map, block))
+      return 11;
+  GNUNET_FUSE_cache_partial_close (cp);
+  if (GNUNET_YES != GNUNET_DISK_file_test (part))
+    return 12;
+  GNUNET_FUSE_cache_partial_close (cp2);
+  if (GNUNET_NO != GNUNET_DISK_file_test (part))
+    return 13;
+  GNUNET_free (part);
+  return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_FS_Uri *uri;
+  char *dir;
+  int ret;
+
+  GNUNET_log_setup ("test-gfs-cache",
+		    "WARNING",
+		    NULL);
+  if (NULL == (dir = GNUNET_DISK_mkdtemp ("test-gfs-cache")))
+    return 1;
+  ret = 1;
+  if ( (NULL != (uri = make_uri ())) &&
+       (GNUNET_OK == GNUNET_FUSE_cache_init (dir)) )
+  {
+    ret = check (uri);
+    GNUNET_FUSE_cache_done ();
+  }
+  if (NULL != uri)
+    GNUNET_FS_uri_destroy (uri);
+  if (0 != ret)
+    fprintf (stderr,
+	     "Test failed at step %d\n",
+	     ret);
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_directory_remove (dir));
+  GNUNET_free (dir);
+  return ret;
+}
+
+/* end of test_gfs_cache.c */